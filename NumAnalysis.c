@@ -1,852 +1,4657 @@
-#include <ctype.h>
-#include <float.h>
-#include <stdlib.h>
-#include <stdio.h>
-#include <math.h>
-#include <string.h>
-
-#ifndef M_PI
-#define M_PI 3.14159265358979323846
-#endif
-
-#ifndef M_E
-#define M_E 2.71828182845904523536
-#endif
+#include "NumAnalysis.h"
 
-#define EPSILON 0.0001
 #define h 0.001
 
-enum {ASSOC_NONE = 0, ASSOC_LEFT, ASSOC_RIGHT};
+/* Internals of the compiler, the JIT, the symbol table and the thread pool; NumAnalysis.h has the API. */
 
 typedef struct {
-    char* operator;
-    int prec;
-    int assoc;
-    float(*func)(float a, float b);
-} Operator;
+    const char* name;
+    int type;
+    int index;
+} Symbol;
+
+/*
+ * Node of an expression tree; op, index and exponent as in Instr, value the
+ * constant or log base. image, uses and slot are scratch space of the
+ * optimisation passes.
+ */
+typedef struct ExprNode {
+    int op;
+    int index;
+    int exponent;
+    long double value;
+    struct ExprNode* left;
+    struct ExprNode* right;
+    struct ExprNode* image;
+    int uses;
+    int slot;
+} ExprNode;
+
+/* Open-addressing hash table of DAG nodes, for common-subexpression elimination. */
+typedef struct {
+    ExprNode** entries;
+    int capacity;
+    int count;
+} NodeTable;
 
 typedef struct {
-    char *name;
-    float (*func)(float val);
-} Function;
+    unsigned char* bytes;
+    size_t length;
+    size_t capacity;
+} CodeBuffer;
 
 typedef struct {
-    char* input;
-} Var;
-
-typedef struct Node {
-    Var Variable;
-    struct Node* next;
-} Node;
-
-float eval_exp(float a, float b) { return powf(a, b); }
-float eval_add(float a, float b) { return a+b; }
-float eval_sub(float a, float b) { return a-b; }
-float eval_mult(float a, float b) { return a*b; }
-float eval_div(float a, float b) { return a/b; }
-float eval_log(float a, float b) { return log10f(a)/log10f(b); }
-
-float eval_sin(float angle) { return sinf(angle); }
-float eval_cos(float angle) { return cosf(angle); }
-float eval_tan(float angle) { return tanf(angle); }
-float eval_csc(float angle) { return 1/sinf(angle); }
-float eval_sec(float angle) { return 1/cosf(angle); }
-float eval_cot(float angle) { return 1/tanf(angle); }
-float eval_arcsin(float angle) { return asinf(angle); }
-float eval_arccos(float angle) { return acosf(angle); }
-float eval_arctan(float angle) { return atanf(angle); }
-
-Node* createNode(Var data);
-void insertAtBeginning(Node** headref, Var data);
-void popTop(Node** headref);
-void freeList(Node* head);
-void printList(Node* head);
-
-void parse(char* func, Var** infix);
-void shuntingYard(Var* infix, Var** postfix);
-float evalPostfix(Var* postfix, float x);
-
-int matchStrings(char* string, int structNum);
-int findStruct(char* string, int structNum);
-int isInt(char* string);
-
-float bisection(float a, float b, Var* postfix);
-float regula_falsi(float a, float b, Var* postfix);
-float newton_raphson(float a, float b, Var* postfix);
-float numerical_derivative(Var* postfix);
-float simpsons(float a, float b, Var* postfix);
-float trapezoidal(float a, float b, Var* postfix);
-float gregory_newton(Var* postfix);
-void inverse_matrix();
-void gauus_elimination();
-void gauss_seidal();
-
-void takeIntervals(float *a, float *b, Var* postfix);
-float derive(Var* postfix, float x);
-
-Function functions[] = {
-    {"\0", NULL},
-    {"log", NULL},
-    {"arcsin", eval_arcsin},
-    {"arccos", eval_arccos},
-    {"arctan", eval_arctan},
-    {"sin", eval_sin},
-    {"cos", eval_cos},
-    {"tan", eval_tan},
-    {"csc", eval_csc},
-    {"sec", eval_sec},
-    {"cot", eval_cot},
-    {"end"}
+    void (*body)(void* ctx, int lo, int hi);
+    void* ctx;
+    int end;
+    int chunk;
+    atomic_int next;
+} ParallelJob;
+
+/* submit is held by the thread whose job is on the pool, or by setThreadCount while it resizes. */
+typedef struct {
+    pthread_t* threads;
+    int count;
+    pthread_mutex_t submit;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    ParallelJob* job;
+    unsigned long generation;
+    int active;
+} ThreadPool;
+
+static const long double kronrodNodes[7];
+static const long double kronrodWeights[8];
+static const long double gaussWeights[4];
+static const double powersOfTen[23];
+
+static void batchSinCos(float* vals, int count, float scale, int cosine);
+static void* poolWorker(void* arg);
+static void runChunks(ParallelJob* job);
+static void startPool(void);
+static void resizePool(int count);
+static void copyVariables(Expr* from, Expr* to);
+static ExprNode* buildTree(Expr* expr, Arena* arena);
+static ExprNode* differentiateNode(ExprNode* node, Arena* arena);
+static ExprNode* makeNode(Arena* arena, int op, int index, ExprNode* left, ExprNode* right);
+static ExprNode* makeConst(Arena* arena, long double value);
+static ExprNode* makeSum(Arena* arena, ExprNode* a, ExprNode* b);
+static ExprNode* makeDifference(Arena* arena, ExprNode* a, ExprNode* b);
+static ExprNode* makeProduct(Arena* arena, ExprNode* a, ExprNode* b);
+static ExprNode* makeQuotient(Arena* arena, ExprNode* a, ExprNode* b);
+static ExprNode* makePower(Arena* arena, ExprNode* base, long double exponent);
+static ExprNode* makeFunction(Arena* arena, float (*func)(float val), ExprNode* arg);
+static int isConst(ExprNode* node, long double value);
+static ExprNode* simplifyNode(ExprNode* node, Arena* arena);
+static unsigned int hashNode(ExprNode* node);
+static int sameNode(ExprNode* a, ExprNode* b);
+static ExprNode* lookupNode(NodeTable* table, ExprNode* node);
+static ExprNode* internBinary(NodeTable* table, Arena* arena, int op, ExprNode* a, ExprNode* b);
+static ExprNode* internNode(ExprNode* node, NodeTable* table, Arena* arena);
+static int countUses(ExprNode* node);
+static void emitNode(ExprNode* node, Expr* expr, int depth);
+static void compileTree(ExprNode* root, Expr* expr, Arena* arena);
+static int functionIndex(float (*func)(float val));
+#ifdef JIT_X86_64
+static void emitBytes(CodeBuffer* buf, const void* bytes, size_t n);
+static void emitByte(CodeBuffer* buf, unsigned char byte);
+static void emit32(CodeBuffer* buf, unsigned int value);
+static void emit64(CodeBuffer* buf, unsigned long long value);
+static void emitSlot(CodeBuffer* buf, unsigned char op, int reg, int disp);
+static void emitCall(CodeBuffer* buf, void* func);
+static void emitBody(CodeBuffer* buf, Expr* expr, int xOffset, int slotBase);
+#endif
+static int isInt(char* string);
+#ifdef BENCHMARK
+static float evalPostfix(Var* postfix, int size, float x);
+static int matchStrings(char* string, int structNum);
+static int findStruct(char* string, int structNum);
+#endif
+static void classifyToken(Var* var);
+static void initSymbols(void);
+static void insertSymbol(const char* name, int type, int index);
+static Symbol* lookupSymbol(const char* name);
+static unsigned int hashName(const char* name);
+
+#define SCALAR_DEFINITIONS
+#include "NumAnalysisPrecision.h"
+
+Function functions[MAX_FUNCTIONS] = {
+    {"\0", NULL, 0, NULL, NULL},
+    {"log", NULL, 0, NULL, NULL},
+    {"arcsin", eval_arcsin, 0, eval_arcsin_d, eval_arcsin_ld},
+    {"arccos", eval_arccos, 0, eval_arccos_d, eval_arccos_ld},
+    {"arctan", eval_arctan, 0, eval_arctan_d, eval_arctan_ld},
+    {"sin", eval_sin, 1, eval_sin_d, eval_sin_ld},
+    {"cos", eval_cos, 1, eval_cos_d, eval_cos_ld},
+    {"tan", eval_tan, 1, eval_tan_d, eval_tan_ld},
+    {"csc", eval_csc, 1, eval_csc_d, eval_csc_ld},
+    {"sec", eval_sec, 1, eval_sec_d, eval_sec_ld},
+    {"cot", eval_cot, 1, eval_cot_d, eval_cot_ld},
+    {"exp", eval_exp1, 0, eval_exp1_d, eval_exp1_ld},
+    {"ln", eval_ln, 0, eval_ln_d, eval_ln_ld},
+    {"sqrt", eval_sqrt, 0, eval_sqrt_d, eval_sqrt_ld},
+    {"abs", eval_abs, 0, eval_abs_d, eval_abs_ld},
+    {"sinh", eval_sinh, 0, eval_sinh_d, eval_sinh_ld},
+    {"cosh", eval_cosh, 0, eval_cosh_d, eval_cosh_ld},
+    {"tanh", eval_tanh, 0, eval_tanh_d, eval_tanh_ld},
+    {.name = "end"}
 };
 Operator operators[] = {
-    {"\0", 0, ASSOC_NONE, NULL},
-    {"_", 1, ASSOC_RIGHT, eval_log},
-    {"^", 3, ASSOC_RIGHT, eval_exp},
-    {"*", 2, ASSOC_LEFT, eval_mult},
-    {"/", 2, ASSOC_LEFT, eval_div},
-    {"+", 1, ASSOC_LEFT, eval_add},
-    {"-", 1, ASSOC_LEFT, eval_sub},
-    {"end"}
+    {"\0", 0, ASSOC_NONE, NULL, NULL, NULL},
+    {"_", 1, ASSOC_RIGHT, eval_log, eval_log_d, eval_log_ld},
+    {"^", 3, ASSOC_RIGHT, eval_exp, eval_exp_d, eval_exp_ld},
+    {"*", 2, ASSOC_LEFT, eval_mult, eval_mult_d, eval_mult_ld},
+    {"/", 2, ASSOC_LEFT, eval_div, eval_div_d, eval_div_ld},
+    {"+", 1, ASSOC_LEFT, eval_add, eval_add_d, eval_add_ld},
+    {"-", 1, ASSOC_LEFT, eval_sub, eval_sub_d, eval_sub_ld},
+    {.operator = "end"}
+};
+
+/* Gauss-Kronrod 7-15 abscissae (positive half, outermost first) and weights; the last Kronrod and Gauss weights belong to the centre. */
+static const long double kronrodNodes[7] = {
+    0.991455371120812639206854697526329L, 0.949107912342758524526189684047851L,
+    0.864864423359769072789712788640926L, 0.741531185599394439863864773280788L,
+    0.586087235467691130294144845693013L, 0.405845151377397166906606412076961L,
+    0.207784955007898467600689403773245L
+};
+static const long double kronrodWeights[8] = {
+    0.022935322010529224963732008058970L, 0.063092092629978553290700663189204L,
+    0.104790010322250183839876322541518L, 0.140653259715525918745189590510238L,
+    0.169004726639267902826583426598550L, 0.190350578064785409913256402421014L,
+    0.204432940075298892414161999234649L, 0.209482141084727828012999174891714L
 };
-int size = 0;
-
-int main() {
-    char* input = (char*) calloc(100, sizeof(char));
-    Var* infix = (Var*) calloc(100, sizeof(Var));
-    Var* postfix = (Var*) calloc(size, sizeof(Var));
-
-    int funcNeeded[] = {1, 2, 3, 7, 8, 9};
-
-    int methodSelected = 0;
-    printf("Choose a method:\n");
-    printf("1. Bisection Method\n");
-    printf("2. Regula-Falsi Method\n");
-    printf("3. Newton-Raphson\n");
-    printf("4. Inverse of an NxN Matrix\n");
-    printf("5. Gauus Elimination\n");
-    printf("6. Gauss Seidal Methods\n");
-    printf("7. Numerical Derviative\n");
-    printf("8. Simpson Method\n");
-    printf("9. Trapezoidal Method\n");
-    printf("10. Gregory Newton Interpolation\n");
-    printf("Method (1-10): ");
-    scanf("%d", &methodSelected);
-
-    if (methodSelected > 10 || methodSelected < 1) {
-        printf("out of bounds.");
-        exit(1);
-    }
-
-    getchar();
-
-    for (int i = 0; i < 6; i++) {
-        if (methodSelected == funcNeeded[i]) {
-            printf("(Use _ for base, ^ for exponent, *,/,+,- for arithmetics, arc for inverse trig, csc/sec/cot for reciprocals of sin/cos/tan)\n");
-            printf("Input Function: ");
-            fgets(input, 100, stdin);
-
-            input = (char*) realloc(input, strlen(input) + 1);
-            for (int i = 0; input[i] != '\0'; i++) {
-                if (input[i] == '\n') {
-                    input[i] = '\0';
+static const long double gaussWeights[4] = {
+    0.129484966168869693270611432679082L, 0.279705391489276667901467771423780L,
+    0.381830050505118944950369775488975L, 0.417959183673469387755102040816327L
+};
+
+static const double powersOfTen[23] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* Filled on first use by initSymbols; after that only registerFunction writes to it. */
+static Symbol* symbols = NULL;
+static int symbolCapacity = 0;
+static pthread_once_t symbolsOnce = PTHREAD_ONCE_INIT;
+
+static ThreadPool pool = {NULL, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, 0, 0};
+static pthread_once_t poolOnce = PTHREAD_ONCE_INIT;
+static int threadCount = 0;
+/* Set in the pool workers, and in a caller while its job is on the pool. */
+static _Thread_local int inPool = 0;
+
+/*
+ * Splits func into tokens. All token strings and the infix array itself are
+ * carved out of the arena, so the whole expression is released at once with
+ * arenaFree. The infix array is sized up front: every character yields at
+ * most one token plus one implicit '*'. Returns the number of tokens. The
+ * token counts are passed along rather than kept in globals, so
+ * expressions can be compiled on several threads at once.
+ */
+int parse(const char* func, Arena* arena, Var** infix) {
+    size_t length = strlen(func);
+    char* text = (char*) arenaAlloc(arena, length + 1);
+    char buffer = '\0';
+    int i = 0;
+
+    int k = 0;
+    for (int l = 0; func[l]; l++) {
+        if (func[l] != ' ') {
+            text[k++] = func[l];
+        }
+    }
+    text[k] = '\0';
+
+    *infix = (Var*) arenaAlloc(arena, (2 * k + 1) * sizeof(Var));
+    int size = 0;
+
+    while (text[i] != '\0') {
+        int start = i;
+        int buffered = 0;
+
+        if (isdigit(text[i]) || text[i] == '.') {
+            while (isdigit(text[i]) || text[i] == '.') {
+                i++;
+            }
+        } else if (isalpha(text[i])) {
+            while (isalpha(text[i])) {
+                i++;
+            }
+            /* A number followed by a variable, as in 2x or 3theta, is a product. */
+            char name[i - start + 1];
+            memcpy(name, text + start, i - start);
+            name[i - start] = '\0';
+            if (buffer == '\0' && size > 0 && isInt((*infix)[size-1].input) && lookupSymbol(name) == NULL) {
+                (*infix)[size].input = "*";
+                classifyToken(&(*infix)[size++]);
+            }
+        } else if (text[i] == '_') {
+            if (i == 0 || (!isdigit(text[i-1]) && text[i-1] != ')')) {
+                buffer = text[i];
+                buffered = 1;
+            }
+            i++;
+        } else {
+            i++;
+        }
+
+        if (buffered) {
+            continue;
+        }
+
+        char* token = (char*) arenaAlloc(arena, i - start + 2);
+        int j = 0;
+        if (buffer != '\0') {
+            token[j++] = buffer;
+            buffer = '\0';
+        }
+        memcpy(token + j, text + start, i - start);
+        token[j + i - start] = '\0';
+        (*infix)[size].input = token;
+        classifyToken(&(*infix)[size++]);
+    }
+    return size;
+}
+
+/* Reorders the size tokens of infix into postfix. Returns the length of postfix, or COMPILE_PARENTHESES if the parentheses do not match. */
+int shuntingYard(Var* infix, int size, Arena* arena, Var** postfix) {
+    Var* stack = (Var*) arenaAlloc(arena, (size + 1) * sizeof(Var));
+    Var* queue = (Var*) arenaAlloc(arena, (size + 1) * sizeof(Var));
+    int top = -1;
+
+    int j = 0;
+    for (int i = 0; i < size; i++) {
+        Var token = infix[i];
+
+        switch (token.type) {
+            case TOKEN_NUMBER:
+            case TOKEN_VARIABLE:
+                queue[j++] = token;
+                break;
+            case TOKEN_FUNCTION:
+            case TOKEN_LOG:
+            case TOKEN_LOGBASE:
+            case TOKEN_LPAREN:
+                stack[++top] = token;
+                break;
+            case TOKEN_OPERATOR: {
+                Operator* op = &operators[token.index];
+                while (top >= 0 && stack[top].type != TOKEN_LPAREN) {
+                    Var* head = &stack[top];
+                    int popHead = head->type != TOKEN_OPERATOR || *head->input == '_';
+                    if (!popHead) {
+                        Operator* headOp = &operators[head->index];
+                        popHead = headOp->prec > op->prec || (headOp->prec == op->prec && headOp->assoc == ASSOC_LEFT);
+                    }
+                    if (!popHead) {
+                        break;
+                    }
+                    queue[j++] = stack[top--];
                 }
+                stack[++top] = token;
+                break;
+            }
+            case TOKEN_RPAREN:
+                while (top >= 0 && stack[top].type != TOKEN_LPAREN) {
+                    queue[j++] = stack[top--];
+                }
+                if (top < 0) {
+                    return COMPILE_PARENTHESES;
+                }
+                top--;
+                break;
+        }
+    }
+
+    while (top >= 0) {
+        if (stack[top].type == TOKEN_LPAREN) {
+            return COMPILE_PARENTHESES;
+        }
+        queue[j++] = stack[top--];
+    }
+
+    *postfix = queue;
+    return j;
+}
+
+/*
+ * Translates the size tokens of postfix into expr's bytecode. Returns 0, COMPILE_IDENTIFIER for
+ * a name that is neither a variable of expr nor e or pi, or COMPILE_MALFORMED
+ * if the operands do not match the operators; expr->code is then left NULL.
+ */
+int compilePostfix(Var* postfix, int size, Expr* expr) {
+    Instr* code = (Instr*) malloc((size > 0 ? size : 1) * sizeof(Instr));
+    int length = 0;
+    int depth = 0;
+    int maxDepth = 0;
+
+    for (int i = 0; i < size; i++) {
+        char* token = postfix[i].input;
+        Instr instr = {0};
+        int pops = 0;
+
+        instr.index = postfix[i].index;
+
+        if (postfix[i].type == TOKEN_NUMBER) {
+            instr.op = OP_CONST;
+            instr.wide = strtold(token, NULL);
+            instr.value = (float) instr.wide;
+        } else if (postfix[i].type == TOKEN_OPERATOR) {
+            float (*func)(float a, float b) = operators[postfix[i].index].func;
+            Instr* prev = (length > 0) ? &code[length-1] : NULL;
+
+            if (func == eval_exp && prev != NULL && prev->op == OP_CONST && fabsf(prev->value) <= MAX_POWI && prev->value == (int) prev->value) {
+                instr.op = OP_POWI;
+                instr.exponent = (int) prev->value;
+                length--;
+                depth--;
+                pops = 1;
+            } else {
+                instr.op = (func == eval_add) ? OP_ADD :
+                           (func == eval_sub) ? OP_SUB :
+                           (func == eval_mult) ? OP_MUL :
+                           (func == eval_div) ? OP_DIV : OP_BINARY;
+                instr.binary = func;
+                pops = 2;
+            }
+        } else if (postfix[i].type == TOKEN_FUNCTION) {
+            Function* function = &functions[postfix[i].index];
+            instr.op = function->degrees ? OP_UNARY_DEG : OP_UNARY;
+            instr.unary = function->func;
+            pops = 1;
+        } else if (postfix[i].type == TOKEN_VARIABLE) {
+            int slot = lookupVariable(expr, token);
+            if (slot >= 0) {
+                instr.op = OP_VAR;
+                instr.index = slot;
+            } else if (strcmp(token, "e") == 0) {
+                instr.op = OP_CONST;
+                instr.wide = E_L;
+                instr.value = M_E;
+            } else if (strcmp(token, "pi") == 0) {
+                instr.op = OP_CONST;
+                instr.wide = PI_L;
+                instr.value = M_PI;
+            } else {
+                free(code);
+                return COMPILE_IDENTIFIER;
             }
+        } else if (postfix[i].type == TOKEN_LOGBASE) {
+            instr.op = OP_LOGBASE;
+            instr.wide = strtold(token + 1, NULL);
+            instr.value = (float) instr.wide;
+            pops = 1;
+        } else {
+            continue;
+        }
+
+        if (depth < pops) {
+            free(code);
+            return COMPILE_MALFORMED;
+        }
+        depth = depth - pops + 1;
+        if (depth > maxDepth) {
+            maxDepth = depth;
+        }
+        code[length++] = instr;
+    }
+
+    if (depth != 1) {
+        free(code);
+        return COMPILE_MALFORMED;
+    }
+
+    expr->code = code;
+    expr->length = length;
+    expr->depth = maxDepth;
+    expr->slots = 0;
+    return 0;
+}
+
+/*
+ * Parses and compiles func into expr, optimises it (optimizeExpression),
+ * JIT-compiles it where supported, and attaches its symbolic derivative
+ * (see differentiateExpression) for newton_raphson. Release with freeExpr.
+ * Returns 0, or one of the COMPILE_ errors (see compileError); expr is then
+ * empty and needs no freeExpr.
+ */
+int compileExpression(const char* func, Expr* expr) {
+    const char* names[] = {"x"};
+
+    return compileMultivariate(func, names, 1, expr);
+}
+
+/*
+ * compileExpression for a function of the count variables names; slot k
+ * (see lookupVariable) is names[k], and names[0] is the free variable of
+ * evalExpr, the root finders and the integrators. Variables other than
+ * slot 0 start at 0 and are set with setVariable, or bound per call with
+ * evalBound, evalBoundBatch and evalGrid. Any other identifier except e
+ * and pi is a COMPILE_IDENTIFIER error. Returns as compileExpression.
+ */
+int compileMultivariate(const char* func, const char* const* names, int count, Expr* expr) {
+    Arena arena = {NULL};
+    Var* infix = NULL;
+    Var* postfix = NULL;
+    int status;
+
+    *expr = (Expr) {0};
+    expr->variables = count;
+    expr->names = (char**) malloc(count * sizeof(char*));
+    expr->values = (long double*) calloc(count, sizeof(long double));
+    for (int k = 0; k < count; k++) {
+        expr->names[k] = strdup(names[k]);
+    }
+
+    int size = parse(func, &arena, &infix);
+    status = shuntingYard(infix, size, &arena, &postfix);
+    if (status >= 0) {
+        status = compilePostfix(postfix, status, expr);
+    }
+    arenaFree(&arena);
+    if (status != 0) {
+        freeExpr(expr);
+        return status;
+    }
+
+    Expr* derivative = (Expr*) malloc(sizeof(Expr));
+    if (differentiateExpression(expr, derivative) == 0) {
+        expr->derivative = derivative;
+    } else {
+        free(derivative);
+    }
+    optimizeExpression(expr);
+    jitCompile(expr);
+    return 0;
+}
+
+/* Message for a status returned by compileExpression or compileMultivariate. */
+const char* compileError(int status) {
+    switch (status) {
+        case 0: return "no error";
+        case COMPILE_PARENTHESES: return "mismatched parentheses";
+        case COMPILE_IDENTIFIER: return "unknown identifier";
+        case COMPILE_MALFORMED: return "malformed expression";
+    }
+    return "unknown error";
+}
+
+static void batchSinCos(float* vals, int count, float scale, int cosine) {
+    float in[BATCH_BLOCK];
+    memcpy(in, vals, count * sizeof(float));
+
+    for (int i = 0; i < count; i++) {
+        float x = in[i] * scale;
+        float shifted = x * (float) M_2_PI + 12582912.0f;
+        float k = shifted - 12582912.0f;
+        int q;
+        memcpy(&q, &shifted, sizeof(q));
+
+        float r = x - k * 1.5703125f - k * 4.83751296997070312e-04f - k * 7.54978995489188216e-8f;
+        float r2 = r * r;
+        float s = r * (1 + r2 * (-1.0f/6 + r2 * (1.0f/120 + r2 * (-1.0f/5040 + r2 * (1.0f/362880)))));
+        float c = 1 + r2 * (-0.5f + r2 * (1.0f/24 + r2 * (-1.0f/720 + r2 * (1.0f/40320 + r2 * (-1.0f/3628800)))));
+
+        q += cosine;
+        float v = s + (float) (q & 1) * (c - s);
+        vals[i] = (float) (1 - (q & 2)) * v;
+    }
+
+    for (int i = 0; i < count; i++) {
+        float x = in[i] * scale;
+        if (!(fabsf(x) < 1e5f)) {
+            vals[i] = cosine ? cosf(x) : sinf(x);
+        }
+    }
+}
+
+void freeExpr(Expr* expr) {
+#ifdef JIT_X86_64
+    if (expr->nativeCode != NULL) {
+        munmap(expr->nativeCode, expr->nativeSize);
+    }
+#endif
+    if (expr->derivative != NULL) {
+        freeExpr(expr->derivative);
+        free(expr->derivative);
+    }
+    for (int k = 0; k < expr->variables; k++) {
+        free(expr->names[k]);
+    }
+    free(expr->names);
+    free(expr->values);
+    free(expr->code);
+    *expr = (Expr) {0};
+}
+
+/*
+ * Slot of the variable called name, or -1 if expr has none. Names are only
+ * looked up while compiling; evaluation indexes the slots directly. An
+ * expression compiled without a variable table has x in slot 0.
+ */
+int lookupVariable(Expr* expr, const char* name) {
+    if (expr->variables == 0) {
+        return (strcmp(name, "x") == 0) ? 0 : -1;
+    }
+    for (int k = 0; k < expr->variables; k++) {
+        if (strcmp(expr->names[k], name) == 0) {
+            return k;
+        }
+    }
+    return -1;
+}
+
+/* Sets the value evalExpr and the other single-variable routines use for variable name (not slot 0). Returns its slot, or -1. */
+int setVariable(Expr* expr, const char* name, long double value) {
+    int slot = lookupVariable(expr, name);
+
+    if (slot > 0 && slot < expr->variables) {
+        expr->values[slot] = value;
+        if (expr->derivative != NULL) {
+            setVariable(expr->derivative, name, value);
+        }
+        return slot;
+    }
+    return -1;
+}
+
+/* Gives to (which has none) a copy of from's variable table and values. */
+static void copyVariables(Expr* from, Expr* to) {
+    to->variables = from->variables;
+    to->names = (char**) malloc((from->variables + 1) * sizeof(char*));
+    to->values = (long double*) malloc((from->variables + 1) * sizeof(long double));
+    for (int k = 0; k < from->variables; k++) {
+        to->names[k] = strdup(from->names[k]);
+        to->values[k] = from->values[k];
+    }
+}
+
+/* Index of func in functions[], or -1 if it is not there. */
+static int functionIndex(float (*func)(float val)) {
+    for (int i = 1; strcmp(functions[i].name, "end") != 0; i++) {
+        if (functions[i].func == func) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Rebuilds the tree of expr's bytecode in the arena; OP_CONST and OP_VAR are the leaves, and a loaded slot shares the stored node. */
+static ExprNode* buildTree(Expr* expr, Arena* arena) {
+    ExprNode** stack = (ExprNode**) arenaAlloc(arena, (expr->depth + 1) * sizeof(ExprNode*));
+    ExprNode** saved = (ExprNode**) arenaAlloc(arena, (expr->slots + 1) * sizeof(ExprNode*));
+    int top = -1;
+
+    for (int i = 0; i < expr->length; i++) {
+        Instr* instr = &expr->code[i];
+
+        if (instr->op == OP_STORE) {
+            saved[instr->index] = stack[top];
+            continue;
+        }
+        if (instr->op == OP_LOAD) {
+            stack[++top] = saved[instr->index];
+            continue;
+        }
+
+        ExprNode* node = (ExprNode*) arenaAlloc(arena, sizeof(ExprNode));
+
+        *node = (ExprNode) {.op = instr->op, .index = instr->index, .value = instr->wide};
+        if (instr->op == OP_POWI) {
+            node->exponent = instr->exponent;
+        }
+        switch (instr->op) {
+            case OP_ADD:
+            case OP_SUB:
+            case OP_MUL:
+            case OP_DIV:
+            case OP_BINARY:
+                node->right = stack[top--];
+                node->left = stack[top--];
+                break;
+            case OP_POWI:
+            case OP_UNARY:
+            case OP_UNARY_DEG:
+            case OP_LOGBASE:
+                node->left = stack[top--];
+                break;
+        }
+        stack[++top] = node;
+    }
+    return stack[0];
+}
 
-            parse(input, &infix);
-            free(input);
-            
-            shuntingYard(infix, &postfix);
-            free(infix);
+/*
+ * Allocates a node, folding it into a constant when its operands are
+ * constants. The folding is done in long double, so the float and double
+ * instantiations see correctly rounded constants.
+ */
+static ExprNode* makeNode(Arena* arena, int op, int index, ExprNode* left, ExprNode* right) {
+    ExprNode* node = (ExprNode*) arenaAlloc(arena, sizeof(ExprNode));
+
+    *node = (ExprNode) {.op = op, .index = index, .left = left, .right = right};
+    if (left != NULL && left->op == OP_CONST && (right == NULL || right->op == OP_CONST)) {
+        long double a = left->value;
+        long double b = (right != NULL) ? right->value : 0;
+        long double value = 0;
+
+        switch (op) {
+            case OP_ADD: value = a + b; break;
+            case OP_SUB: value = a - b; break;
+            case OP_MUL: value = a * b; break;
+            case OP_DIV: value = a / b; break;
+            case OP_BINARY: value = operators[index].func_ld(a, b); break;
+            case OP_UNARY: value = applyFunction_ld(&functions[index], a); break;
+            case OP_UNARY_DEG: value = applyFunction_ld(&functions[index], a * PI_L / 180); break;
+            default: return node;
         }
+        if (isfinite(value)) {
+            *node = (ExprNode) {.op = OP_CONST, .value = value};
+        }
+    }
+    return node;
+}
+
+static ExprNode* makeConst(Arena* arena, long double value) {
+    ExprNode* node = (ExprNode*) arenaAlloc(arena, sizeof(ExprNode));
+
+    *node = (ExprNode) {.op = OP_CONST, .value = value};
+    return node;
+}
+
+static int isConst(ExprNode* node, long double value) {
+    return node->op == OP_CONST && node->value == value;
+}
+
+static ExprNode* makeSum(Arena* arena, ExprNode* a, ExprNode* b) {
+    if (isConst(a, 0)) {
+        return b;
+    }
+    if (isConst(b, 0)) {
+        return a;
+    }
+    return makeNode(arena, OP_ADD, 0, a, b);
+}
+
+static ExprNode* makeDifference(Arena* arena, ExprNode* a, ExprNode* b) {
+    if (isConst(b, 0)) {
+        return a;
+    }
+    if (isConst(a, 0)) {
+        return makeProduct(arena, makeConst(arena, -1), b);
+    }
+    return makeNode(arena, OP_SUB, 0, a, b);
+}
+
+/* Products keep a constant factor on the left and merge it with a constant factor of the right operand. */
+static ExprNode* makeProduct(Arena* arena, ExprNode* a, ExprNode* b) {
+    if (isConst(a, 0) || isConst(b, 0)) {
+        return makeConst(arena, 0);
+    }
+    if (b->op == OP_CONST) {
+        ExprNode* swap = a;
+        a = b;
+        b = swap;
+    }
+    if (isConst(a, 1)) {
+        return b;
+    }
+    if (a->op == OP_CONST && b->op == OP_MUL && b->left->op == OP_CONST) {
+        return makeProduct(arena, makeConst(arena, a->value * b->left->value), b->right);
+    }
+    return makeNode(arena, OP_MUL, 0, a, b);
+}
+
+static ExprNode* makeQuotient(Arena* arena, ExprNode* a, ExprNode* b) {
+    if (isConst(a, 0)) {
+        return a;
+    }
+    if (isConst(b, 1)) {
+        return a;
+    }
+    return makeNode(arena, OP_DIV, 0, a, b);
+}
+
+/* base^exponent as OP_POWI when the exponent is a small integer, like compilePostfix does. */
+static ExprNode* makePower(Arena* arena, ExprNode* base, long double exponent) {
+    if (exponent == 0) {
+        return makeConst(arena, 1);
+    }
+    if (exponent == 1) {
+        return base;
+    }
+    if (fabsl(exponent) <= MAX_POWI && exponent == (int) exponent) {
+        if (base->op == OP_CONST) {
+            return makeConst(arena, powi_ld(base->value, (int) exponent));
+        }
+        if (base->op == OP_POWI && abs(base->exponent * (int) exponent) <= MAX_POWI) {
+            return makePower(arena, base->left, base->exponent * (int) exponent);
+        }
+        ExprNode* node = makeNode(arena, OP_POWI, 0, base, NULL);
+        node->exponent = (int) exponent;
+        return node;
     }
 
-    float a = 0;
-    float b = 0;
-    float root = 0;
+    int index = 1;
+    while (operators[index].func != eval_exp) {
+        index++;
+    }
+    return makeNode(arena, OP_BINARY, index, base, makeConst(arena, exponent));
+}
+
+static ExprNode* makeFunction(Arena* arena, float (*func)(float val), ExprNode* arg) {
+    int index = functionIndex(func);
+    return makeNode(arena, functions[index].degrees ? OP_UNARY_DEG : OP_UNARY, index, arg, NULL);
+}
+
+/*
+ * Returns d(node)/d(slot 0), built from the smart constructors above so that the
+ * zeros and ones of the rules vanish as the tree is built. Subtrees of node
+ * are shared with the result. Trigonometric functions of degrees pick up a
+ * factor pi/180 and differentiate to functions of degrees again. Returns
+ * NULL if node calls a registered function whose derivative is unknown.
+ */
+static ExprNode* differentiateNode(ExprNode* node, Arena* arena) {
+    ExprNode* u = node->left;
+    ExprNode* v = node->right;
+    ExprNode* du = NULL;
+    ExprNode* dv = NULL;
+
+    if (node->op == OP_CONST) {
+        return makeConst(arena, 0);
+    }
+    if (node->op == OP_VAR) {
+        return makeConst(arena, node->index == 0);
+    }
+    if ((du = differentiateNode(u, arena)) == NULL) {
+        return NULL;
+    }
+    if (v != NULL && (dv = differentiateNode(v, arena)) == NULL) {
+        return NULL;
+    }
+
+    switch (node->op) {
+        case OP_ADD:
+            return makeSum(arena, du, dv);
+        case OP_SUB:
+            return makeDifference(arena, du, dv);
+        case OP_MUL:
+            return makeSum(arena, makeProduct(arena, du, v), makeProduct(arena, u, dv));
+        case OP_DIV:
+            if (isConst(dv, 0)) {
+                return makeQuotient(arena, du, v);
+            }
+            return makeQuotient(arena, makeDifference(arena, makeProduct(arena, du, v), makeProduct(arena, u, dv)), makePower(arena, v, 2));
+        case OP_POWI:
+            return makeProduct(arena, makeProduct(arena, makeConst(arena, node->exponent), makePower(arena, u, node->exponent - 1)), du);
+        case OP_LOGBASE:
+            return makeQuotient(arena, du, makeProduct(arena, makeConst(arena, logl(node->value)), u));
+        case OP_BINARY:
+            if (operators[node->index].func == eval_log) {
+                /* u_v is log(u)/log(v); differentiate ln(u)/ln(v). */
+                ExprNode* ratio = makeQuotient(arena, makeFunction(arena, eval_ln, u), makeFunction(arena, eval_ln, v));
+                return (ratio->op == OP_CONST) ? makeConst(arena, 0) : differentiateNode(ratio, arena);
+            }
+            if (dv->op == OP_CONST && v->op == OP_CONST) {
+                return makeProduct(arena, makeProduct(arena, makeConst(arena, v->value), makePower(arena, u, v->value - 1)), du);
+            }
+            if (isConst(du, 0)) {
+                return makeProduct(arena, makeProduct(arena, node, makeFunction(arena, eval_ln, u)), dv);
+            }
+            /* (u^v)' = u^v (v' ln u + v u'/u) */
+            return makeProduct(arena, node, makeSum(arena, makeProduct(arena, dv, makeFunction(arena, eval_ln, u)),
+                                                   makeQuotient(arena, makeProduct(arena, v, du), u)));
+        case OP_UNARY:
+        case OP_UNARY_DEG: {
+            float (*func)(float val) = functions[node->index].func;
+            ExprNode* outer = NULL;
+
+            if (node->op == OP_UNARY_DEG) {
+                du = makeProduct(arena, makeConst(arena, PI_L / 180), du);
+            }
+            if (func == eval_sin) {
+                outer = makeFunction(arena, eval_cos, u);
+            } else if (func == eval_cos) {
+                outer = makeProduct(arena, makeConst(arena, -1), makeFunction(arena, eval_sin, u));
+            } else if (func == eval_tan) {
+                outer = makePower(arena, makeFunction(arena, eval_sec, u), 2);
+            } else if (func == eval_csc) {
+                outer = makeProduct(arena, makeConst(arena, -1), makeProduct(arena, node, makeFunction(arena, eval_cot, u)));
+            } else if (func == eval_sec) {
+                outer = makeProduct(arena, node, makeFunction(arena, eval_tan, u));
+            } else if (func == eval_cot) {
+                outer = makeProduct(arena, makeConst(arena, -1), makePower(arena, makeFunction(arena, eval_csc, u), 2));
+            } else if (func == eval_arcsin || func == eval_arccos) {
+                outer = makePower(arena, makeFunction(arena, eval_sqrt, makeDifference(arena, makeConst(arena, 1), makePower(arena, u, 2))), -1);
+                if (func == eval_arccos) {
+                    outer = makeProduct(arena, makeConst(arena, -1), outer);
+                }
+            } else if (func == eval_arctan) {
+                outer = makePower(arena, makeSum(arena, makeConst(arena, 1), makePower(arena, u, 2)), -1);
+            } else if (func == eval_exp1) {
+                outer = node;
+            } else if (func == eval_ln) {
+                return makeQuotient(arena, du, u);
+            } else if (func == eval_sqrt) {
+                return makeQuotient(arena, du, makeProduct(arena, makeConst(arena, 2), node));
+            } else if (func == eval_abs) {
+                outer = makeQuotient(arena, u, node);
+            } else if (func == eval_sinh) {
+                outer = makeFunction(arena, eval_cosh, u);
+            } else if (func == eval_cosh) {
+                outer = makeFunction(arena, eval_sinh, u);
+            } else if (func == eval_tanh) {
+                outer = makePower(arena, makeFunction(arena, eval_cosh, u), -2);
+            } else {
+                return NULL;
+            }
+            return makeProduct(arena, outer, du);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * First optimisation pass: rebuilds the tree through the smart
+ * constructors, which fold constants and drop the algebraic identities
+ * (x+0, x*1, x*0, x/1, x^1, x^0). Constant exponents of ^ become OP_POWI.
+ * Every result is a fresh node; node->image remembers it, so shared
+ * subtrees are simplified once.
+ */
+static ExprNode* simplifyNode(ExprNode* node, Arena* arena) {
+    ExprNode* a = NULL;
+    ExprNode* b = NULL;
+    ExprNode* result = NULL;
+
+    if (node->image != NULL) {
+        return node->image;
+    }
+    if (node->left != NULL) {
+        a = simplifyNode(node->left, arena);
+    }
+    if (node->right != NULL) {
+        b = simplifyNode(node->right, arena);
+    }
 
-    switch (methodSelected) {
-        case 1:
-            takeIntervals(&a, &b, postfix);
-            root = bisection(a, b, postfix);
-            printf("Root is %lf", root);
+    switch (node->op) {
+        case OP_CONST:
+            result = makeConst(arena, node->value);
+            break;
+        case OP_VAR:
+            result = makeNode(arena, OP_VAR, node->index, NULL, NULL);
+            break;
+        case OP_ADD:
+            result = makeSum(arena, a, b);
+            break;
+        case OP_SUB:
+            result = makeDifference(arena, a, b);
             break;
-        case 2:
-            takeIntervals(&a, &b, postfix);
-            root = regula_falsi(a, b, postfix);
-            printf("Root is %lf", root);
+        case OP_MUL:
+            result = makeProduct(arena, a, b);
             break;
-        case 3:
-            takeIntervals(&a, &b, postfix);
-            root = newton_raphson(a, b, postfix);
-            printf("Root is %lf", root);
+        case OP_DIV:
+            result = makeQuotient(arena, a, b);
+            break;
+        case OP_POWI:
+            result = makePower(arena, a, node->exponent);
+            break;
+        case OP_BINARY:
+            if (operators[node->index].func == eval_exp && b->op == OP_CONST) {
+                result = makePower(arena, a, b->value);
+            } else {
+                result = makeNode(arena, OP_BINARY, node->index, a, b);
+            }
             break;
-        case 4:
-            inverse_matrix();
+        case OP_UNARY:
+        case OP_UNARY_DEG:
+            result = makeNode(arena, node->op, node->index, a, NULL);
             break;
-        case 5:
-            gauus_elimination();
+        case OP_LOGBASE:
+            if (a->op == OP_CONST) {
+                result = makeConst(arena, eval_log_ld(a->value, node->value));
+            } else {
+                result = makeNode(arena, OP_LOGBASE, 0, a, NULL);
+                result->value = node->value;
+            }
             break;
-        case 6:
-            gauss_seidal();
+    }
+    node->image = result;
+    return result;
+}
+
+static unsigned int hashNode(ExprNode* node) {
+    double value = (double) node->value;
+    unsigned int hash = 2166136261u;
+    unsigned long long words[5] = {node->op, node->index, node->exponent, (size_t) node->left, (size_t) node->right};
+
+    for (int i = 0; i < 5; i++) {
+        hash = (hash ^ (unsigned int) (words[i] ^ (words[i] >> 32))) * 16777619u;
+    }
+    for (size_t i = 0; i < sizeof value; i++) {
+        hash = (hash ^ ((unsigned char*) &value)[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static int sameNode(ExprNode* a, ExprNode* b) {
+    return a->op == b->op && a->index == b->index && a->exponent == b->exponent && a->value == b->value
+           && a->left == b->left && a->right == b->right;
+}
+
+/* Returns the node in the table equal to node (whose children are already interned), inserting node if there is none. */
+static ExprNode* lookupNode(NodeTable* table, ExprNode* node) {
+    if (2 * (table->count + 1) > table->capacity) {
+        NodeTable grown = {NULL, (table->capacity > 0) ? 2 * table->capacity : 256, 0};
+        grown.entries = (ExprNode**) calloc(grown.capacity, sizeof(ExprNode*));
+        for (int i = 0; i < table->capacity; i++) {
+            if (table->entries[i] != NULL) {
+                lookupNode(&grown, table->entries[i]);
+            }
+        }
+        free(table->entries);
+        *table = grown;
+    }
+
+    unsigned int slot = hashNode(node) & (table->capacity - 1);
+    while (table->entries[slot] != NULL) {
+        if (sameNode(table->entries[slot], node)) {
+            return table->entries[slot];
+        }
+        slot = (slot + 1) & (table->capacity - 1);
+    }
+    table->entries[slot] = node;
+    table->count++;
+    return node;
+}
+
+static ExprNode* internBinary(NodeTable* table, Arena* arena, int op, ExprNode* a, ExprNode* b) {
+    ExprNode* node = (ExprNode*) arenaAlloc(arena, sizeof(ExprNode));
+
+    *node = (ExprNode) {.op = op, .left = a, .right = b};
+    return lookupNode(table, node);
+}
+
+/*
+ * Second pass: hash-conses the simplified tree into a DAG, so identical
+ * subexpressions become one node. Powers up to MAX_CHAIN are expanded into
+ * multiplications (x^2 into x*x, x^-2 into 1/(x*x)) that are shared with
+ * the rest of the expression; higher powers stay OP_POWI, which every
+ * evaluator already runs as a squaring chain.
+ */
+static ExprNode* internNode(ExprNode* node, NodeTable* table, Arena* arena) {
+    if (node->image != NULL) {
+        return node->image;
+    }
+    if (node->left != NULL) {
+        node->left = internNode(node->left, table, arena);
+    }
+    if (node->right != NULL) {
+        node->right = internNode(node->right, table, arena);
+    }
+
+    ExprNode* result = NULL;
+    if (node->op == OP_POWI && abs(node->exponent) <= MAX_CHAIN) {
+        ExprNode* base = node->left;
+        unsigned int m = abs(node->exponent);
+        while (m) {
+            if (m & 1) {
+                result = (result == NULL) ? base : internBinary(table, arena, OP_MUL, result, base);
+            }
+            m >>= 1;
+            if (m) {
+                base = internBinary(table, arena, OP_MUL, base, base);
+            }
+        }
+        if (node->exponent < 0) {
+            result = internBinary(table, arena, OP_DIV, lookupNode(table, makeConst(arena, 1)), result);
+        }
+    } else {
+        result = lookupNode(table, node);
+    }
+    node->image = result;
+    return result;
+}
+
+/* Counts the references to every DAG node; the first visit resets its slot. */
+static int countUses(ExprNode* node) {
+    int references = 1;
+
+    if (node->uses++ == 0) {
+        node->slot = -1;
+        if (node->left != NULL) {
+            references += countUses(node->left);
+        }
+        if (node->right != NULL) {
+            references += countUses(node->right);
+        }
+    }
+    return references;
+}
+
+/*
+ * Appends node to expr->code in postfix order; depth is the stack height
+ * before it. An inner node with several uses is computed once and kept in a
+ * slot with OP_STORE; later uses are an OP_LOAD. Leaves are cheaper to push
+ * again than to load.
+ */
+static void emitNode(ExprNode* node, Expr* expr, int depth) {
+    Instr instr = {0};
+
+    if (depth + 1 > expr->depth) {
+        expr->depth = depth + 1;
+    }
+    if (node->slot >= 0) {
+        instr.op = OP_LOAD;
+        instr.index = node->slot;
+        expr->code[expr->length++] = instr;
+        return;
+    }
+    if (node->left != NULL) {
+        emitNode(node->left, expr, depth);
+    }
+    if (node->right != NULL) {
+        emitNode(node->right, expr, depth + 1);
+    }
+
+    instr.op = node->op;
+    instr.index = node->index;
+    switch (node->op) {
+        case OP_CONST:
+        case OP_LOGBASE:
+            instr.wide = node->value;
+            instr.value = (float) node->value;
             break;
-        case 7:
-            root = numerical_derivative(postfix);
-            printf("Answer is %lf", root);
+        case OP_POWI:
+            instr.exponent = node->exponent;
             break;
-        case 8:
-            takeIntervals(&a, &b, postfix);
-            root = simpsons(a, b, postfix);
-            printf("Answer is %lf", root);
+        case OP_BINARY:
+            instr.binary = operators[node->index].func;
             break;
-        case 9:
-            takeIntervals(&a, &b, postfix);
-            root = trapezoidal(a, b, postfix);
-            printf("Answer is %lf", root);
+        case OP_UNARY:
+        case OP_UNARY_DEG:
+            instr.unary = functions[node->index].func;
             break;
-        case 10:
-            root = gregory_newton(postfix);
-            printf("Answer is %lf", root);
-            break; 
+    }
+    expr->code[expr->length++] = instr;
+
+    if (node->uses > 1 && node->left != NULL) {
+        node->slot = expr->slots++;
+        instr = (Instr) {0};
+        instr.op = OP_STORE;
+        instr.index = node->slot;
+        expr->code[expr->length++] = instr;
+    }
+}
+
+/*
+ * Compiles the tree rooted at root into expr (without JIT): constant
+ * folding and algebraic simplification, then common-subexpression
+ * elimination on the DAG, then emission with the shared values held in
+ * slots. The tree's nodes are consumed.
+ */
+static void compileTree(ExprNode* root, Expr* expr, Arena* arena) {
+    NodeTable table = {NULL, 0, 0};
+    ExprNode* dag = internNode(simplifyNode(root, arena), &table, arena);
+    int references = countUses(dag);
+
+    expr->code = (Instr*) malloc((2 * table.count + references) * sizeof(Instr));
+    expr->length = 0;
+    expr->depth = 0;
+    expr->slots = 0;
+    emitNode(dag, expr, 0);
+    free(table.entries);
+}
+
+/*
+ * Rewrites expr's bytecode with compileTree, so every evaluator does the
+ * least work per point: sin(x)*sin(x) + 3*2^4 becomes sin(x), a store, a
+ * load, a multiply and an add of 48. Call it before jitCompile.
+ */
+void optimizeExpression(Expr* expr) {
+    Arena arena = {NULL};
+    ExprNode* root = buildTree(expr, &arena);
+
+    free(expr->code);
+    compileTree(root, expr, &arena);
+    arenaFree(&arena);
+}
+
+/*
+ * Compiles the exact derivative of expr into derivative: the bytecode is
+ * turned back into a tree, differentiated symbolically, and the result
+ * optimised by compileTree and JIT-compiled like any other expression, so
+ * f' costs about as much to evaluate as f. Returns 0, or -1 if expr uses a
+ * registered function without a known derivative; derivative is then left
+ * empty.
+ */
+int differentiateExpression(Expr* expr, Expr* derivative) {
+    Arena arena = {NULL};
+    ExprNode* result = differentiateNode(buildTree(expr, &arena), &arena);
+
+    *derivative = (Expr) {0};
+    if (result == NULL) {
+        arenaFree(&arena);
+        return -1;
+    }
 
-        free(postfix);
+    compileTree(result, derivative, &arena);
+    arenaFree(&arena);
+    copyVariables(expr, derivative);
+    jitCompile(derivative);
+    return 0;
+}
+
+/*
+ * Translates the bytecode into x86-64 SSE code (System V ABI) in an mmap'd
+ * page. Two entry points are produced: native(x) for single points and
+ * nativeBatch(xs, out, n), which loops over the points without leaving
+ * machine code. The value stack lives in the native frame and every
+ * instruction reads and writes its slots directly, mirroring evalExpr.
+ * Returns 1 on success; on other platforms, for expressions of several
+ * variables, or if the page cannot be made executable, it returns 0 and
+ * the interpreter stays in use.
+ */
+int jitCompile(Expr* expr) {
+#ifdef JIT_X86_64
+    CodeBuffer buf = {NULL, 0, 0};
+
+    if (expr->variables > 1) {
+        return 0;
+    }
+    int frame = (16 + 4 * (expr->depth + expr->slots) + 15) & ~15;
+
+    /* float native(float x) */
+    emitBytes(&buf, "\x55\x48\x89\xE5", 4);              /* push rbp; mov rbp, rsp */
+    emitBytes(&buf, "\x48\x81\xEC", 3);                   /* sub rsp, frame */
+    emit32(&buf, frame);
+    emitSlot(&buf, 0x11, 0, -8);                            /* movss [rbp-8], xmm0 */
+    emitBody(&buf, expr, -8, -16);
+    emitSlot(&buf, 0x10, 0, -16);                           /* movss xmm0, [slot 0] */
+    emitBytes(&buf, "\xC9\xC3", 2);                        /* leave; ret */
+
+    while (buf.length % 16) {
+        emitByte(&buf, 0xCC);
+    }
+    size_t batchOffset = buf.length;
+    frame = (48 + 4 * (expr->depth + expr->slots) + 15) & ~15;
+
+    /* void nativeBatch(const float* xs, float* out, size_t n) */
+    emitBytes(&buf, "\x55\x48\x89\xE5", 4);              /* push rbp; mov rbp, rsp */
+    emitBytes(&buf, "\x53\x41\x54\x41\x55\x41\x56", 7);  /* push rbx, r12, r13, r14 */
+    emitBytes(&buf, "\x48\x81\xEC", 3);                   /* sub rsp, frame */
+    emit32(&buf, frame);
+    emitBytes(&buf, "\x48\x89\xFB\x49\x89\xF4", 6);       /* mov rbx, rdi; mov r12, rsi */
+    emitBytes(&buf, "\x49\x89\xD5\x45\x31\xF6", 6);       /* mov r13, rdx; xor r14d, r14d */
+    size_t loop = buf.length;
+    emitBytes(&buf, "\x4D\x39\xEE\x0F\x83", 5);           /* cmp r14, r13; jae done */
+    size_t exitJump = buf.length;
+    emit32(&buf, 0);
+    emitBytes(&buf, "\xF3\x42\x0F\x10\x04\xB3", 6);       /* movss xmm0, [rbx+r14*4] */
+    emitSlot(&buf, 0x11, 0, -40);                           /* movss [rbp-40], xmm0 */
+    emitBody(&buf, expr, -40, -48);
+    emitSlot(&buf, 0x10, 0, -48);                           /* movss xmm0, [slot 0] */
+    emitBytes(&buf, "\xF3\x43\x0F\x11\x04\xB4", 6);       /* movss [r12+r14*4], xmm0 */
+    emitBytes(&buf, "\x49\xFF\xC6\xE9", 4);               /* inc r14; jmp loop */
+    emit32(&buf, (unsigned int) (loop - (buf.length + 4)));
+    unsigned int done = (unsigned int) (buf.length - (exitJump + 4));
+    memcpy(buf.bytes + exitJump, &done, 4);
+    emitBytes(&buf, "\x48\x8D\x65\xE0", 4);               /* lea rsp, [rbp-32] */
+    emitBytes(&buf, "\x41\x5E\x41\x5D\x41\x5C\x5B\x5D\xC3", 9); /* pop r14, r13, r12, rbx, rbp; ret */
+
+    size_t pageSize = (buf.length + 4095) & ~(size_t) 4095;
+    void* page = mmap(NULL, pageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (page == MAP_FAILED) {
+        free(buf.bytes);
+        return 0;
+    }
+    memcpy(page, buf.bytes, buf.length);
+    free(buf.bytes);
+    if (mprotect(page, pageSize, PROT_READ | PROT_EXEC) != 0) {
+        munmap(page, pageSize);
+        return 0;
+    }
 
+    expr->nativeCode = page;
+    expr->nativeSize = pageSize;
+    expr->native = (float (*)(float)) page;
+    expr->nativeBatch = (void (*)(const float*, float*, size_t)) ((unsigned char*) page + batchOffset);
+    return 1;
+#else
+    (void) expr;
+    return 0;
+#endif
+}
+
+#ifdef JIT_X86_64
+/* Emits the instructions of expr; stack slot k lives at [rbp + slotBase - 4k], saved value k after the stack. */
+static void emitBody(CodeBuffer* buf, Expr* expr, int xOffset, int slotBase) {
+    int top = -1;
+
+    for (Instr* instr = expr->code, *end = expr->code + expr->length; instr < end; instr++) {
+        int slot;
+        unsigned int bits;
+
+        switch (instr->op) {
+            case OP_CONST:
+                slot = slotBase - 4 * ++top;
+                memcpy(&bits, &instr->value, 4);
+                emitBytes(buf, "\xC7\x85", 2);                     /* mov dword [slot], imm32 */
+                emit32(buf, slot);
+                emit32(buf, bits);
+                break;
+            case OP_VAR:
+                slot = slotBase - 4 * ++top;
+                emitSlot(buf, 0x10, 0, xOffset);                    /* movss xmm0, [x] */
+                emitSlot(buf, 0x11, 0, slot);                       /* movss [slot], xmm0 */
+                break;
+            case OP_STORE:
+                emitSlot(buf, 0x10, 0, slotBase - 4 * top);         /* movss xmm0, [top] */
+                emitSlot(buf, 0x11, 0, slotBase - 4 * (expr->depth + instr->index)); /* movss [saved], xmm0 */
+                break;
+            case OP_LOAD:
+                slot = slotBase - 4 * ++top;
+                emitSlot(buf, 0x10, 0, slotBase - 4 * (expr->depth + instr->index)); /* movss xmm0, [saved] */
+                emitSlot(buf, 0x11, 0, slot);                       /* movss [slot], xmm0 */
+                break;
+            case OP_ADD:
+            case OP_SUB:
+            case OP_MUL:
+            case OP_DIV: {
+                unsigned char op = (instr->op == OP_ADD) ? 0x58 : (instr->op == OP_SUB) ? 0x5C : (instr->op == OP_MUL) ? 0x59 : 0x5E;
+                top--;
+                slot = slotBase - 4 * top;
+                emitSlot(buf, 0x10, 0, slot);                       /* movss xmm0, [a] */
+                emitSlot(buf, op, 0, slot - 4);                     /* op xmm0, [b] */
+                emitSlot(buf, 0x11, 0, slot);                       /* movss [a], xmm0 */
+                break;
+            }
+            case OP_POWI: {
+                unsigned int m = (instr->exponent < 0) ? -instr->exponent : instr->exponent;
+                slot = slotBase - 4 * top;
+                emitSlot(buf, 0x10, 0, slot);                       /* movss xmm0, [a] */
+                emitBytes(buf, "\xB8\x00\x00\x80\x3F", 5);          /* mov eax, 1.0f */
+                emitBytes(buf, "\x66\x0F\x6E\xC8", 4);               /* movd xmm1, eax */
+                while (m) {
+                    if (m & 1) {
+                        emitBytes(buf, "\xF3\x0F\x59\xC8", 4);       /* mulss xmm1, xmm0 */
+                    }
+                    emitBytes(buf, "\xF3\x0F\x59\xC0", 4);           /* mulss xmm0, xmm0 */
+                    m >>= 1;
+                }
+                if (instr->exponent < 0) {
+                    emitBytes(buf, "\x66\x0F\x6E\xC0", 4);           /* movd xmm0, eax */
+                    emitBytes(buf, "\xF3\x0F\x5E\xC1", 4);           /* divss xmm0, xmm1 */
+                } else {
+                    emitBytes(buf, "\x0F\x28\xC1", 3);               /* movaps xmm0, xmm1 */
+                }
+                emitSlot(buf, 0x11, 0, slot);                       /* movss [a], xmm0 */
+                break;
+            }
+            case OP_BINARY:
+                top--;
+                slot = slotBase - 4 * top;
+                emitSlot(buf, 0x10, 0, slot);                       /* movss xmm0, [a] */
+                emitSlot(buf, 0x10, 1, slot - 4);                   /* movss xmm1, [b] */
+                emitCall(buf, (void*) instr->binary);
+                emitSlot(buf, 0x11, 0, slot);                       /* movss [a], xmm0 */
+                break;
+            case OP_UNARY:
+            case OP_UNARY_DEG:
+                slot = slotBase - 4 * top;
+                emitSlot(buf, 0x10, 0, slot);                       /* movss xmm0, [a] */
+                if (instr->op == OP_UNARY_DEG) {
+                    double pi = M_PI;
+                    double deg = 180;
+                    unsigned long long wide;
+                    emitBytes(buf, "\xF3\x0F\x5A\xC0\x48\xB8", 6);    /* cvtss2sd xmm0, xmm0; mov rax, pi */
+                    memcpy(&wide, &pi, 8);
+                    emit64(buf, wide);
+                    emitBytes(buf, "\x66\x48\x0F\x6E\xC8", 5);       /* movq xmm1, rax */
+                    emitBytes(buf, "\xF2\x0F\x59\xC1\x48\xB8", 6);    /* mulsd xmm0, xmm1; mov rax, 180 */
+                    memcpy(&wide, &deg, 8);
+                    emit64(buf, wide);
+                    emitBytes(buf, "\x66\x48\x0F\x6E\xC8", 5);       /* movq xmm1, rax */
+                    emitBytes(buf, "\xF2\x0F\x5E\xC1", 4);           /* divsd xmm0, xmm1 */
+                    emitBytes(buf, "\xF2\x0F\x5A\xC0", 4);           /* cvtsd2ss xmm0, xmm0 */
+                }
+                emitCall(buf, (void*) instr->unary);
+                emitSlot(buf, 0x11, 0, slot);                       /* movss [a], xmm0 */
+                break;
+            case OP_LOGBASE:
+                slot = slotBase - 4 * top;
+                memcpy(&bits, &instr->value, 4);
+                emitSlot(buf, 0x10, 0, slot);                       /* movss xmm0, [a] */
+                emitByte(buf, 0xB8);                                /* mov eax, base */
+                emit32(buf, bits);
+                emitBytes(buf, "\x66\x0F\x6E\xC8", 4);               /* movd xmm1, eax */
+                emitCall(buf, (void*) eval_log);
+                emitSlot(buf, 0x11, 0, slot);                       /* movss [a], xmm0 */
+                break;
+        }
+    }
+}
+
+static void emitBytes(CodeBuffer* buf, const void* bytes, size_t n) {
+    if (buf->length + n > buf->capacity) {
+        buf->capacity = (buf->capacity + n) * 2;
+        buf->bytes = (unsigned char*) realloc(buf->bytes, buf->capacity);
+    }
+    memcpy(buf->bytes + buf->length, bytes, n);
+    buf->length += n;
+}
+
+static void emitByte(CodeBuffer* buf, unsigned char byte) {
+    emitBytes(buf, &byte, 1);
+}
+
+static void emit32(CodeBuffer* buf, unsigned int value) {
+    emitBytes(buf, &value, 4);
+}
+
+static void emit64(CodeBuffer* buf, unsigned long long value) {
+    emitBytes(buf, &value, 8);
+}
+
+/* Emits an SSE scalar-single instruction (F3 0F op) between xmm<reg> and [rbp+disp]. */
+static void emitSlot(CodeBuffer* buf, unsigned char op, int reg, int disp) {
+    unsigned char bytes[] = {0xF3, 0x0F, op, (unsigned char) (0x85 | (reg << 3))};
+    emitBytes(buf, bytes, 4);
+    emit32(buf, (unsigned int) disp);
+}
+
+static void emitCall(CodeBuffer* buf, void* func) {
+    emitBytes(buf, "\x48\xB8", 2);                             /* mov rax, func */
+    emit64(buf, (unsigned long long) func);
+    emitBytes(buf, "\xFF\xD0", 2);                             /* call rax */
+}
+#endif
+
+/* 64-byte aligned allocation for matrix storage, NULL if there is no memory; release with free. */
+void* alignedAlloc(size_t bytes) {
+    void* ptr = NULL;
+
+    if (posix_memalign(&ptr, 64, (bytes + 63) & ~(size_t) 63) != 0) {
+        return NULL;
+    }
+    return ptr;
+}
+
+/*
+ * Runs body over [begin, end) in chunks of at most chunk iterations, using the
+ * calling thread plus the pool workers. Chunks are handed out through an
+ * atomic counter, so uneven chunks balance themselves. Ranges that fit in one
+ * chunk, a pool of one thread, a call from inside a body, and a call made
+ * while another thread's job holds the pool all run inline on the caller.
+ */
+void parallelFor(int begin, int end, int chunk, void (*body)(void* ctx, int lo, int hi), void* ctx) {
+    pthread_once(&poolOnce, startPool);
+    if (inPool || end - begin <= chunk || pthread_mutex_trylock(&pool.submit) != 0) {
+        if (begin < end) {
+            body(ctx, begin, end);
+        }
+        return;
+    }
+    if (pool.count == 0) {
+        pthread_mutex_unlock(&pool.submit);
+        body(ctx, begin, end);
+        return;
+    }
+
+    ParallelJob job = {body, ctx, end, chunk, begin};
+
+    inPool = 1;
+    pthread_mutex_lock(&pool.lock);
+    pool.job = &job;
+    pool.active = pool.count;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.wake);
+    pthread_mutex_unlock(&pool.lock);
+
+    runChunks(&job);
+
+    pthread_mutex_lock(&pool.lock);
+    while (pool.active > 0) {
+        pthread_cond_wait(&pool.done, &pool.lock);
+    }
+    pool.job = NULL;
+    pthread_mutex_unlock(&pool.lock);
+    inPool = 0;
+    pthread_mutex_unlock(&pool.submit);
+}
+
+static void runChunks(ParallelJob* job) {
+    int lo;
+
+    while ((lo = atomic_fetch_add(&job->next, job->chunk)) < job->end) {
+        int hi = (lo + job->chunk < job->end) ? lo + job->chunk : job->end;
+        job->body(job->ctx, lo, hi);
+    }
+}
+
+/*
+ * Sets how many threads parallelFor uses, counting the caller. Waits for a
+ * job on the pool to finish, then stops and restarts the workers. Ignored
+ * from inside a parallelFor body.
+ */
+void setThreadCount(int count) {
+    if (inPool) {
+        return;
+    }
+    pthread_mutex_lock(&pool.submit);
+    resizePool(count);
+    pthread_mutex_unlock(&pool.submit);
+}
+
+/* Run once by the first parallelFor: one thread per online processor, unless setThreadCount came first. */
+static void startPool(void) {
+    pthread_mutex_lock(&pool.submit);
+    if (threadCount == 0) {
+        resizePool((int) sysconf(_SC_NPROCESSORS_ONLN));
+    }
+    pthread_mutex_unlock(&pool.submit);
+}
+
+/* Joins the workers and starts count - 1 new ones; the caller holds pool.submit. */
+static void resizePool(int count) {
+    pthread_mutex_lock(&pool.lock);
+    pool.generation++;
+    pool.job = NULL;
+    pthread_cond_broadcast(&pool.wake);
+    pthread_mutex_unlock(&pool.lock);
+    for (int i = 0; i < pool.count; i++) {
+        pthread_join(pool.threads[i], NULL);
+    }
+    free(pool.threads);
+
+    threadCount = (count > 0) ? count : 1;
+    pool.count = threadCount - 1;
+    pool.threads = (pthread_t*) malloc((pool.count + 1) * sizeof(pthread_t));
+    for (int i = 0; i < pool.count; i++) {
+        pthread_create(&pool.threads[i], NULL, poolWorker, (void*) (size_t) pool.generation);
+    }
+}
+
+/* arg is the pool generation at creation, so a job posted before the worker first waits is not missed. */
+static void* poolWorker(void* arg) {
+    unsigned long seen = (unsigned long) (size_t) arg;
+
+    inPool = 1;
+    pthread_mutex_lock(&pool.lock);
+    for (;;) {
+        while (pool.generation == seen) {
+            pthread_cond_wait(&pool.wake, &pool.lock);
+        }
+        seen = pool.generation;
+        ParallelJob* job = pool.job;
+        if (job == NULL) {
+            pthread_mutex_unlock(&pool.lock);
+            return NULL;
+        }
+        pthread_mutex_unlock(&pool.lock);
+
+        runChunks(job);
+
+        pthread_mutex_lock(&pool.lock);
+        if (--pool.active == 0) {
+            pthread_cond_signal(&pool.done);
+        }
+    }
+}
+
+/*
+ * Bump allocator backing one parsed expression. Blocks are chained and only
+ * released together, so parse and shuntingYard never free individual tokens.
+ */
+void* arenaAlloc(Arena* arena, size_t bytes) {
+    bytes = (bytes + 15) & ~(size_t) 15;
+
+    if (arena->head == NULL || arena->head->used + bytes > arena->head->capacity) {
+        size_t capacity = (bytes > ARENA_BLOCK) ? bytes : ARENA_BLOCK;
+        ArenaBlock* block = (ArenaBlock*) malloc(sizeof(ArenaBlock) + capacity);
+        block->next = arena->head;
+        block->used = 0;
+        block->capacity = capacity;
+        arena->head = block;
+    }
+
+    void* ptr = arena->head->data + arena->head->used;
+    arena->head->used += bytes;
+    return ptr;
+}
+
+void arenaFree(Arena* arena) {
+    ArenaBlock* block = arena->head;
+
+    while (block != NULL) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->head = NULL;
+}
+
+static int isInt(char* string) {
+    if (string[0] == '-' || string[0] == '+') {
+        if (isdigit(string[1])) {
+            return 1;
+        }
+    } else if (isdigit(*string)) {
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Sets the token type (and table index for operators and functions) once, at parse time. */
+static void classifyToken(Var* var) {
+    char* token = var->input;
+    Symbol* symbol = lookupSymbol(token);
+
+    var->index = 0;
+    if (symbol != NULL) {
+        var->type = symbol->type;
+        var->index = symbol->index;
+    } else if (isInt(token) || *token == '.') {
+        var->type = TOKEN_NUMBER;
+    } else if (*token == '_') {
+        var->type = TOKEN_LOGBASE;
+    } else if (*token == '(') {
+        var->type = TOKEN_LPAREN;
+    } else if (*token == ')') {
+        var->type = TOKEN_RPAREN;
+    } else if (isalpha(*token)) {
+        var->type = TOKEN_VARIABLE;
+    } else {
+        var->type = TOKEN_UNKNOWN;
+    }
+}
+
+/*
+ * Adds a unary function to the table so the parser recognises it; the table
+ * keeps its own copy of name. func_d and func_ld, which may be NULL, are its
+ * double and long double versions; without them those precisions evaluate
+ * func in float. Returns its index, or -1 if the name is taken or the table
+ * is full. Compiling only reads the tables, so register every function
+ * before compiling on several threads.
+ */
+int registerFunction(const char* name, float (*func)(float val), int degrees, double (*func_d)(double val), long double (*func_ld)(long double val)) {
+    int count = 0;
+    while (strcmp(functions[count].name, "end") != 0) {
+        count++;
+    }
+
+    if (count + 1 >= MAX_FUNCTIONS || lookupSymbol(name) != NULL) {
+        return -1;
+    }
+
+    functions[count + 1] = functions[count];
+    functions[count] = (Function) {.name = strdup(name), .func = func, .degrees = degrees, .func_d = func_d, .func_ld = func_ld};
+    insertSymbol(functions[count].name, TOKEN_FUNCTION, count);
+    return count;
+}
+
+/*
+ * Operator and function names live in an open-addressing hash table keyed by
+ * FNV-1a, so classifying a token costs one hash and usually one strcmp no
+ * matter how many functions are registered.
+ */
+static void initSymbols(void) {
+    symbolCapacity = 4 * MAX_FUNCTIONS;
+    symbols = (Symbol*) calloc(symbolCapacity, sizeof(Symbol));
+
+    for (int i = 1; strcmp(operators[i].operator, "end") != 0; i++) {
+        insertSymbol(operators[i].operator, TOKEN_OPERATOR, i);
+    }
+    for (int i = 1; strcmp(functions[i].name, "end") != 0; i++) {
+        insertSymbol(functions[i].name, (functions[i].func == NULL) ? TOKEN_LOG : TOKEN_FUNCTION, i);
+    }
+}
+
+static void insertSymbol(const char* name, int type, int index) {
+    unsigned int slot = hashName(name) & (symbolCapacity - 1);
+    while (symbols[slot].name != NULL) {
+        slot = (slot + 1) & (symbolCapacity - 1);
+    }
+    symbols[slot] = (Symbol) {name, type, index};
+}
+
+static Symbol* lookupSymbol(const char* name) {
+    pthread_once(&symbolsOnce, initSymbols);
+
+    unsigned int slot = hashName(name) & (symbolCapacity - 1);
+    while (symbols[slot].name != NULL) {
+        if (strcmp(symbols[slot].name, name) == 0) {
+            return &symbols[slot];
+        }
+        slot = (slot + 1) & (symbolCapacity - 1);
+    }
+    return NULL;
+}
+
+static unsigned int hashName(const char* name) {
+    unsigned int hash = 2166136261u;
+
+    while (*name) {
+        hash = (hash ^ (unsigned char) *name++) * 16777619u;
+    }
+    return hash;
+}
+
+/*
+ * Reads a matrix from path. A file starting with the "NAMX" magic is the
+ * binary format and is mapped, not read: loading costs a page-table update
+ * and pages are faulted in as the solver touches them. Anything else is
+ * parsed as text by parseMatrixText. Returns 0, or -1 if the file cannot
+ * be read or is malformed.
+ */
+int loadMatrix(const char* path, MatrixData* matrix) {
+    struct stat info;
+    int fd = open(path, O_RDONLY);
+
+    *matrix = (MatrixData) {0};
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        return -1;
+    }
+
+    size_t length = (size_t) info.st_size;
+    void* mapping = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return -1;
+    }
+
+    MatrixFileHeader* header = (MatrixFileHeader*) mapping;
+    if (length >= MATRIX_DATA_OFFSET && memcmp(header->magic, "NAMX", 4) == 0) {
+        unsigned long long count = header->rows * header->cols;
+        if ((header->elementSize != MATRIX_FLOAT && header->elementSize != MATRIX_DOUBLE)
+            || header->rows > INT_MAX || header->cols > INT_MAX
+            || count > (length - MATRIX_DATA_OFFSET) / header->elementSize) {
+            munmap(mapping, length);
+            return -1;
+        }
+        matrix->rows = (int) header->rows;
+        matrix->cols = (int) header->cols;
+        matrix->elementSize = (int) header->elementSize;
+        matrix->data = (char*) mapping + MATRIX_DATA_OFFSET;
+        matrix->mapping = mapping;
+        matrix->mappingSize = length;
+        return 0;
+    }
+
+    madvise(mapping, length, MADV_SEQUENTIAL);
+    int status = parseMatrixText((const char*) mapping, length, matrix);
+    munmap(mapping, length);
+    return status;
+}
+
+/*
+ * Parses text with one row per line and fields separated by commas,
+ * semicolons or blanks (CSV included). Blank lines and everything after a
+ * # are ignored; every row must have as many fields as the first. The
+ * values go to a growing heap array of doubles in a single pass.
+ */
+int parseMatrixText(const char* text, size_t length, MatrixData* matrix) {
+    const char* p = text;
+    const char* end = text + length;
+    size_t capacity = 1024;
+    size_t count = 0;
+    double* values = (double*) malloc(capacity * sizeof(double));
+    int rows = 0;
+    int cols = 0;
+
+    *matrix = (MatrixData) {0};
+    while (p < end) {
+        int fields = 0;
+
+        while (p < end && *p != '\n') {
+            if (*p == ' ' || *p == '\t' || *p == '\r' || *p == ',' || *p == ';') {
+                p++;
+                continue;
+            }
+            if (*p == '#') {
+                while (p < end && *p != '\n') {
+                    p++;
+                }
+                break;
+            }
+            if (count == capacity) {
+                capacity *= 2;
+                values = (double*) realloc(values, capacity * sizeof(double));
+            }
+            p = parseNumber(p, end, &values[count]);
+            if (p == NULL) {
+                free(values);
+                return -1;
+            }
+            count++;
+            fields++;
+        }
+        p++;
+
+        if (fields == 0) {
+            continue;
+        }
+        if (rows == 0) {
+            cols = fields;
+        } else if (fields != cols) {
+            free(values);
+            return -1;
+        }
+        rows++;
+    }
+
+    if (rows == 0) {
+        free(values);
+        return -1;
+    }
+    matrix->rows = rows;
+    matrix->cols = cols;
+    matrix->elementSize = MATRIX_DOUBLE;
+    matrix->data = values;
+    return 0;
+}
+
+/*
+ * Parses one number from [text, end) into value and returns the position
+ * after it, or NULL if the field is not a number. Decimal mantissas of up
+ * to 19 digits that fit in 53 bits with a power of ten up to 22 are
+ * converted exactly with one multiplication or division; anything longer,
+ * and inf/nan, goes through strtod on a bounded copy.
+ */
+const char* parseNumber(const char* text, const char* end, double* value) {
+    const char* p = text;
+    unsigned long long mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    int exact = 1;
+    int negative = 0;
+    int seen = 0;
+
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
+    while (p < end && isdigit((unsigned char) *p)) {
+        seen++;
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            digits += (mantissa != 0);
+        } else {
+            exponent++;
+            exact = 0;
+        }
+        p++;
+    }
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && isdigit((unsigned char) *p)) {
+            seen++;
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += (mantissa != 0);
+                exponent--;
+            } else {
+                exact = 0;
+            }
+            p++;
+        }
+    }
+    if (seen > 0 && p < end && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        int sign = 1;
+        int power = 0;
+        if (q < end && (*q == '-' || *q == '+')) {
+            sign = (*q == '-') ? -1 : 1;
+            q++;
+        }
+        if (q < end && isdigit((unsigned char) *q)) {
+            while (q < end && isdigit((unsigned char) *q)) {
+                power = (power < 100000) ? power * 10 + (*q - '0') : power;
+                q++;
+            }
+            exponent += sign * power;
+            p = q;
+        }
+    }
+
+    int terminated = (p == end || *p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'
+                      || *p == ',' || *p == ';' || *p == '#');
+    if (seen > 0 && terminated && exact && mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+        double result = (double) mantissa;
+        result = (exponent < 0) ? result / powersOfTen[-exponent] : result * powersOfTen[exponent];
+        *value = negative ? -result : result;
+        return p;
+    }
+
+    /* Slow path: strtod needs a terminated string, and the mapping has none. */
+    const char* stop = text;
+    while (stop < end && *stop != ' ' && *stop != '\t' && *stop != '\r' && *stop != '\n'
+           && *stop != ',' && *stop != ';' && *stop != '#') {
+        stop++;
+    }
+    char buffer[128];
+    size_t length = (size_t) (stop - text);
+    char* copy = (length < sizeof(buffer)) ? buffer : (char*) malloc(length + 1);
+    char* parsedEnd;
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    *value = strtod(copy, &parsedEnd);
+    int ok = (length > 0 && parsedEnd == copy + length);
+    if (copy != buffer) {
+        free(copy);
+    }
+    return ok ? stop : NULL;
+}
+
+/* Writes matrix in the binary format. Returns 0, or -1 on an I/O error. */
+int saveMatrix(const char* path, const MatrixData* matrix) {
+    FILE* file = fopen(path, "wb");
+    char header[MATRIX_DATA_OFFSET] = {0};
+    MatrixFileHeader fields = {{'N', 'A', 'M', 'X'}, (unsigned int) matrix->elementSize,
+                               (unsigned long long) matrix->rows, (unsigned long long) matrix->cols};
+    size_t count = (size_t) matrix->rows * matrix->cols;
+
+    if (file == NULL) {
+        return -1;
+    }
+    memcpy(header, &fields, sizeof(fields));
+    int ok = fwrite(header, 1, sizeof(header), file) == sizeof(header)
+             && fwrite(matrix->data, matrix->elementSize, count, file) == count;
+    return (fclose(file) == 0 && ok) ? 0 : -1;
+}
+
+void freeMatrix(MatrixData* matrix) {
+    if (matrix->mapping != NULL) {
+        munmap(matrix->mapping, matrix->mappingSize);
+    } else {
+        free(matrix->data);
+    }
+    *matrix = (MatrixData) {0};
+}
+
+#ifdef BENCHMARK
+/*
+ * Build with -DBENCHMARK to time the evaluators against each other:
+ * evalPostfix, the bytecode interpreter, evalBatch and the JIT entry points.
+ */
+
+/* The original token-by-token interpreter, kept as the baseline the compiled evaluators are timed against. */
+static float evalPostfix(Var* postfix, int size, float x) {
+    float stack[size + 1];
+    int top = -1;
+
+    for (int i = 0; i < size; i++) {
+        if (isInt(postfix[i].input)) { 
+            stack[++top] = strtof(postfix[i].input, NULL);
+        } else if (matchStrings(postfix[i].input, 0)) { 
+            float b = stack[top--];
+            float a = stack[top];
+            stack[top] = operators[findStruct(postfix[i].input, 0)].func(a, b);
+        } else if (matchStrings(postfix[i].input, 1) && strcmp(postfix[i].input, "log") != 0) { 
+            int index = findStruct(postfix[i].input, 1);
+            float num = functions[index].degrees ? stack[top] * M_PI / 180 : stack[top];
+            stack[top] = functions[index].func(num);
+        } else if (isalpha(*postfix[i].input) && !matchStrings(postfix[i].input, 1) && strcmp(postfix[i].input, "log") != 0) {
+            if (strcmp(postfix[i].input, "x") == 0) {
+                stack[++top] = x;
+            } else if (strcmp(postfix[i].input, "e") == 0) {
+                stack[++top] = M_E;
+            } else if (strcmp(postfix[i].input, "pi") == 0) {
+                stack[++top] = M_PI;
+            }
+        } else if (strchr(postfix[i].input, '_')) { 
+            stack[top] = eval_log(stack[top], strtof(postfix[i].input + 1, NULL));
+        }
+    }
+
+    return stack[0];
+}
+
+static int matchStrings(char* string, int structNum) {
+    Symbol* symbol = lookupSymbol(string);
+
+    if (symbol == NULL) {
+        return 0;
+    }
+    return (structNum == 0) ? symbol->type == TOKEN_OPERATOR : symbol->type == TOKEN_FUNCTION || symbol->type == TOKEN_LOG;
+}
+
+static int findStruct(char* string, int structNum) {
+    return matchStrings(string, structNum) ? lookupSymbol(string)->index : 0;
+}
+
+double nsPerEval(clock_t start, int count) {
+    return (double) (clock() - start) / CLOCKS_PER_SEC * 1e9 / count;
+}
+
+void benchmark() {
+    char* sources[] = {"sin(x)", "arctan(x)", "x_2", "x^2", "x^2.5", "sin(x)*x^2+arctan(x)/x_2"};
+    int count = 1 << 20;
+    int slowCount = 1 << 16;
+    float* xs = (float*) malloc(count * sizeof(float));
+    float* out = (float*) malloc(count * sizeof(float));
+    volatile float sink = 0;
+
+    for (int i = 0; i < count; i++) {
+        xs[i] = 1 + 10.0f * i / count;
+    }
+
+    printf("%-28s%12s%12s%12s%12s%12s  (ns/eval)\n", "expression", "postfix", "bytecode", "batch", "jit", "jit batch");
+    for (int k = 0; k < (int) (sizeof(sources) / sizeof(sources[0])); k++) {
+        Arena arena = {NULL};
+        Var* infix = NULL;
+        Var* postfix = NULL;
+        Expr expr = {0};
+
+        int size = parse(sources[k], &arena, &infix);
+        size = shuntingYard(infix, size, &arena, &postfix);
+        compilePostfix(postfix, size, &expr);
+
+        clock_t start = clock();
+        for (int i = 0; i < slowCount; i++) { sink += evalPostfix(postfix, size, xs[i]); }
+        double tPostfix = nsPerEval(start, slowCount);
+
+        start = clock();
+        for (int i = 0; i < count; i++) { sink += evalExpr(&expr, xs[i]); }
+        double tBytecode = nsPerEval(start, count);
+
+        start = clock();
+        evalBatch(&expr, xs, out, count);
+        double tBatch = nsPerEval(start, count);
+
+        double tJit = 0, tJitBatch = 0;
+        if (jitCompile(&expr)) {
+            start = clock();
+            for (int i = 0; i < count; i++) { sink += expr.native(xs[i]); }
+            tJit = nsPerEval(start, count);
+
+            start = clock();
+            expr.nativeBatch(xs, out, count);
+            tJitBatch = nsPerEval(start, count);
+        }
+
+        printf("%-28s%12.1f%12.1f%12.1f%12.1f%12.1f\n", sources[k], tPostfix, tBytecode, tBatch, tJit, tJitBatch);
+        freeExpr(&expr);
+        arenaFree(&arena);
+    }
+
+    free(xs);
+    free(out);
+
+    benchmarkPrecision();
+}
+
+double secondsSince(clock_t start) {
+    return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+/*
+ * Same problems at every precision: root of x^3-2x-5 on [2, 3], Simpson 1/3
+ * of exp(x) over [0, 1], and a 200x200 diagonally dominant linear system.
+ */
+#define BENCH_PRECISION(T, SFX, label) { \
+    int repeat = 2000; \
+    int n = 200; \
+    T root = 0, integral = 0, residual = 0; \
+    CAT(RootResult, SFX) result = {0}; \
+    clock_t start = clock(); \
+    for (int r = 0; r < repeat; r++) { CAT(bisection, SFX)(2, 3, &cubic, 0, 0, &result); root = result.root; } \
+    double tRoot = secondsSince(start) / repeat; \
+    start = clock(); \
+    for (int r = 0; r < repeat; r++) { integral = CAT(simpsons_rule, SFX)(0, 1, &exponential, 1); } \
+    double tIntegral = secondsSince(start) / repeat; \
+    T* system = (T*) malloc(n * (n+1) * sizeof(T)); \
+    T* solution = (T*) malloc(n * sizeof(T)); \
+    for (int i = 0; i < n; i++) { \
+        for (int j = 0; j <= n; j++) { system[i*(n+1) + j] = (i == j) ? n : 1.0 / (1 + i + j); } \
+    } \
+    start = clock(); \
+    CAT(gauss_solve, SFX)(n, system, solution); \
+    double tSolve = secondsSince(start); \
+    for (int i = 0; i < n; i++) { \
+        T sum = -1.0 / (1 + i + n); \
+        for (int j = 0; j < n; j++) { sum += ((i == j) ? n : 1.0 / (1 + i + j)) * solution[j]; } \
+        residual = fmaxl(residual, fabsl(sum)); \
+    } \
+    printf("%-12s%12.2e%10.1f%12.2e%10.1f%12.2e%10.1f\n", label, \
+           (double) fabsl(root - 2.0945514815423265914823865405793L), tRoot * 1e6, \
+           (double) fabsl(integral - (E_L - 1)), tIntegral * 1e6, (double) residual, tSolve * 1e3); \
+    free(system); \
+    free(solution); \
+}
+
+void benchmarkPrecision() {
+    Arena arena = {NULL};
+    Var* infix = NULL;
+    Var* postfix = NULL;
+    Expr cubic = {0};
+    Expr exponential = {0};
+
+    int size = parse("x^3-2*x-5", &arena, &infix);
+    size = shuntingYard(infix, size, &arena, &postfix);
+    compilePostfix(postfix, size, &cubic);
+    size = parse("exp(x)", &arena, &infix);
+    size = shuntingYard(infix, size, &arena, &postfix);
+    compilePostfix(postfix, size, &exponential);
+    arenaFree(&arena);
+
+    printf("\n%-12s%12s%10s%12s%10s%12s%10s\n", "precision", "root err", "us", "simpson err", "us", "residual", "ms");
+    BENCH_PRECISION(float, , "float")
+    BENCH_PRECISION(double, _d, "double")
+    BENCH_PRECISION(long double, _ld, "long double")
+
+    freeExpr(&cubic);
+    freeExpr(&exponential);
+
+    benchmarkLU(1000);
+    benchmarkInverse(800);
+    benchmarkSparse(100);
+    benchmarkQuadrature();
+    benchmarkBatchQuadrature(50000);
+    benchmarkMatrixIO(4000);
+    benchmarkRoots();
+    benchmarkAllRoots(100000);
+    benchmarkDerivatives();
+    benchmarkOptimizer();
+    benchmarkGrid(1000);
+    benchmarkSystem(300);
+    benchmarkInterpolation(32, 1 << 22);
+    benchmarkLookup(1024, 1 << 22);
+    benchmarkRidders(1 << 16);
+}
+
+/* Factor-once/solve-many: one lu_factor followed by 100 right-hand sides. */
+void benchmarkLU(int n) {
+    double* matrix = (double*) malloc((size_t) n * n * sizeof(double));
+    double* rhs = (double*) malloc((size_t) n * 100 * sizeof(double));
+    LUFactor_d lu;
+
+    srand(1);
+    for (int i = 0; i < n * n; i++) {
+        matrix[i] = (double) rand() / RAND_MAX - 0.5;
+    }
+    for (int i = 0; i < n * 100; i++) {
+        rhs[i] = 1;
+    }
+
+    clock_t start = clock();
+    lu_factor_d(&lu, n, matrix, n);
+    double tFactor = secondsSince(start);
+
+    start = clock();
+    lu_solve_d(&lu, rhs, 100);
+    double tSolve = secondsSince(start);
+
+    double residual = 0;
+    for (int i = 0; i < n; i++) {
+        double sum = -1;
+        for (int j = 0; j < n; j++) {
+            sum += matrix[(size_t) i*n + j] * rhs[(size_t) j*100];
+        }
+        residual = fmax(residual, fabs(sum));
+    }
+
+    printf("\nlu_factor_d n=%d: %.1f ms (%.2f GFLOP/s), lu_solve_d 100 rhs: %.1f ms, residual %.2e\n",
+           n, tFactor * 1e3, 2.0 / 3 * n * n * (double) n / tFactor * 1e-9, tSolve * 1e3, residual);
+
+    lu_free_d(&lu);
+    free(matrix);
+    free(rhs);
+}
+/* Thread scaling of invert_matrix_d, doubling the thread count up to the core count. */
+void benchmarkInverse(int n) {
+    int cores = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    double* original = (double*) malloc((size_t) n * n * sizeof(double));
+    double* matrix = (double*) malloc((size_t) n * n * sizeof(double));
+    double* inverse = (double*) malloc((size_t) n * n * sizeof(double));
+    double base = 0;
+
+    srand(2);
+    for (int i = 0; i < n * n; i++) {
+        original[i] = (double) rand() / RAND_MAX - 0.5;
+    }
+
+    printf("\ninvert_matrix_d n=%d\n%-10s%12s%10s\n", n, "threads", "ms", "speedup");
+    for (int threads = 1; ; threads *= 2) {
+        if (threads > cores) {
+            threads = cores;
+        }
+        setThreadCount(threads);
+        memcpy(matrix, original, (size_t) n * n * sizeof(double));
+
+        struct timespec start, stop;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        invert_matrix_d(n, matrix, inverse);
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        double elapsed = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) * 1e-9;
+
+        if (threads == 1) {
+            base = elapsed;
+        }
+        printf("%-10d%12.1f%10.2f\n", threads, elapsed * 1e3, base / elapsed);
+        if (threads == cores) {
+            break;
+        }
+    }
+
+    free(original);
+    free(matrix);
+    free(inverse);
+}
+/* 5-point Laplacian on a grid x grid interior, the usual 5 non-zeros per row. */
+void poissonMatrix(CSRMatrix_d* A, int grid) {
+    int n = grid * grid;
+    int* rows = (int*) malloc(5 * n * sizeof(int));
+    int* cols = (int*) malloc(5 * n * sizeof(int));
+    double* values = (double*) malloc(5 * n * sizeof(double));
+    int nnz = 0;
+
+    for (int i = 0; i < grid; i++) {
+        for (int j = 0; j < grid; j++) {
+            int row = i * grid + j;
+            int neighbours[4][2] = {{i-1, j}, {i+1, j}, {i, j-1}, {i, j+1}};
+            rows[nnz] = row; cols[nnz] = row; values[nnz++] = 4;
+            for (int k = 0; k < 4; k++) {
+                int ni = neighbours[k][0], nj = neighbours[k][1];
+                if (ni >= 0 && ni < grid && nj >= 0 && nj < grid) {
+                    rows[nnz] = row; cols[nnz] = ni * grid + nj; values[nnz++] = -1;
+                }
+            }
+        }
+    }
+
+    csr_from_triplets_d(A, n, nnz, rows, cols, values);
+    free(rows);
+    free(cols);
+    free(values);
+}
+
+/* Gauss-Seidel against SOR and the parallel multicolour/Jacobi sweeps on a 2D Poisson problem. */
+void benchmarkSparse(int grid) {
+    int n = grid * grid;
+    int cores = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    double omega = 2 / (1 + sin(M_PI / (grid + 1)));
+    double* b = (double*) malloc(n * sizeof(double));
+    double* x = (double*) malloc(n * sizeof(double));
+    CSRMatrix_d A;
+
+    poissonMatrix(&A, grid);
+    for (int i = 0; i < n; i++) {
+        b[i] = 1.0 / ((grid + 1) * (grid + 1));
+    }
+
+    printf("\nPoisson %dx%d (n=%d, nnz=%d)\n%-26s%10s%12s%12s\n", grid, grid, n, A.nnz, "method", "threads", "sweeps", "ms");
+    double omegas[] = {1, omega};
+    for (int k = 0; k < 2; k++) {
+        memset(x, 0, n * sizeof(double));
+        clock_t start = clock();
+        int sweeps = sor_solve_d(&A, b, x, omegas[k], 1e-8, 100000);
+        char label[32];
+        snprintf(label, sizeof(label), (k == 0) ? "gauss-seidel" : "sor w=%.3f", omegas[k]);
+        printf("%-26s%10d%12d%12.1f\n", label, 1, sweeps, secondsSince(start) * 1e3);
+    }
+
+    struct {
+        char* label;
+        int mode;
+        double omega;
+    } runs[] = {
+        {"jacobi", RELAX_JACOBI, 1},
+        {"multicolor gauss-seidel", RELAX_MULTICOLOR, 1},
+        {"multicolor sor", RELAX_MULTICOLOR, omega},
+    };
+    for (int k = 0; k < 3; k++) {
+        for (int threads = 1; ; threads *= 2) {
+            if (threads > cores) {
+                threads = cores;
+            }
+            setThreadCount(threads);
+            memset(x, 0, n * sizeof(double));
+
+            struct timespec start, stop;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            int sweeps = parallel_relax_d(&A, b, x, runs[k].mode, runs[k].omega, 1e-6, 100000);
+            clock_gettime(CLOCK_MONOTONIC, &stop);
+            double elapsed = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) * 1e-9;
+
+            printf("%-26s%10d%12d%12.1f\n", runs[k].label, threads, sweeps, elapsed * 1e3);
+            if (threads == cores) {
+                break;
+            }
+        }
+    }
+
+    csr_free_d(&A);
+    free(b);
+    free(x);
+}
+
+/* Fixed 100-panel Simpson against adaptive Gauss-Kronrod and Romberg at 1e-10 on smooth, peaked and singular integrands. */
+void benchmarkQuadrature() {
+    struct {
+        char* func;
+        double a, b;
+        double exact;
+    } cases[] = {
+        {"exp(x)", 0, 1, M_E - 1},
+        {"1/(1+25*x^2)", -1, 1, 0.4 * atan(5.0)},
+        {"sqrt(x)", 0, 1, 2.0 / 3},
+        {"1/(0.0001+x^2)", 0, 1, 100 * atan(100.0)},
+    };
+
+    printf("\n%-16s%12s%8s%12s%12s%8s%12s%8s\n", "integrand", "simpson err", "evals", "gk err", "gk est", "evals", "romberg err", "evals");
+    for (int k = 0; k < 4; k++) {
+        Arena arena = {NULL};
+        Var* infix = NULL;
+        Var* postfix = NULL;
+        Expr expr = {0};
+        Quadrature_d result;
+        Quadrature_d rombergResult;
+
+        int size = parse(cases[k].func, &arena, &infix);
+        size = shuntingYard(infix, size, &arena, &postfix);
+        compilePostfix(postfix, size, &expr);
+        arenaFree(&arena);
+
+        double simpson = simpsons_rule_d(cases[k].a, cases[k].b, &expr, 1);
+        gauss_kronrod_d(cases[k].a, cases[k].b, &expr, 1e-10, 1e-10, 1000, &result);
+        romberg_d(cases[k].a, cases[k].b, &expr, 1e-10, 1e-10, 20, &rombergResult);
+        printf("%-16s%12.2e%8d%12.2e%12.2e%8d%12.2e%8d\n", cases[k].func, fabs(simpson - cases[k].exact), 101,
+               fabs(result.value - cases[k].exact), result.error, result.evaluations,
+               fabs(rombergResult.value - cases[k].exact), rombergResult.evaluations);
+
+        freeExpr(&expr);
+    }
+}
+
+/* Thread scaling of integrate_batch_d over count slices of [-1, 1] of a sharply peaked integrand, so their cost varies widely. */
+void benchmarkBatchQuadrature(int count) {
+    int cores = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    double* bounds = (double*) malloc(2 * count * sizeof(double));
+    double* values = (double*) malloc(count * sizeof(double));
+    double* errors = (double*) malloc(count * sizeof(double));
+    Arena arena = {NULL};
+    Var* infix = NULL;
+    Var* postfix = NULL;
+    Expr expr = {0};
+    double base = 0;
+
+    int size = parse("1/(0.000001+x^2)", &arena, &infix);
+    size = shuntingYard(infix, size, &arena, &postfix);
+    compilePostfix(postfix, size, &expr);
+    arenaFree(&arena);
+
+    for (int i = 0; i < count; i++) {
+        bounds[2*i] = -1 + 2.0 * i / count;
+        bounds[2*i + 1] = -1 + 2.0 * (i + 1) / count;
+    }
+
+    printf("\nintegrate_batch_d %d intervals\n%-10s%12s%10s%12s%12s\n", count, "threads", "ms", "speedup", "evals", "total err");
+    for (int threads = 1; ; threads *= 2) {
+        if (threads > cores) {
+            threads = cores;
+        }
+        setThreadCount(threads);
+
+        struct timespec start, stop;
+        int evaluations = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        integrate_batch_d(&expr, count, bounds, 1e-12, 1e-12, 1000, values, errors, &evaluations);
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        double elapsed = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) * 1e-9;
+
+        double total = 0;
+        for (int i = 0; i < count; i++) {
+            total += values[i];
+        }
+        if (threads == 1) {
+            base = elapsed;
+        }
+        printf("%-10d%12.1f%10.2f%12d%12.2e\n", threads, elapsed * 1e3, base / elapsed, evaluations, fabs(total - 2000 * atan(1000.0)));
+        if (threads == cores) {
+            break;
+        }
+    }
+
+    freeExpr(&expr);
+    free(bounds);
+    free(values);
+    free(errors);
+}
+
+/*
+ * Loading an n x n double matrix from the binary format against parsing the
+ * same values as text with parseMatrixText and with fscanf (the latter two
+ * on an n/4 square, which is already slow enough to make the point).
+ */
+void benchmarkMatrixIO(int n) {
+    char* binaryPath = "/tmp/NumAnalysisBench.namx";
+    char* textPath = "/tmp/NumAnalysisBench.csv";
+    int textN = n / 4;
+    MatrixData matrix = {n, n, MATRIX_DOUBLE, malloc((size_t) n * n * sizeof(double)), NULL, 0};
+    MatrixData loaded;
+    double* values = (double*) matrix.data;
+    struct timespec start, stop;
+
+    srand(3);
+    for (size_t i = 0; i < (size_t) n * n; i++) {
+        values[i] = (double) rand() / RAND_MAX - 0.5;
+    }
+    saveMatrix(binaryPath, &matrix);
+
+    FILE* file = fopen(textPath, "w");
+    for (int i = 0; i < textN; i++) {
+        for (int j = 0; j < textN; j++) {
+            fprintf(file, (j + 1 < textN) ? "%.17g," : "%.17g\n", values[(size_t) i*n + j]);
+        }
+    }
+    fclose(file);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    loadMatrix(binaryPath, &loaded);
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    double tMap = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) * 1e-9;
+    double sum = 0;
+    for (size_t i = 0; i < (size_t) n * n; i++) {
+        sum += ((double*) loaded.data)[i];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    double tTouch = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) * 1e-9;
+    int same = memcmp(loaded.data, values, (size_t) n * n * sizeof(double)) == 0;
+    freeMatrix(&loaded);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    loadMatrix(textPath, &loaded);
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    double tText = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) * 1e-9;
+    int textSame = loaded.rows == textN && loaded.cols == textN;
+    for (int i = 0; textSame && i < textN; i++) {
+        textSame = memcmp((double*) loaded.data + (size_t) i*textN, values + (size_t) i*n, textN * sizeof(double)) == 0;
+    }
+    freeMatrix(&loaded);
+
+    double* scanned = (double*) malloc((size_t) textN * textN * sizeof(double));
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    file = fopen(textPath, "r");
+    for (size_t i = 0; i < (size_t) textN * textN; i++) {
+        if (fscanf(file, "%lf,", &scanned[i]) != 1) {
+            break;
+        }
+    }
+    fclose(file);
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    double tScanf = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) * 1e-9;
+
+    printf("\nbinary %dx%d: mapped in %.3f ms, summed through in %.1f ms, %s (sum %.3f)\n",
+           n, n, tMap * 1e3, tTouch * 1e3, same ? "bit-exact" : "MISMATCH", sum);
+    printf("text %dx%d: parseMatrixText %.1f ms (%s), fscanf %.1f ms\n",
+           textN, textN, tText * 1e3, textSame ? "bit-exact" : "MISMATCH", tScanf * 1e3);
+
+    remove(binaryPath);
+    remove(textPath);
+    free(scanned);
+    free(matrix.data);
+}
+
+/* Evaluations and time per solve of every root finder at 1e-12, in double. */
+void benchmarkRoots() {
+    struct {
+        char* func;
+        double a, b;
+    } cases[] = {
+        {"x^3-2*x-5", 2, 3},
+        {"x^10-1", 0, 1.3},
+        {"exp(x)*ln(x)-x^2+sinh(x)/10", 1, 3},
+    };
+    char* names[] = {"bisection", "regula-falsi", "newton", "brent"};
+    int (*finders[])(double, double, Expr*, double, int, RootResult_d*) = {bisection_d, regula_falsi_d, newton_raphson_d, brent_d};
+    int repeat = 20000;
+
+    printf("\n%-30s%14s%8s%10s%20s\n", "function", "method", "evals", "us", "root");
+    for (int k = 0; k < 3; k++) {
+        Expr expr;
+        compileExpression(cases[k].func, &expr);
+        for (int m = 0; m < 4; m++) {
+            RootResult_d result = {0};
+            int status = 0;
+            clock_t start = clock();
+            for (int r = 0; r < repeat; r++) {
+                status = finders[m](cases[k].a, cases[k].b, &expr, 1e-12, 0, &result);
+            }
+            printf("%-30s%14s%8d%10.2f%20.15f%s\n", (m == 0) ? cases[k].func : "", names[m], result.evaluations,
+                   secondsSince(start) / repeat * 1e6, result.root, status ? " (not converged)" : "");
+        }
+        freeExpr(&expr);
+    }
+}
+
+/*
+ * find_all_roots_d on a function with a few hundred roots, sampled finely
+ * enough that refining the brackets dominates the sampling pass.
+ */
+void benchmarkAllRoots(int samples) {
+    int cores = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    double* roots = (double*) malloc(MAX_ROOTS * 4 * sizeof(double));
+    Expr expr;
+    double base = 0;
+
+    compileExpression("sin(x)*(x/1000+1)", &expr);
+
+    printf("\nfind_all_roots_d %d samples\n%-10s%12s%10s%10s%12s\n", samples, "threads", "ms", "speedup", "roots", "evals");
+    for (int threads = 1; ; threads *= 2) {
+        if (threads > cores) {
+            threads = cores;
+        }
+        setThreadCount(threads);
+
+        struct timespec start, stop;
+        int evaluations = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        int found = find_all_roots_d(-36000, 36000, &expr, samples, 1e-8, roots, MAX_ROOTS * 4, &evaluations);
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        double elapsed = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) * 1e-9;
+
+        if (threads == 1) {
+            base = elapsed;
+        }
+        printf("%-10d%12.1f%10.2f%10d%12d\n", threads, elapsed * 1e3, base / elapsed, found, evaluations);
+        if (threads == cores) {
+            break;
+        }
+    }
+
+    freeExpr(&expr);
+    free(roots);
+}
+
+/* Instruction count and time per point of the bytecode as parsed against after optimizeExpression. */
+void benchmarkOptimizer() {
+    char* funcs[] = {"sin(x)*sin(x)+3*2^4", "(x+1)^2+(x+1)^3+(x+1)^4", "exp(x)/(1+exp(x))+exp(x)", "x^2*3*1+0*x"};
+    int count = 1 << 18;
+    double* xs = (double*) malloc(count * sizeof(double));
+    double* out = (double*) malloc(count * sizeof(double));
+
+    for (int i = 0; i < count; i++) {
+        xs[i] = 0.5 + (double) i / count;
+    }
+
+    printf("\n%-30s%14s%10s%16s%16s\n", "function", "", "instr", "ns evalExpr_d", "ns evalBatch_d");
+    for (int k = 0; k < 4; k++) {
+        Arena arena = {NULL};
+        Var* infix = NULL;
+        Var* postfix = NULL;
+        Expr expr = {0};
+
+        int size = parse(funcs[k], &arena, &infix);
+        size = shuntingYard(infix, size, &arena, &postfix);
+        compilePostfix(postfix, size, &expr);
+        arenaFree(&arena);
+
+        for (int optimized = 0; optimized < 2; optimized++) {
+            volatile double sink = 0;
+            if (optimized) {
+                optimizeExpression(&expr);
+            }
+
+            clock_t start = clock();
+            for (int i = 0; i < count; i++) {
+                sink += evalExpr_d(&expr, xs[i]);
+            }
+            double scalar = secondsSince(start) / count * 1e9;
+
+            start = clock();
+            evalBatch_d(&expr, xs, out, count);
+            double batch = secondsSince(start) / count * 1e9;
+
+            printf("%-30s%14s%10d%16.1f%16.1f\n", optimized ? "" : funcs[k], optimized ? "optimized" : "as parsed", expr.length, scalar, batch);
+        }
+        freeExpr(&expr);
+    }
+    free(xs);
+    free(out);
+}
+
+/*
+ * Cost per point and error of the slope of f: forward difference (two
+ * evaluations), the symbolic derivative (f and f'), one dual-number pass,
+ * a 4th-order Taylor pass and Ridders' extrapolation, in float and double.
+ */
+void benchmarkDerivatives() {
+    char* funcs[] = {"x^3-2*x-5", "exp(x)*ln(x)-x^2+sinh(x)/10", "sin(x)*x^2+cos(2*x)"};
+    char* names[] = {"forward difference", "symbolic", "dual", "taylor(4)", "ridders"};
+    int count = 200000;
+
+    printf("\n%-30s%20s%12s%12s%12s%12s\n", "function", "slope", "ns float", "err float", "ns double", "err double");
+    for (int k = 0; k < 3; k++) {
+        Expr expr;
+        compileExpression(funcs[k], &expr);
+        for (int m = 0; m < 5; m++) {
+            volatile float sinkF = 0;
+            volatile double sinkD = 0;
+            float errorF = 0;
+            double errorD = 0;
+
+            clock_t start = clock();
+            for (int i = 0; i < count; i++) {
+                float x = 1 + i * (1.0f / count), slope = 0, c[5];
+                Derivative r;
+                switch (m) {
+                    case 0: slope = derive(&expr, x); break;
+                    case 1: evalExpr(&expr, x); slope = evalExpr(expr.derivative, x); break;
+                    case 2: evalDual(&expr, x, &slope); break;
+                    case 3: evalTaylor(&expr, x, 4, c); slope = c[1]; break;
+                    case 4: ridders_derivative(&expr, x, 1, &r); slope = r.value; break;
+                }
+                sinkF += slope;
+            }
+            double nsF = secondsSince(start) / count * 1e9;
+
+            start = clock();
+            for (int i = 0; i < count; i++) {
+                double x = 1 + i * (1.0 / count), slope = 0, c[5];
+                Derivative_d r;
+                switch (m) {
+                    case 0: slope = derive_d(&expr, x); break;
+                    case 1: evalExpr_d(&expr, x); slope = evalExpr_d(expr.derivative, x); break;
+                    case 2: evalDual_d(&expr, x, &slope); break;
+                    case 3: evalTaylor_d(&expr, x, 4, c); slope = c[1]; break;
+                    case 4: ridders_derivative_d(&expr, x, 1, &r); slope = r.value; break;
+                }
+                sinkD += slope;
+            }
+            double nsD = secondsSince(start) / count * 1e9;
+
+            /* Errors against the long double dual slope on a few points. */
+            for (int i = 0; i < 100; i++) {
+                long double x = 1 + i / 100.0L, exact = 0;
+                float slopeF = 0, c[5];
+                double slopeD = 0, cd[5];
+                Derivative r;
+                Derivative_d rd;
+                evalDual_ld(&expr, x, &exact);
+                switch (m) {
+                    case 0: slopeF = derive(&expr, x); slopeD = derive_d(&expr, x); break;
+                    case 1: slopeF = evalExpr(expr.derivative, x); slopeD = evalExpr_d(expr.derivative, x); break;
+                    case 2: evalDual(&expr, x, &slopeF); evalDual_d(&expr, x, &slopeD); break;
+                    case 3: evalTaylor(&expr, x, 4, c); evalTaylor_d(&expr, x, 4, cd); slopeF = c[1]; slopeD = cd[1]; break;
+                    case 4: ridders_derivative(&expr, x, 1, &r); ridders_derivative_d(&expr, x, 1, &rd); slopeF = r.value; slopeD = rd.value; break;
+                }
+                errorF = fmaxf(errorF, fabsl(slopeF - exact) / fabsl(exact));
+                errorD = fmax(errorD, fabsl(slopeD - exact) / fabsl(exact));
+            }
+            printf("%-30s%20s%12.1f%12.1e%12.1f%12.1e\n", (m == 0) ? funcs[k] : "", names[m], nsF, errorF, nsD, errorD);
+        }
+        freeExpr(&expr);
+    }
+}
+
+/* An n x n grid of a two-variable surface: one evalBound_d per point against evalGrid_d as threads are added. */
+void benchmarkGrid(int n) {
+    const char* names[] = {"x", "y"};
+    int cores = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    double* axis = (double*) malloc(n * sizeof(double));
+    double* out = (double*) malloc((size_t) n * n * sizeof(double));
+    const double* axes[] = {axis, axis};
+    int slots[] = {0, 1};
+    int sizes[] = {n, n};
+    volatile double sink = 0;
+    struct timespec start, stop;
+    double base = 0;
+    Expr expr;
+
+    compileMultivariate("exp(0-x^2-y^2)*cos(x*y)+x*y^2", names, 2, &expr);
+    for (int i = 0; i < n; i++) {
+        axis[i] = -2 + 4.0 * i / (n - 1);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            sink += evalBound_d(&expr, (double[]) {axis[i], axis[j]});
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    double scalar = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) * 1e-9;
+
+    printf("\nevalGrid_d %dx%d, evalBound_d per point %.1f ms\n%-10s%12s%10s%12s\n", n, n, scalar * 1e3, "threads", "ms", "speedup", "vs scalar");
+    for (int threads = 1; ; threads *= 2) {
+        if (threads > cores) {
+            threads = cores;
+        }
+        setThreadCount(threads);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        evalGrid_d(&expr, NULL, 2, slots, axes, sizes, out);
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        double elapsed = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) * 1e-9;
+
+        if (threads == 1) {
+            base = elapsed;
+        }
+        printf("%-10d%12.1f%10.2f%12.2f\n", threads, elapsed * 1e3, base / elapsed, scalar / elapsed);
+        if (threads == cores) {
+            break;
+        }
+    }
+
+    freeExpr(&expr);
+    free(axis);
+    free(out);
+}
+
+/*
+ * Broyden's tridiagonal system (3 - 2x_i) x_i - x_(i-1) - 2x_(i+1) + 1 = 0
+ * in n unknowns from x = -1, with each Jacobian and update strategy.
+ */
+void benchmarkSystem(int n) {
+    char* updates[] = {"newton", "frozen", "broyden"};
+    char** names = (char**) malloc(n * sizeof(char*));
+    Expr* equations = (Expr*) malloc(n * sizeof(Expr));
+    double* x = (double*) malloc(n * sizeof(double));
+    char func[128];
+
+    /* The unknowns are called va, vb, ..., vz, vab, ...: names are letters only. */
+    for (int i = 0; i < n; i++) {
+        names[i] = (char*) malloc(16);
+        int k = 0;
+        names[i][k++] = 'v';
+        for (int v = i; k == 1 || v > 0; v /= 26) {
+            names[i][k++] = 'a' + v % 26;
+        }
+        names[i][k] = '\0';
+    }
+    for (int i = 0; i < n; i++) {
+        snprintf(func, sizeof(func), "(3-2*%s)*%s-%s-2*%s+1", names[i], names[i], (i > 0) ? names[i-1] : "0", (i < n-1) ? names[i+1] : "0");
+        compileMultivariate(func, (const char* const*) names, n, &equations[i]);
+    }
+
+    printf("\nnewton_system_d, Broyden tridiagonal n=%d\n%-10s%10s%12s%14s%12s%12s\n", n, "jacobian", "update", "iterations", "evaluations", "jacobians", "ms");
+    for (int jacobian = JACOBIAN_DIFFERENCE; jacobian <= JACOBIAN_DUAL; jacobian++) {
+        for (int update = UPDATE_NEWTON; update <= UPDATE_BROYDEN; update++) {
+            SystemResult_d result;
+            struct timespec start, stop;
+
+            for (int i = 0; i < n; i++) {
+                x[i] = -1;
+            }
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            int status = newton_system_d(n, equations, x, jacobian, update, 1e-10, 0, &result);
+            clock_gettime(CLOCK_MONOTONIC, &stop);
+            double elapsed = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) * 1e-9;
+
+            printf("%-10s%10s%12d%14d%12d%12.1f%s\n", jacobian ? "dual" : "difference", updates[update], result.iterations,
+                   result.evaluations, result.jacobians, elapsed * 1e3, status ? " not-converged" : "");
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        freeExpr(&equations[i]);
+        free(names[i]);
+    }
+    free(names);
+    free(equations);
+    free(x);
+}
+
+/*
+ * Cost per query of interpolating count samples of exp on [0, 1]: the old
+ * path that rebuilds the divided differences for every query, one fit
+ * evaluated point by point, and the same fit evaluated as one batch.
+ */
+void benchmarkInterpolation(int count, int queries) {
+    double* x = (double*) malloc(count * sizeof(double));
+    double* y = (double*) malloc(count * sizeof(double));
+    double* values = (double*) malloc(queries * sizeof(double));
+    double* out = (double*) malloc(queries * sizeof(double));
+    int rebuilt = queries / 64;
+    volatile double sink = 0;
+    struct timespec start, stop;
+    NewtonPoly_d poly;
+
+    for (int i = 0; i < count; i++) {
+        x[i] = (double) i / (count - 1);
+        y[i] = exp(x[i]);
+    }
+    for (int i = 0; i < queries; i++) {
+        values[i] = (double) i / queries;
+    }
+
+    printf("\n%d-point Newton interpolation, %d queries\n%-26s%12s%12s\n", count, queries, "", "ns/query", "max error");
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < rebuilt; i++) {
+        sink += newton_interpolate_d(count, x, y, values[i * 64]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    double elapsed = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) * 1e-9;
+    printf("%-26s%12.1f%12s\n", "newton_interpolate_d", elapsed / rebuilt * 1e9, "");
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    newton_fit_d(&poly, count, x, y);
+    for (int i = 0; i < queries; i++) {
+        out[i] = newton_eval_d(&poly, values[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    elapsed = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) * 1e-9;
+    double error = 0;
+    for (int i = 0; i < queries; i++) {
+        error = fmax(error, fabs(out[i] - exp(values[i])));
+    }
+    printf("%-26s%12.1f%12.2e\n", "newton_fit_d + eval", elapsed / queries * 1e9, error);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    newton_eval_batch_d(&poly, values, out, queries);
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    elapsed = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) * 1e-9;
+    error = 0;
+    for (int i = 0; i < queries; i++) {
+        error = fmax(error, fabs(out[i] - exp(values[i])));
     }
+    printf("%-26s%12.2f%12.2e\n", "newton_eval_batch_d", elapsed / queries * 1e9, error);
+
+    newton_free_d(&poly);
+    free(x);
+    free(y);
+    free(values);
+    free(out);
 }
 
-void parse(char* func, Var** infix) {
-    char buffer = '\0';
-    int i = 0;
+/*
+ * A count-entry table of Runge's function 1/(1+25x^2) on [-1, 1], equally
+ * spaced and with jittered knots: fit time, cost per query (scalar and
+ * batch) and maximum error of the spline and the barycentric interpolants.
+ * The O(count) barycentric queries run on a sample of the points.
+ */
+void benchmarkLookup(int count, int queries) {
+    double* x = (double*) malloc(count * sizeof(double));
+    double* y = (double*) malloc(count * sizeof(double));
+    double* values = (double*) malloc(queries * sizeof(double));
+    double* out = (double*) malloc(queries * sizeof(double));
+    struct timespec start, stop;
+
+    for (int i = 0; i < queries; i++) {
+        values[i] = -1 + 2.0 * ((i * 2654435761u) % queries) / queries;
+        out[i] = 0;
+    }
 
-    int l, k;
-    for (l = 0, k = 0; func[l]; l++) {
-        if (func[l] != ' ') {
-            func[k++] = func[l];
+    printf("\n%d-entry table of 1/(1+25x^2), %d queries\n%-28s%12s%14s%14s%12s\n", count, queries, "", "fit us",
+           "ns/query", "ns batched", "max error");
+    for (int jitter = 0; jitter < 2; jitter++) {
+        for (int i = 0; i < count; i++) {
+            x[i] = -1 + (2.0 * i + ((jitter && i > 0 && i < count - 1) ? 0.3 * sin(i) : 0)) / (count - 1);
+            y[i] = 1 / (1 + 25 * x[i] * x[i]);
         }
-    }
-    func = (char*) realloc(func, k * sizeof(char));
-    func[k] = '\0';
 
-    while (func[i] != '\0') {
-        Var variable;
-        variable.input = (char*) calloc(100, sizeof(char));
-        int j = 0;
-        int bool = 0;
+        for (int method = 0; method < 3; method++) {
+            Spline_d spline;
+            Barycentric_d barycentric;
+            int n = (method == 0) ? queries : queries / 256;
+            volatile double sink = 0;
 
-        if (buffer != '\0') {
-            strncat(variable.input, &buffer, 1);
-            bool = 0;
-        } 
-        
-        if (isdigit(func[i]) || func[i] == '.') {
-            do {
-                strncat(variable.input, &func[i++], 1);
-                if (isdigit(func[i]) || func[i] == '.') {
-                    j++;
-                }
-            } while ((isdigit(func[i]) || func[i] == '.') && func[i] != '\0');
-        } else if (isalpha(func[i])) {
-            do {
-                strncat(variable.input, &func[i++], 1);
-                if (size > 0 && (((*infix)[size-1].input[0] == '-' || (*infix)[size-1].input[0] == '+') ? isdigit((*infix)[size-1].input[1]):isdigit((*infix)[size-1].input[0])) && strcmp(variable.input, "x") == 0) {
-                    Var tempVar;
-                    tempVar.input = strdup("*");
-                    (*infix)[size++] = tempVar;
-                    *infix = realloc(*infix, (size+1) * sizeof(Var));
-                }
-                if (isalpha(func[i])) {
-                    j++;
-                }
-            } while (isalpha(func[i]) && func[i] != '\0');
-        } else if (func[i] == '_') {
-            if ((!isdigit(func[i-1]) && strcmp(&func[i-1], "x") != 0) && func[i-1] != ')') {
-                buffer = func[i++];
-                bool = 1;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            if (method == 0) {
+                spline_fit_d(&spline, count, x, y);
             } else {
-                strncat(variable.input, &func[i++], 1);
+                barycentric_fit_d(&barycentric, count, x, y, (method == 1) ? 3 : -1);
             }
-        } else {
-            strncat(variable.input, &func[i++], 1);
-        }
+            clock_gettime(CLOCK_MONOTONIC, &stop);
+            double fit = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) * 1e-9;
+
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (int i = 0; i < n; i++) {
+                sink += (method == 0) ? spline_eval_d(&spline, values[i]) : barycentric_eval_d(&barycentric, values[i]);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &stop);
+            double scalar = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) * 1e-9;
 
-        if (buffer == '\0') {
-            variable.input = realloc(variable.input, (j+1) * sizeof(char));
-            variable.input[j+1] = '\0';
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            if (method == 0) {
+                spline_eval_batch_d(&spline, values, out, n);
+            } else {
+                barycentric_eval_batch_d(&barycentric, values, out, n);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &stop);
+            double batch = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) * 1e-9;
 
-            (*infix)[size++] = variable;
-            *infix = realloc(*infix, (size+1) * sizeof(Var));
-        } else if (buffer != '\0' && bool == 0) {
-            variable.input = realloc(variable.input, (j+2) * sizeof(char));
-            variable.input[j+2] = '\0';
+            double error = 0;
+            for (int i = 0; i < n; i++) {
+                error = fmax(error, fabs(out[i] - 1 / (1 + 25 * values[i] * values[i])));
+            }
 
-            (*infix)[size++] = variable;
-            *infix = realloc(*infix, (size+1) * sizeof(Var));
-            buffer = '\0';
-            bool = 0;
+            char label[64];
+            if (method == 0) {
+                snprintf(label, sizeof(label), "spline, %s knots", spline.uniform ? "uniform" : "searched");
+                spline_free_d(&spline);
+            } else {
+                snprintf(label, sizeof(label), "barycentric, degree %d", barycentric.degree);
+                barycentric_free_d(&barycentric);
+            }
+            printf("%-28s%12.1f%14.1f%14.1f%12.2e\n", label, fit * 1e6, scalar / n * 1e9, batch / n * 1e9, error);
         }
     }
+
+    free(x);
+    free(y);
+    free(values);
+    free(out);
 }
 
-void shuntingYard(Var* infix, Var** postfix) {
-    Node* stack = NULL;
-    Var* queue = (Var*) calloc(size, sizeof(Var));
+/* ridders_derivative_d point by point against ridders_batch_d on count points, for the first three orders. */
+void benchmarkRidders(int count) {
+    double* xs = (double*) malloc(count * sizeof(double));
+    double* values = (double*) malloc(count * sizeof(double));
+    double* errors = (double*) malloc(count * sizeof(double));
+    struct timespec start, stop;
+    Expr expr;
 
-    int j = 0;
-    for (int i = 0; i < size; i++) {
-        char* head = "\0";
-        if (stack != NULL) {
-            head = stack->Variable.input;
-        }
-
-        int matchHeadTrig = matchStrings(head, 1);
-        int headPrec = operators[findStruct(head, 0)].prec;
-        int infixPrec = operators[findStruct(infix[i].input, 0)].prec;
-        int headAssoc = operators[findStruct(head, 0)].assoc;
-
-        if (isInt(infix[i].input)) {
-            queue[j++].input = infix[i].input;
-        } else if (isalpha(*infix[i].input) && !matchStrings(infix[i].input, 1)) {
-            queue[j++].input = infix[i].input;
-        } else if (matchStrings(infix[i].input, 1) || strchr(infix[i].input, '_') || strcmp(infix[i].input, "log") == 0) {
-            insertAtBeginning(&stack, infix[i]);
-        } else if (matchStrings(infix[i].input, 0)) {
-            while (stack != NULL && ((matchHeadTrig || headPrec > infixPrec || strchr(head, '_') || (headPrec == infixPrec && headAssoc == ASSOC_LEFT)) && *head != '(')) {
-                queue[j++] = stack->Variable;
-                popTop(&stack);
-                if (stack != NULL) {
-                    head = stack->Variable.input;
-                    matchHeadTrig = matchStrings(head, 1);
-                    headPrec = operators[findStruct(head, 0)].prec;
-                    headAssoc = operators[findStruct(head, 0)].assoc;
-                }
-            }
-            insertAtBeginning(&stack, infix[i]);
-        } else if (*infix[i].input == '(') {
-            insertAtBeginning(&stack, infix[i]);
-        } else if (*infix[i].input == ')') {
-            while (*stack->Variable.input != '(') {
-                queue[j++] = stack->Variable;
-                popTop(&stack);
-            }
-            popTop(&stack);
-        }
+    compileExpression("exp(x)*ln(x)-x^2+sinh(x)/10", &expr);
+    for (int i = 0; i < count; i++) {
+        xs[i] = 1 + 4.0 * i / count;
     }
 
-    while (stack != NULL) {
-        queue[j++] = stack->Variable;
-        popTop(&stack);
+    printf("\nRidders derivatives of exp(x)*ln(x)-x^2+sinh(x)/10 at %d points\n%-8s%14s%14s%12s%12s\n", count, "order", "ns scalar",
+           "ns batch", "max error", "estimate");
+    for (int order = 1; order <= 3; order++) {
+        volatile double sink = 0;
+        double error = 0, estimate = 0;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < count; i++) {
+            Derivative_d result;
+            ridders_derivative_d(&expr, xs[i], order, &result);
+            sink += result.value;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        double scalar = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) * 1e-9;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        ridders_batch_d(&expr, xs, count, order, values, errors);
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        double batch = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) * 1e-9;
+
+        /* Against the long double Taylor coefficients, scaled by order!. */
+        for (int i = 0; i < count; i++) {
+            long double c[4];
+            evalTaylor_ld(&expr, xs[i], order, c);
+            long double exact = c[order] * ((order == 3) ? 6 : order);
+            error = fmax(error, (double) (fabsl(values[i] - exact) / fabsl(exact)));
+            estimate = fmax(estimate, (double) (errors[i] / fabsl(exact)));
+        }
+        printf("%-8d%14.1f%14.1f%12.2e%12.2e\n", order, scalar / count * 1e9, batch / count * 1e9, error, estimate);
     }
 
-    size = j;
-    *postfix = realloc(queue, size * sizeof(Var));
-    freeList(stack);
+    freeExpr(&expr);
+    free(xs);
+    free(values);
+    free(errors);
 }
 
-float evalPostfix(Var* postfix, float x) {
-    Node* stack = NULL;
-    int j = 0;
-    for (int i = 0; i < size; i++) {
-        if (isInt(postfix[i].input)) { 
-            insertAtBeginning(&stack, postfix[i]);
-        } else if (matchStrings(postfix[i].input, 0)) { 
-            Var var;
-            var.input = (char*) malloc(32 * sizeof(char));
-            float b = strtof(stack->Variable.input, NULL);
-            popTop(&stack);
-            float a = strtof(stack->Variable.input, NULL);
-            popTop(&stack);
-
-            float answer = operators[findStruct(postfix[i].input, 0)].func(a, b);
+#endif
 
-            gcvt(answer, 6, var.input);
-            insertAtBeginning(&stack, var);
-        } else if (matchStrings(postfix[i].input, 1) && strcmp(postfix[i].input, "log") != 0) { 
-            Var var;
-            var.input = (char*) malloc(32 * sizeof(char));
-            int index = findStruct(postfix[i].input, 1);
-            float val = 0.0;
-            float num = (index > 4) ? strtof(stack->Variable.input, NULL) * M_PI / 180 : strtof(stack->Variable.input, NULL);
-            popTop(&stack);
+#ifdef SELFCHECK
+/*
+ * Build with -DSELFCHECK to check results against known values instead of
+ * running the front end. Every failed check is printed, and the exit status
+ * is non-zero if there was one.
+ */
+int checkCount = 0;
+int checkFailures = 0;
+
+int selfCheck() {
+    checkBytecode();
+    checkCompileErrors();
+    checkBatch();
+    checkSinCos();
+    checkTrapezoidal();
+    checkJit();
+    checkArena();
+    checkSymbols();
+    checkWideFunctions();
+    checkPrecision();
+    checkRoots();
+    checkQuadrature();
+    checkDense();
+    checkLargeDense();
+    checkParallelFor();
+    checkPoolSharing();
+    checkSparse();
+    checkRelax();
+    checkIntegrateBatch();
+    checkConcurrentCallers();
+    checkDerivatives();
+    checkInterpolation();
+    checkInterpolationBatch();
+    checkMatrixIO();
+    checkParseNumber();
+    checkAllRoots();
+    checkSymbolic();
+    checkTaylor();
+    checkOptimizer();
+    checkMultivariate();
+    checkNewtonSystem();
+    checkBarycentric();
+    checkSpline();
+    checkRidders();
+    checkConcurrentCompile();
+    printf("%d checks, %d failed\n", checkCount, checkFailures);
+    return checkFailures > 0;
+}
 
-            val = functions[findStruct(postfix[i].input, 1)].func(num);
+/* Passes when |got - want| <= tolerance * max(|want|, 1). */
+void checkValue(const char* label, double got, double want, double tolerance) {
+    checkCount++;
+    if (!(fabs(got - want) <= tolerance * fmax(fabs(want), 1))) {
+        printf("FAIL %-36s got %.17g, want %.17g\n", label, got, want);
+        checkFailures++;
+    }
+}
 
-            gcvt(val, 6, var.input);
-            insertAtBeginning(&stack, var);
-        } else if (isalpha(*postfix[i].input) && !matchStrings(postfix[i].input, 1) && strcmp(postfix[i].input, "log") != 0) {
-            Var var;
-            var.input = (char*) malloc(32 * sizeof(char));
+void checkStatus(const char* label, int got, int want) {
+    checkCount++;
+    if (got != want) {
+        printf("FAIL %-36s status %d, want %d\n", label, got, want);
+        checkFailures++;
+    }
+}
 
-            if (strcmp(postfix[i].input, "x") == 0) {
-                gcvt(x, 6, var.input);
-            } else if (strcmp(postfix[i].input, "e") == 0) {
-                gcvt(M_E, 6, var.input);
-            } else if (strcmp(postfix[i].input, "pi") == 0) {
-                gcvt(M_PI, 6, var.input);
-            }
+/* The bytecode interpreter against closed forms; trigonometric functions take degrees. */
+void checkBytecode() {
+    const char* sources[] = {"x^2+3*x-1", "3x^2+2^x", "(x+1)/(x-1)", "sin(x)", "cos(2*x)", "arctan(x/3)", "x_2", "e^(x-3)"};
+    float x = 3;
+    double expected[] = {17, 35, 2, sin(M_PI / 60), cos(M_PI / 30), atan(1.0), log2(3.0), 1};
+    Expr expr = {0};
+
+    for (int i = 0; i < (int) (sizeof(sources) / sizeof(sources[0])); i++) {
+        compileExpression(sources[i], &expr);
+        checkValue(sources[i], evalExpr(&expr, x), expected[i], 1e-6);
+        freeExpr(&expr);
+    }
+}
 
-            insertAtBeginning(&stack, var);
-        } else if (strchr(postfix[i].input, '_')) { 
-            Var var;
-            var.input = (char*) malloc(32 * sizeof(char));
-            float a = strtof(stack->Variable.input, NULL);
-            float b = strtof(postfix[i].input + 1, NULL); 
-            popTop(&stack);
+/* Malformed input is reported as a COMPILE_ status and leaves nothing to free. */
+void checkCompileErrors() {
+    const char* sources[] = {"(x+1", "x+1)", "sin(x", "y+1", "x+foo(2)", "x+", "*x", "x 2"};
+    int expected[] = {COMPILE_PARENTHESES, COMPILE_PARENTHESES, COMPILE_PARENTHESES, COMPILE_IDENTIFIER, COMPILE_IDENTIFIER,
+                      COMPILE_MALFORMED, COMPILE_MALFORMED, COMPILE_MALFORMED};
+    const char* names[] = {"x", "a"};
+    Expr expr;
+
+    for (int i = 0; i < (int) (sizeof(sources) / sizeof(sources[0])); i++) {
+        checkStatus(sources[i], compileExpression(sources[i], &expr), expected[i]);
+        checkStatus(sources[i], expr.code == NULL && expr.names == NULL && expr.derivative == NULL, 1);
+    }
+    checkStatus("a*x+z", compileMultivariate("a*x+z", names, 2, &expr), COMPILE_IDENTIFIER);
+    checkStatus("a*x+pi", compileMultivariate("a*x+pi", names, 2, &expr), 0);
+    freeExpr(&expr);
+    checkStatus("compileError", strcmp(compileError(COMPILE_MALFORMED), "malformed expression"), 0);
+}
 
-            float answer = eval_log(a, b);
+/* evalBatch must agree with evalExpr, including the POWI, sin/cos and generic pow paths. */
+void checkBatch() {
+    const char* sources[] = {"x^3-2*x", "(x+1)/(x^2+1)", "sin(x)*cos(x)", "x^2.5+1", "x_2+arctan(x)", "2^x/x"};
+    float xs[300];
+    float out[300];
+    char label[64];
+    Expr expr = {0};
 
-            gcvt(answer, 6, var.input);
-            insertAtBeginning(&stack, var);
+    for (int i = 0; i < 300; i++) {
+        xs[i] = 0.5f + i / 7.0f;
+    }
+    for (int k = 0; k < (int) (sizeof(sources) / sizeof(sources[0])); k++) {
+        double error = 0;
+
+        compileExpression(sources[k], &expr);
+        evalBatch(&expr, xs, out, 300);
+        for (int i = 0; i < 300; i++) {
+            double want = evalExpr(&expr, xs[i]);
+            error = fmax(error, fabs(out[i] - want) / fmax(fabs(want), 1));
         }
+        snprintf(label, sizeof(label), "evalBatch %s", sources[k]);
+        checkValue(label, error, 0, 1e-6);
+        freeExpr(&expr);
     }
-
-    float answer = strtof(stack->Variable.input, NULL);
-    freeList(stack);
-    return answer;
 }
 
-float bisection(float a, float b, Var* postfix) {
-    float c;
+/* The Cody-Waite sin/cos kernel against libm, on both sides of zero and past several periods. */
+void checkSinCos() {
+    float angles[BATCH_BLOCK];
+    float values[BATCH_BLOCK];
 
-    printf("i\ta\t\tb\t\tc\t\tf(c)\n");
-    for (int i = 0; (fabs(b-a) >= EPSILON); i++) {
-        printf("%d\t", i);
-        c = (a+b)/2;
-        printf("%lf\t", a);
-        printf("%lf\t", b);
-        printf("%lf\t", c);
-        printf("%lf\t\n", evalPostfix(postfix, c));
+    for (int cosine = 0; cosine <= 1; cosine++) {
+        double error = 0;
 
-        if (evalPostfix(postfix, c) == 0) { return c; }
-
-        if (evalPostfix(postfix, c) * evalPostfix(postfix, a) < 0) {
-            b = c;
-        } else {
-            a = c;
+        for (int i = 0; i < BATCH_BLOCK; i++) {
+            angles[i] = -40 + 80.0f * i / BATCH_BLOCK;
+            values[i] = angles[i];
         }
+        batchSinCos(values, BATCH_BLOCK, 1, cosine);
+        for (int i = 0; i < BATCH_BLOCK; i++) {
+            double want = cosine ? cos((double) angles[i]) : sin((double) angles[i]);
+            error = fmax(error, fabs(values[i] - want));
+        }
+        checkValue(cosine ? "batchSinCos cos" : "batchSinCos sin", error, 0, 5e-7);
     }
+}
 
-    return c;
+void checkTrapezoidal() {
+    Expr expr = {0};
+
+    compileExpression("2*x+1", &expr);
+    checkValue("trapezoidal 2x+1 on [0, 3]", trapezoidal(0, 3, &expr), 12, 1e-5);
+    freeExpr(&expr);
+
+    /* The composite rule with 100 panels is off by (b-a)^3 f'' / (12 n^2) = 4.5e-4 for x^2. */
+    compileExpression("x^2", &expr);
+    checkValue("trapezoidal x^2 on [0, 3]", trapezoidal(0, 3, &expr), 9.00045, 1e-5);
+    freeExpr(&expr);
 }
 
-float regula_falsi(float a, float b, Var* postfix) {
-    int i = 0;
-    float c;
-    float fa = evalPostfix(postfix, a);
-    float fb = evalPostfix(postfix, b);
-    float fc;
-
-    printf("i\ta\t\tb\t\tc\t\tf(c)\n");
-    do {
-        c = a - (a - b) * evalPostfix(postfix, a) / (evalPostfix(postfix, a) - evalPostfix(postfix, b));
-        fc = evalPostfix(postfix, c);
-        printf("%d\t", i);
-        printf("%lf\t", a);
-        printf("%lf\t", b);
-        printf("%lf\t", c);
-        printf("%lf\t\n", evalPostfix(postfix, c));
-
-        if (evalPostfix(postfix, c) * evalPostfix(postfix, a) < 0) {
-            b = c;
-            fb = fc;
-        } else {
-            a = c;
-            fa = fc;
+/*
+ * native and nativeBatch against the interpreter, which evalExpr falls back
+ * to with native cleared; skipped where jitCompile declines.
+ */
+void checkJit() {
+    const char* sources[] = {"x^3-2*x+1", "(x+1)/(x^2+1)", "sin(x)*cos(x)+tan(x/4)", "x^2.5-x^7", "x_2*arctan(x)", "e^(x/10)-pi", "((x-1)*(x-2))/((x+1)*(x+2))"};
+    float xs[300];
+    float want[300];
+    float out[300];
+    char label[64];
+    Expr expr;
+
+    for (int i = 0; i < 300; i++) {
+        xs[i] = 0.25f + i / 11.0f;
+    }
+    for (int k = 0; k < (int) (sizeof(sources) / sizeof(sources[0])); k++) {
+        double error = 0;
+        double batchError = 0;
+
+        compileExpression(sources[k], &expr);
+        float (*native)(float x) = expr.native;
+        if (native == NULL) {
+            freeExpr(&expr);
+            return;
+        }
+        expr.native = NULL;
+        for (int i = 0; i < 300; i++) {
+            want[i] = evalExpr(&expr, xs[i]);
         }
-        i++;
-    } while (fabs(fc) > EPSILON);
+        expr.native = native;
 
-    return c;
+        expr.nativeBatch(xs, out, 300);
+        for (int i = 0; i < 300; i++) {
+            double scale = fmax(fabs(want[i]), 1);
+            error = fmax(error, fabs(expr.native(xs[i]) - want[i]) / scale);
+            batchError = fmax(batchError, fabs(out[i] - want[i]) / scale);
+        }
+        snprintf(label, sizeof(label), "native %s", sources[k]);
+        checkValue(label, error, 0, 1e-6);
+        snprintf(label, sizeof(label), "nativeBatch %s", sources[k]);
+        checkValue(label, batchError, 0, 1e-6);
+        freeExpr(&expr);
+    }
 }
 
-float newton_raphson(float a, float b, Var* postfix) {
-    int i = 0;
-    float fa;
-    float fb = 0;
-    float fc;
-    float ga;
-
-    printf("i\ta\t\tf(a)\t\tb\t\tf(b)\n");
-    do {
-        ga = derive(postfix, a);
-        fa = evalPostfix(postfix, a);
+/* An expression long enough that its tokens span several arena chunks. */
+void checkArena() {
+    int terms = 2000;
+    char* source = (char*) malloc(4 * terms);
+    Expr expr = {0};
 
-        b = a - fa/ga;
-        a = b;
+    strcpy(source, "x");
+    for (int i = 1; i < terms; i++) {
+        strcat(source, i % 2 ? "+x" : "-1");
+    }
+    compileExpression(source, &expr);
+    checkValue("2000-term sum", evalExpr(&expr, 1.5f), 1001 * 1.5 - 999, 0);
+    freeExpr(&expr);
+    free(source);
+}
 
-        printf("%d\t%lf\t%lf\t%lf\t%lf\n", i, a, fa, b, fb);
+float cubed(float x) { return x*x*x; }
+double cubed_d(double x) { return x*x*x; }
+long double cubed_ld(long double x) { return x*x*x; }
+
+/* Built-in and registered functions next to operators, so the operator stack holds function tokens. */
+void checkSymbols() {
+    const char* sources[] = {"2*sqrt(x)+ln(x)*3", "exp(x)-abs(1-x)^2", "sinh(x)/cosh(x)-tanh(x)", "sin(x)^2+cos(x)^2", "cubed(x)-x*x*x+cubed(2)"};
+    double x = 4;
+    double expected[] = {4 + 3 * log(4.0), exp(4.0) - 9, 0, 1, 8};
+    char name[] = "cubed";
+    Expr expr = {0};
+
+    /* The table keeps its own copy of the name, so the caller's buffer can be reused. */
+    checkStatus("registerFunction", registerFunction(name, cubed, 0, NULL, NULL) >= 0, 1);
+    strcpy(name, "xxxxx");
+    checkStatus("registerFunction taken name", registerFunction("sin", cubed, 0, NULL, NULL), -1);
+    for (int i = 0; i < (int) (sizeof(sources) / sizeof(sources[0])); i++) {
+        compileExpression(sources[i], &expr);
+        checkValue(sources[i], evalExpr(&expr, x), expected[i], 1e-6);
+        freeExpr(&expr);
+    }
+}
 
-        i++;
+/* A function registered with double and long double versions is evaluated and differentiated in those precisions. */
+void checkWideFunctions() {
+    long double third = 1.0L / 3;
+    long double wide = 0;
+    double slope = 0;
+    Expr expr;
+
+    checkStatus("registerFunction cube", registerFunction("cube", cubed, 0, cubed_d, cubed_ld) >= 0, 1);
+    compileExpression("cube(x)", &expr);
+    checkValue("cube(x) in double", evalExpr_d(&expr, 1.0 / 3), 1.0 / 27, 1e-16);
+    checkStatus("cube(x) in long double", evalExpr_ld(&expr, third) == third*third*third, 1);
+    freeExpr(&expr);
+
+    compileExpression("cube(x)+x", &expr);
+    evalDual_d(&expr, 2, &slope);
+    checkValue("evalDual_d through cube", slope, 13, 1e-9);
+    evalDual_ld(&expr, 2, &wide);
+    checkValue("evalDual_ld through cube", (double) wide, 13, 1e-12);
+    freeExpr(&expr);
+}
 
-        fb = evalPostfix(postfix, b);
+/* The three families on the same bytecode; the wider ones see unrounded literals, e and pi. */
+void checkPrecision() {
+    double xs[200];
+    double out[200];
+    double error = 0;
+    Expr expr = {0};
+
+    compileExpression("3x^2+2^x", &expr);
+    checkValue("3x^2+2^x at 3 (float)", evalExpr(&expr, 3), 35, 1e-6);
+    checkValue("3x^2+2^x at 3 (double)", evalExpr_d(&expr, 3), 35, 1e-15);
+    checkValue("3x^2+2^x at 3 (long double)", evalExpr_ld(&expr, 3), 35, 1e-15);
+    freeExpr(&expr);
+
+    compileExpression("x/3+0.1", &expr);
+    checkValue("x/3+0.1 at 1 (double)", evalExpr_d(&expr, 1), 1.0/3 + 0.1, 1e-16);
+    checkValue("x/3+0.1 at 1 (long double)", (double) (evalExpr_ld(&expr, 1) - (1.0L/3 + 0.1L)), 0, 1e-18);
+    freeExpr(&expr);
+
+    compileExpression("pi*x-e", &expr);
+    checkValue("pi*x-e at 1 (long double)", (double) (evalExpr_ld(&expr, 1) - (PI_L - E_L)), 0, 1e-18);
+    freeExpr(&expr);
+
+    compileExpression("sin(x)*x^3+ln(x)/x_2", &expr);
+    for (int i = 0; i < 200; i++) {
+        xs[i] = 1.5 + i / 3.0;
+    }
+    evalBatch_d(&expr, xs, out, 200);
+    for (int i = 0; i < 200; i++) {
+        double want = evalExpr_d(&expr, xs[i]);
+        error = fmax(error, fabs(out[i] - want) / fmax(fabs(want), 1));
+    }
+    checkValue("evalBatch_d", error, 0, 1e-15);
+    freeExpr(&expr);
+}
 
-    } while (fabs(fb) > EPSILON);
+/* x^3 - 2x - 5 has its real root at 2.0945514815423265. */
+void checkRoots() {
+    const double root = 2.0945514815423265;
+    RootResult_d result = {0};
+    RootResult single = {0};
+    Iteration_d history[4];
+    Expr expr;
+
+    compileExpression("x^3-2*x-5", &expr);
+    checkStatus("bisection_d", bisection_d(2, 3, &expr, 1e-13, 0, &result), 0);
+    checkValue("bisection_d", result.root, root, 1e-12);
+    checkStatus("regula_falsi_d", regula_falsi_d(2, 3, &expr, 1e-13, 0, &result), 0);
+    checkValue("regula_falsi_d", result.root, root, 1e-12);
+    checkStatus("brent_d", brent_d(2, 3, &expr, 1e-13, 0, &result), 0);
+    checkValue("brent_d", result.root, root, 1e-12);
+    checkStatus("newton_raphson_d", newton_raphson_d(2, 0, &expr, 1e-13, 0, &result), 0);
+    checkValue("newton_raphson_d", result.root, root, 1e-12);
+    checkStatus("newton_raphson_d at a root", newton_raphson_d(result.root, 0, &expr, 1e-13, 0, &result), 0);
+    checkStatus("newton_raphson_d at a root", result.iterations, 0);
+    checkStatus("bisection (float)", bisection(2, 3, &expr, 1e-5f, 0, &single), 0);
+    checkValue("bisection (float)", single.root, root, 1e-5);
+    checkStatus("brent (float)", brent(2, 3, &expr, 1e-5f, 0, &single), 0);
+    checkValue("brent (float)", single.root, root, 1e-5);
+    checkStatus("newton_raphson (float)", newton_raphson(2, 0, &expr, 1e-5f, 0, &single), 0);
+    checkValue("newton_raphson (float)", single.root, root, 1e-5);
+
+    /* The iteration cap is honoured, and the caller's history gets the first rows. */
+    result.history = history;
+    result.historyCapacity = 4;
+    checkStatus("bisection_d, 10 iterations", bisection_d(2, 3, &expr, 1e-13, 10, &result), -1);
+    checkStatus("bisection_d, 10 iterations", result.iterations, 10);
+    checkValue("bisection_d history c0", history[0].c, 2.5, 0);
+    checkValue("bisection_d history c3", history[3].c, 2.0625, 0);
+    result.history = NULL;
+
+    checkStatus("brent_d without a sign change", brent_d(3, 4, &expr, 1e-13, 0, &result), -1);
+    checkStatus("brent_d without a sign change", result.evaluations, 2);
+    freeExpr(&expr);
+
+    /* f'(0) = 0 stops Newton at the starting point instead of stepping to infinity. */
+    compileExpression("x^2+1", &expr);
+    checkStatus("newton_raphson_d, f'(x0) = 0", newton_raphson_d(0, 0, &expr, 1e-13, 0, &result), -1);
+    checkValue("newton_raphson_d, f'(x0) = 0", result.value, 1, 0);
+    checkStatus("newton_raphson_d, f'(x0) = 0", result.iterations, 0);
+    freeExpr(&expr);
+
+    /* Plain false position crawls in from one end here; the Illinois step does not. */
+    compileExpression("x^10-1", &expr);
+    checkStatus("regula_falsi_d x^10-1", regula_falsi_d(0, 1.3, &expr, 1e-12, 40, &result), 0);
+    checkValue("regula_falsi_d x^10-1", result.root, 1, 1e-12);
+    checkStatus("brent_d x^10-1", brent_d(0, 1.3, &expr, 1e-12, 0, &result), 0);
+    checkValue("brent_d x^10-1", result.root, 1, 1e-12);
+    checkStatus("brent_d x^10-1 evaluations", result.evaluations <= 20, 1);
+    freeExpr(&expr);
+}
 
-    return b;
+/* The integral of 4/(1+x^2) over [0, 1] is pi. */
+void checkQuadrature() {
+    Quadrature_d result;
+    Quadrature_ld wide;
+    Expr expr = {0};
+
+    compileExpression("4/(1+x^2)", &expr);
+    checkValue("simpsons_rule_d 1/3", simpsons_rule_d(0, 1, &expr, 1), M_PI, 1e-9);
+    checkValue("simpsons_rule_d 3/8", simpsons_rule_d(0, 1, &expr, 2), M_PI, 1e-8);
+    checkValue("trapezoidal_d", trapezoidal_d(0, 1, &expr), M_PI, 1e-4);
+    checkValue("simpsons_rule_ld 1/3", simpsons_rule_ld(0, 1, &expr, 1), M_PI, 1e-9);
+    checkStatus("gauss_kronrod_d", gauss_kronrod_d(0, 1, &expr, 1e-13, 1e-13, 1000, &result), 0);
+    checkValue("gauss_kronrod_d", result.value, M_PI, 1e-13);
+    checkStatus("romberg_d", romberg_d(0, 1, &expr, 1e-11, 1e-11, 25, &result), 0);
+    checkValue("romberg_d", result.value, M_PI, 1e-10);
+    freeExpr(&expr);
+
+    /* Each level only adds midpoints, so 2^k + 1 abscissae are evaluated in all. */
+    compileExpression("exp(x)", &expr);
+    checkStatus("romberg_d exp", romberg_d(0, 1, &expr, 1e-13, 1e-13, 25, &result), 0);
+    checkValue("romberg_d exp", result.value, exp(1.0) - 1, 1e-14);
+    checkStatus("romberg_d exp, no abscissa twice", ((result.evaluations - 1) & (result.evaluations - 2)) == 0, 1);
+    freeExpr(&expr);
+
+    /* An endpoint singularity in the derivative and a sharp peak both need refinement. */
+    compileExpression("sqrt(x)", &expr);
+    checkStatus("gauss_kronrod_d sqrt", gauss_kronrod_d(0, 1, &expr, 1e-12, 1e-12, 1000, &result), 0);
+    checkValue("gauss_kronrod_d sqrt", result.value, 2.0 / 3, 1e-12);
+    checkStatus("gauss_kronrod_d sqrt refined", result.intervals > 1, 1);
+    freeExpr(&expr);
+
+    compileExpression("1/(0.0001+x^2)", &expr);
+    checkStatus("gauss_kronrod_d peak", gauss_kronrod_d(-1, 1, &expr, 1e-10, 1e-10, 1000, &result), 0);
+    checkValue("gauss_kronrod_d peak", result.value, 200 * atan(100.0), 1e-10);
+    checkStatus("gauss_kronrod_d peak, 1 interval", gauss_kronrod_d(-1, 1, &expr, 1e-10, 1e-10, 1, &result), -1);
+    freeExpr(&expr);
+
+    compileExpression("exp(x)", &expr);
+    gauss_kronrod_ld(0, 1, &expr, 1e-17L, 1e-17L, 1000, &wide);
+    checkValue("gauss_kronrod_ld exp", (double) (wide.value - (E_L - 1)), 0, 1e-17);
+    freeExpr(&expr);
 }
 
-void inverse_matrix() {
-    int n;
-    printf("Enter size of matrix: ");
-    scanf("%d", &n);
+/* Fills the n x cols row-major matrix with a fixed pseudo-random sequence in [-1, 1]. */
+void checkRandomMatrix(int n, int cols, double* matrix, unsigned seed) {
+    for (int i = 0; i < n * cols; i++) {
+        seed = seed * 1103515245u + 12345u;
+        matrix[i] = (seed >> 8) / 8388608.0 - 1;
+    }
+}
 
-    float matrix[n][n];
+/* Normwise backward error |A x - b| / (|A| |x| + |b|) of the n x (n+1) augmented system, in the max norm. */
+double checkResidual(int n, const double* system, const double* x) {
+    double residual = 0;
+    double normA = 0;
+    double normX = 0;
+    double normB = 0;
 
-    printf("Enter elements of matrix:\n");
     for (int i = 0; i < n; i++) {
+        const double* row = system + (size_t) i*(n+1);
+        double sum = -row[n];
+        double rowSum = 0;
         for (int j = 0; j < n; j++) {
-            printf("(%d, %d): ", i+1, j+1);
-            scanf("%f", &matrix[i][j]);
+            sum += row[j] * x[j];
+            rowSum += fabs(row[j]);
         }
+        residual = fmax(residual, fabs(sum));
+        normA = fmax(normA, rowSum);
+        normX = fmax(normX, fabs(x[i]));
+        normB = fmax(normB, fabs(row[n]));
     }
+    return residual / (normA * normX + normB);
+}
 
-    float identity[n][n];
-    for (int i = 0; i < n; i++) {
-        for (int j = 0; j < n; j++) {
-            identity[i][j] = (i == j) ? 1.0 : 0.0;
-        }
+void checkDense() {
+    double system[] = {2, 1, -1, 8,
+                       -3, -1, 2, -11,
+                       -2, 1, 2, -3};
+    double pivoted[] = {0, 1, 1, 5,
+                        1, 0, 1, 4,
+                        1, 1, 0, 3};
+    double singular[] = {1, 2, 3,
+                         2, 4, 6};
+    double matrix[] = {4, 7, 2, 6};
+    double inverse[4];
+    double expected[] = {0.6, -0.7, -0.2, 0.4};
+    double solution[3];
+
+    checkStatus("gauss_solve_d", gauss_solve_d(3, system, solution), 0);
+    checkValue("gauss_solve_d x", solution[0], 2, 1e-14);
+    checkValue("gauss_solve_d y", solution[1], 3, 1e-14);
+    checkValue("gauss_solve_d z", solution[2], -1, 1e-14);
+
+    /* A zero leading element needs a row swap. */
+    checkStatus("gauss_solve_d pivoted", gauss_solve_d(3, pivoted, solution), 0);
+    checkValue("gauss_solve_d pivoted x", solution[0], 1, 1e-14);
+    checkValue("gauss_solve_d pivoted y", solution[1], 2, 1e-14);
+    checkValue("gauss_solve_d pivoted z", solution[2], 3, 1e-14);
+    checkStatus("gauss_solve_d singular", gauss_solve_d(2, singular, solution), -1);
+
+    checkStatus("invert_matrix_d", invert_matrix_d(2, matrix, inverse), 0);
+    for (int i = 0; i < 4; i++) {
+        checkValue("invert_matrix_d", inverse[i], expected[i], 1e-14);
     }
 
-    for (int i = 0; i < n; i++) {
-        float pivot = matrix[i][i];
-        for (int j = 0; j < n; j++) {
-            matrix[i][j] /= pivot;
-            identity[i][j] /= pivot;
-        }
-        for (int k = 0; k < n; k++) {
-            if (k != i) {
-                float factor = matrix[k][i];
+    double flat[] = {1, 2, 2, 4};
+    checkStatus("invert_matrix_d singular", invert_matrix_d(2, flat, inverse), -1);
+}
+
+/* Sizes past one LU_BLOCK panel and past one LU_TILE column tile; the inversion spans several pool chunks. */
+void checkLargeDense() {
+    int sizes[] = {65, 300};
+    int nrhs = 3;
+    char label[64];
+
+    for (int s = 0; s < 2; s++) {
+        int n = sizes[s];
+        double* system = (double*) malloc((size_t) n * (n+1) * sizeof(double));
+        double* copy = (double*) malloc((size_t) n * (n+1) * sizeof(double));
+        double* x = (double*) malloc(n * sizeof(double));
+        double* known = (double*) malloc((size_t) n * nrhs * sizeof(double));
+        double* rhs = (double*) malloc((size_t) n * nrhs * sizeof(double));
+        double error = 0;
+        LUFactor_d lu;
+
+        checkRandomMatrix(n, n+1, system, n);
+        memcpy(copy, system, (size_t) n * (n+1) * sizeof(double));
+        snprintf(label, sizeof(label), "gauss_solve_d n=%d", n);
+        checkStatus(label, gauss_solve_d(n, copy, x), 0);
+        snprintf(label, sizeof(label), "gauss_solve_d n=%d residual", n);
+        checkValue(label, checkResidual(n, system, x), 0, 1e-15);
+
+        /* Several right-hand sides through one factorization, against known solutions. */
+        checkRandomMatrix(n, nrhs, known, 7*n);
+        for (int i = 0; i < n; i++) {
+            for (int c = 0; c < nrhs; c++) {
+                double sum = 0;
                 for (int j = 0; j < n; j++) {
-                    matrix[k][j] -= factor * matrix[i][j];
-                    identity[k][j] -= factor * identity[i][j];
+                    sum += system[(size_t) i*(n+1) + j] * known[(size_t) j*nrhs + c];
+                }
+                rhs[(size_t) i*nrhs + c] = sum;
+            }
+        }
+        snprintf(label, sizeof(label), "lu_factor_d n=%d", n);
+        checkStatus(label, lu_factor_d(&lu, n, system, n+1), 0);
+        lu_solve_d(&lu, rhs, nrhs);
+        for (int i = 0; i < n * nrhs; i++) {
+            error = fmax(error, fabs(rhs[i] - known[i]));
+        }
+        snprintf(label, sizeof(label), "lu_solve_d n=%d, %d right-hand sides", n, nrhs);
+        checkValue(label, error, 0, 1e-10);
+        lu_free_d(&lu);
+
+        /* A A^-1 = I, with the row updates split over four threads. */
+        double* matrix = (double*) malloc((size_t) n * n * sizeof(double));
+        double* inverse = (double*) malloc((size_t) n * n * sizeof(double));
+        error = 0;
+        checkRandomMatrix(n, n, matrix, 3*n);
+        memcpy(copy, matrix, (size_t) n * n * sizeof(double));
+        setThreadCount(4);
+        snprintf(label, sizeof(label), "invert_matrix_d n=%d", n);
+        checkStatus(label, invert_matrix_d(n, copy, inverse), 0);
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < n; j++) {
+                double sum = -(i == j);
+                for (int k = 0; k < n; k++) {
+                    sum += matrix[(size_t) i*n + k] * inverse[(size_t) k*n + j];
                 }
+                error = fmax(error, fabs(sum));
             }
         }
+        snprintf(label, sizeof(label), "invert_matrix_d n=%d, A A^-1 - I", n);
+        checkValue(label, error, 0, 1e-10);
+        free(matrix);
+        free(inverse);
+
+        free(system);
+        free(copy);
+        free(x);
+        free(known);
+        free(rhs);
+    }
+}
+
+void checkMarkRange(void* ctx, int lo, int hi) {
+    int* marks = (int*) ctx;
+
+    for (int i = lo; i < hi; i++) {
+        marks[i]++;
     }
+}
 
-    printf("Inverse of the matrix:\n");
-    for (int i = 0; i < n; i++) {
-        for (int j = 0; j < n; j++) {
-            printf("%f\t", identity[i][j]);
+/*
+ * Every index of an uneven range is visited exactly once, whatever the
+ * thread count. The pool is left at four threads for the checks after this.
+ */
+void checkParallelFor() {
+    int threads[] = {1, 3, 8};
+    int n = 10007;
+    int* marks = (int*) malloc(n * sizeof(int));
+    char label[64];
+
+    for (int t = 0; t < 3; t++) {
+        int wrong = 0;
+
+        memset(marks, 0, n * sizeof(int));
+        setThreadCount(threads[t]);
+        parallelFor(0, n, 13, checkMarkRange, marks);
+        for (int i = 0; i < n; i++) {
+            wrong += marks[i] != 1;
         }
-        printf("\n");
+        snprintf(label, sizeof(label), "parallelFor, %d threads", threads[t]);
+        checkStatus(label, wrong, 0);
     }
+    setThreadCount(4);
+    free(marks);
 }
 
-void gauus_elimination() {
-    int numEq;
+/* Marks one 64-wide row per index through an inner parallelFor; the setThreadCount is ignored. */
+void checkNestedRange(void* ctx, int lo, int hi) {
+    int* marks = (int*) ctx;
+
+    setThreadCount(2);
+    for (int i = lo; i < hi; i++) {
+        parallelFor(0, 64, 4, checkMarkRange, marks + 64*i);
+    }
+}
 
-    printf("Enter num of equations: ");
-    scanf("%d", &numEq);
+void* checkPoolCaller(void* arg) {
+    for (int round = 0; round < 50; round++) {
+        parallelFor(0, 10007, 13, checkMarkRange, arg);
+    }
+    return NULL;
+}
 
-    float matrix[numEq][numEq+1];
-    float solution[numEq];
+/* A parallelFor inside a body, and four threads calling parallelFor at once, neither deadlock nor lose work. */
+void checkPoolSharing() {
+    int n = 10007;
+    int* marks = (int*) calloc(4 * n, sizeof(int));
+    pthread_t callers[4];
+    int wrong = 0;
 
-    printf("Enter coefficients of matrix:\n");
-    for (int i = 0; i < numEq; i++) {
-        for (int j = 0; j <= numEq; j++) {
-            printf("(%d, %d): ", i+1, j+1);
-            scanf("%f", &matrix[i][j]);
-        }
+    parallelFor(0, 64, 1, checkNestedRange, marks);
+    for (int i = 0; i < 64 * 64; i++) {
+        wrong += marks[i] != 1;
     }
+    checkStatus("nested parallelFor", wrong, 0);
 
-    float factor;
+    memset(marks, 0, 4 * n * sizeof(int));
+    for (int t = 0; t < 4; t++) {
+        pthread_create(&callers[t], NULL, checkPoolCaller, marks + t*n);
+    }
+    for (int t = 0; t < 4; t++) {
+        pthread_join(callers[t], NULL);
+    }
+    wrong = 0;
+    for (int i = 0; i < 4 * n; i++) {
+        wrong += marks[i] != 50;
+    }
+    checkStatus("parallelFor from four threads", wrong, 0);
+    free(marks);
+}
 
-    for (int i = 0; i < numEq - 1; i++) {
-        for (int j = i+1; j < numEq; j++) {
-            if (matrix[i][i] == 0) {
-                exit(1);
-            }
+/* Tridiagonal 4, -1 system with solution all ones, built from dense storage and from shuffled triplets. */
+void checkSparse() {
+    const int n = 50;
+    double* dense = (double*) calloc(n * n, sizeof(double));
+    int rowIndex[3 * n];
+    int colIndex[3 * n];
+    double values[3 * n];
+    double b[n];
+    double x[n];
+    int nnz = 0;
+    CSRMatrix_d A;
+    CSRMatrix_d shuffled;
 
-            factor = matrix[j][i] / matrix[i][i];
-            for (int k = 0; k <= numEq; k++) {
-                matrix[j][k] -= factor * matrix[i][k];
-            }
+    for (int i = 0; i < n; i++) {
+        dense[i*n + i] = 4;
+        b[i] = 4;
+        if (i > 0) {
+            dense[i*n + i - 1] = -1;
+            b[i] -= 1;
+        }
+        if (i < n - 1) {
+            dense[i*n + i + 1] = -1;
+            b[i] -= 1;
         }
     }
-
-    for (int i = numEq-1; i >= 0; i--) {
-        solution[i] = matrix[i][numEq];
-        for (int j = i+1; j < numEq; j++) {
-            solution[i] -= matrix[i][j] * solution[j];
+    for (int i = n - 1; i >= 0; i--) {
+        for (int j = n - 1; j >= 0; j--) {
+            if (dense[i*n + j] != 0) {
+                rowIndex[nnz] = i;
+                colIndex[nnz] = j;
+                values[nnz++] = dense[i*n + j];
+            }
         }
-        solution[i] /= matrix[i][i];
     }
-
-    printf("The solution is:\n");
-    for (int i = 0; i < numEq; i++) {
-        printf("matrix[%d] = %f\n", i+1, solution[i]);
+    csr_from_dense_d(&A, n, n, dense, n);
+    csr_from_triplets_d(&shuffled, n, nnz, rowIndex, colIndex, values);
+    checkStatus("csr_from_dense_d nnz", A.nnz, 3*n - 2);
+
+    for (int method = 0; method < 3; method++) {
+        const char* labels[] = {"sparse_gauss_seidel_d", "sor_solve_d", "sor_solve_d from triplets"};
+        double error = 0;
+        int sweeps;
+
+        memset(x, 0, sizeof(x));
+        if (method == 0) {
+            sweeps = sparse_gauss_seidel_d(&A, b, x, 1e-14, 1000);
+        } else {
+            sweeps = sor_solve_d((method == 1) ? &A : &shuffled, b, x, 1.1, 1e-14, 1000);
+        }
+        checkStatus(labels[method], sweeps > 0, 1);
+        for (int i = 0; i < n; i++) {
+            error = fmax(error, fabs(x[i] - 1));
+        }
+        checkValue(labels[method], error, 0, 1e-12);
     }
-}
 
-void gauss_seidal() {
-    int numEq;
+    /* Without a diagonal entry the sweep cannot run. */
+    dense[0] = 0;
+    csr_free_d(&A);
+    csr_from_dense_d(&A, n, n, dense, n);
+    checkStatus("sor_solve_d missing diagonal", sor_solve_d(&A, b, x, 1, 1e-14, 1000), -1);
 
-    printf("Enter num of equations: ");
-    scanf("%d", &numEq);
+    csr_free_d(&A);
+    csr_free_d(&shuffled);
+    free(dense);
+}
 
-    float matrix[numEq][numEq+1];
-    float solution[numEq];
-    float guess[numEq];
+/* Poisson on a 30 x 30 grid (more rows than one RELAX_CHUNK), with solution all ones. */
+void checkRelax() {
+    const int grid = 30;
+    const int n = grid * grid;
+    int* rowIndex = (int*) malloc(5 * n * sizeof(int));
+    int* colIndex = (int*) malloc(5 * n * sizeof(int));
+    double* values = (double*) malloc(5 * n * sizeof(double));
+    double* b = (double*) malloc(n * sizeof(double));
+    double* x = (double*) malloc(n * sizeof(double));
+    int* colors = (int*) malloc(n * sizeof(int));
+    int nnz = 0;
+    CSRMatrix_d A;
 
-    printf("Enter coefficients of matrix:\n");
-    for (int i = 0; i < numEq; i++) {
-        for (int j = 0; j <= numEq; j++) {
-            printf("(%d, %d): ", i+1, j+1);
-            scanf("%f", &matrix[i][j]);
+    for (int i = 0; i < n; i++) {
+        int r = i / grid;
+        int c = i % grid;
+        int neighbours[] = {(r > 0) ? i - grid : -1, (c > 0) ? i - 1 : -1, (c < grid - 1) ? i + 1 : -1, (r < grid - 1) ? i + grid : -1};
+
+        rowIndex[nnz] = i;
+        colIndex[nnz] = i;
+        values[nnz++] = 4;
+        b[i] = 4;
+        for (int k = 0; k < 4; k++) {
+            if (neighbours[k] >= 0) {
+                rowIndex[nnz] = i;
+                colIndex[nnz] = neighbours[k];
+                values[nnz++] = -1;
+                b[i] -= 1;
+            }
         }
     }
+    csr_from_triplets_d(&A, n, nnz, rowIndex, colIndex, values);
 
-    for (int i = 0; i < numEq; i++) {
-        guess[i] = 0;
+    /* Natural order on a 5-point grid colours red-black. */
+    int conflicts = 0;
+    checkStatus("csr_color_d colours", csr_color_d(&A, colors), 2);
+    for (int i = 0; i < n; i++) {
+        for (int k = A.rowStart[i]; k < A.rowStart[i+1]; k++) {
+            conflicts += A.cols[k] != i && colors[A.cols[k]] == colors[i];
+        }
     }
+    checkStatus("csr_color_d conflicts", conflicts, 0);
 
-    float sum;
+    for (int mode = RELAX_JACOBI; mode <= RELAX_MULTICOLOR; mode++) {
+        const char* labels[] = {"parallel_relax_d jacobi", "parallel_relax_d multicolour"};
+        double omega = (mode == RELAX_MULTICOLOR) ? 1.8 : 1;
+        double error = 0;
 
-    for (int i = 0; i < 100; i++) {
-        float err = 0;
-        for (int j = 0; j < numEq; j++) {
-            sum = 0;
-            for (int k = 0; k < numEq; k++) {
-                if (j != k) {
-                    sum += matrix[j][k] * guess[k];
-                }
-            }
-            float newguess = (matrix[j][numEq] - sum) / matrix[j][j]; 
-            err += fabs(newguess - guess[j]);
-            guess[j] = newguess;
+        memset(x, 0, n * sizeof(double));
+        checkStatus(labels[mode], parallel_relax_d(&A, b, x, mode, omega, 1e-13, 20000) > 0, 1);
+        for (int i = 0; i < n; i++) {
+            error = fmax(error, fabs(x[i] - 1));
         }
+        checkValue(labels[mode], error, 0, 1e-10);
     }
 
-    printf("The solution is:\n");
-    for(int i = 0; i < numEq; i++) {
-        printf("matrix[%d] = %f\n", i, guess[i]);
-    }
+    csr_free_d(&A);
+    free(rowIndex);
+    free(colIndex);
+    free(values);
+    free(b);
+    free(x);
+    free(colors);
 }
 
-float numerical_derivative(Var* postfix) {
-    int method = 0;
-    float x = 0;
-    printf("Choose a method: \n1. Forward\n2. Backward\n3. Central\nMethod(1-3): ");
-    scanf("%d", &method);
+/* Many slices of 4/(1+x^2) on the pool: each is a difference of arctangents, and together they make pi. */
+void checkIntegrateBatch() {
+    int count = 200;
+    double* bounds = (double*) malloc(2 * count * sizeof(double));
+    double* values = (double*) malloc(count * sizeof(double));
+    double* errors = (double*) malloc(count * sizeof(double));
+    double error = 0;
+    double total = 0;
+    int evaluations = 0;
+    Expr expr = {0};
 
-    if (method > 3 || method < 1) {
-        printf("Out of bounds.");
-        exit(1);
+    for (int i = 0; i < count; i++) {
+        bounds[2*i] = (double) i / count;
+        bounds[2*i + 1] = (double) (i + 1) / count;
     }
+    compileExpression("4/(1+x^2)", &expr);
+    checkStatus("integrate_batch_d", integrate_batch_d(&expr, count, bounds, 1e-13, 1e-13, 1000, values, errors, &evaluations), 0);
+    for (int i = 0; i < count; i++) {
+        error = fmax(error, fabs(values[i] - 4 * (atan(bounds[2*i + 1]) - atan(bounds[2*i]))));
+        total += values[i];
+    }
+    checkValue("integrate_batch_d slices", error, 0, 1e-15);
+    checkValue("integrate_batch_d sum of slices", total, M_PI, 1e-13);
+    checkStatus("integrate_batch_d evaluations", evaluations >= 15 * count, 1);
+    freeExpr(&expr);
+
+    free(bounds);
+    free(values);
+    free(errors);
+}
+
+/* Shared inputs and serial results for checkConcurrentCallers; every caller thread reads them and compares. */
+typedef struct {
+    Expr integrand;
+    Expr sine;
+    Expr surface;
+    Expr* chain;
+    int unknowns;
+    double bounds[400];
+    double slices[200];
+    double roots[MAX_ROOTS];
+    int rootCount;
+    double xs[40];
+    double ys[1500];
+    double* grid;
+    CSRMatrix_d A;
+    double b[2000];
+    double relaxed[2][2000];
+    double system[64];
+    double matrix[120 * 120];
+    double inverse[120 * 120];
+    double points[5003];
+    Spline_d spline;
+    double splined[5003];
+    double ridders[5003];
+    atomic_int mismatches;
+} CheckCallers;
+
+/* Runs each pool routine three times on the shared inputs and counts results that differ from the serial ones. */
+void* checkConcurrentCaller(void* arg) {
+    CheckCallers* c = (CheckCallers*) arg;
+    double* grid = (double*) malloc(40 * 1500 * sizeof(double));
+    double* matrix = (double*) malloc(120 * 120 * sizeof(double));
+    double* inverse = (double*) malloc(120 * 120 * sizeof(double));
+    double* out = (double*) malloc(5003 * sizeof(double));
+    double* errors = (double*) malloc(5003 * sizeof(double));
+    double relaxed[2000];
+    double roots[MAX_ROOTS];
+    double x[64];
+    int slots[2] = {0, 1};
+    const double* axes[2] = {c->xs, c->ys};
+    int sizes[2] = {40, 1500};
+    SystemResult_d result;
+    int wrong = 0;
+
+    for (int round = 0; round < 3; round++) {
+        integrate_batch_d(&c->integrand, 200, c->bounds, 1e-13, 1e-13, 1000, out, errors, NULL);
+        wrong += memcmp(out, c->slices, 200 * sizeof(double)) != 0;
+
+        int count = find_all_roots_d(-200, 740, &c->sine, 5000, 1e-12, roots, MAX_ROOTS, NULL);
+        wrong += count != c->rootCount || memcmp(roots, c->roots, count * sizeof(double)) != 0;
+
+        evalGrid_d(&c->surface, NULL, 2, slots, axes, sizes, grid);
+        wrong += memcmp(grid, c->grid, 40 * 1500 * sizeof(double)) != 0;
+
+        for (int mode = RELAX_JACOBI; mode <= RELAX_MULTICOLOR; mode++) {
+            memset(relaxed, 0, sizeof(relaxed));
+            parallel_relax_d(&c->A, c->b, relaxed, mode, 1, 1e-13, 20000);
+            wrong += memcmp(relaxed, c->relaxed[mode], sizeof(relaxed)) != 0;
+        }
 
-    printf("Enter point x: ");
-    scanf("%f", &x);
+        for (int k = 0; k < c->unknowns; k++) {
+            x[k] = -1;
+        }
+        newton_system_d(c->unknowns, c->chain, x, JACOBIAN_DUAL, UPDATE_NEWTON, 1e-12, 0, &result);
+        wrong += memcmp(x, c->system, c->unknowns * sizeof(double)) != 0;
 
-    float derivative = 0; 
-    switch (method) {
-        case 1:
-            derivative = ((evalPostfix(postfix, x+h) - evalPostfix(postfix, x))/h);
-            break;
-        case 2:
-            derivative = ((evalPostfix(postfix, x) - evalPostfix(postfix, x-h))/h);
-            break;
-        case 3:
-            derivative = ((evalPostfix(postfix, x+h) - evalPostfix(postfix, x-h))/(2*h));
-            break;
-    }
+        memcpy(matrix, c->matrix, 120 * 120 * sizeof(double));
+        invert_matrix_d(120, matrix, inverse);
+        wrong += memcmp(inverse, c->inverse, 120 * 120 * sizeof(double)) != 0;
+
+        spline_eval_batch_d(&c->spline, c->points, out, 5003);
+        wrong += memcmp(out, c->splined, 5003 * sizeof(double)) != 0;
 
-    return derivative;
+        ridders_batch_d(&c->integrand, c->points, 5003, 1, out, errors);
+        wrong += memcmp(out, c->ridders, 5003 * sizeof(double)) != 0;
+    }
+    atomic_fetch_add(&c->mismatches, wrong);
+
+    free(grid);
+    free(matrix);
+    free(inverse);
+    free(out);
+    free(errors);
+    return NULL;
 }
 
-float simpsons(float a, float b, Var* postfix) {
-    int method= 0;
-    printf("Select a method\n1. (1/3)\n2. (3/8)\n");
-    scanf("%d", &method);
+/*
+ * The routines that split their work over the thread pool, called from
+ * four threads at once, give the results of a serial call.
+ */
+void checkConcurrentCallers() {
+    const char* names[] = {"x", "y"};
+    const int n = 2000;
+    int* rowIndex = (int*) malloc(3 * n * sizeof(int));
+    int* colIndex = (int*) malloc(3 * n * sizeof(int));
+    double* values = (double*) malloc(3 * n * sizeof(double));
+    CheckCallers* shared = (CheckCallers*) calloc(1, sizeof(CheckCallers));
+    pthread_t threads[4];
+    char sources[64][64];
+    char unknowns[64][4];
+    const char* unknownNames[64];
+    double knots[101];
+    double heights[101];
+    SystemResult_d result;
+    int nnz = 0;
+
+    compileExpression("4/(1+x^2)", &shared->integrand);
+    compileExpression("sin(x)", &shared->sine);
+    compileMultivariate("x*y+x^2", names, 2, &shared->surface);
+    for (int i = 0; i < 200; i++) {
+        shared->bounds[2*i] = i / 200.0;
+        shared->bounds[2*i + 1] = (i + 1) / 200.0;
+    }
+    integrate_batch_d(&shared->integrand, 200, shared->bounds, 1e-13, 1e-13, 1000, shared->slices, NULL, NULL);
+    shared->rootCount = find_all_roots_d(-200, 740, &shared->sine, 5000, 1e-12, shared->roots, MAX_ROOTS, NULL);
 
-    if (method == 1) {
-        float step = (b-a)/100;
-        float sum = evalPostfix(postfix, a) + evalPostfix(postfix, b);
+    for (int i = 0; i < 40; i++) {
+        shared->xs[i] = i / 10.0;
+    }
+    for (int j = 0; j < 1500; j++) {
+        shared->ys[j] = j / 500.0 - 1;
+    }
+    int slots[2] = {0, 1};
+    const double* axes[2] = {shared->xs, shared->ys};
+    int sizes[2] = {40, 1500};
+    shared->grid = (double*) malloc(40 * 1500 * sizeof(double));
+    evalGrid_d(&shared->surface, NULL, 2, slots, axes, sizes, shared->grid);
 
-        for (int i = 1; i < 100; i++) {
-            float x = a + i * step;
-            if (i % 2 == 0) {
-                sum += 2 * evalPostfix(postfix, x);
-            } else {
-                sum += 4 * evalPostfix(postfix, x);
+    /* Tridiagonal 4, -1 of order 2000: four RELAX_CHUNK chunks, two colours. */
+    for (int i = 0; i < n; i++) {
+        for (int j = i - 1; j <= i + 1; j++) {
+            if (j >= 0 && j < n) {
+                rowIndex[nnz] = i;
+                colIndex[nnz] = j;
+                values[nnz++] = (i == j) ? 4 : -1;
             }
         }
+        shared->b[i] = 4 - (i > 0) - (i < n - 1);
+    }
+    csr_from_triplets_d(&shared->A, n, nnz, rowIndex, colIndex, values);
+    for (int mode = RELAX_JACOBI; mode <= RELAX_MULTICOLOR; mode++) {
+        parallel_relax_d(&shared->A, shared->b, shared->relaxed[mode], mode, 1, 1e-13, 20000);
+    }
 
-        return (step / 3) * sum;
-    } else if (method == 2) {
-        float step = (b-a)/99;
-        float sum = evalPostfix(postfix, a) + evalPostfix(postfix, b);
-
-        for (int i = 1; i < 99; i++) {
-            float x = a + i * step;
-            if (i % 3 == 0) {
-                sum += 2 * evalPostfix(postfix, x);
-            } else {
-                sum += 3 * evalPostfix(postfix, x);
-            }
+    /* Broyden's tridiagonal system with 64 unknowns, so the Jacobian rows go over the pool. */
+    shared->unknowns = 64;
+    shared->chain = (Expr*) malloc(64 * sizeof(Expr));
+    for (int k = 0; k < 64; k++) {
+        snprintf(unknowns[k], sizeof(unknowns[k]), "u%c%c", 'a' + k / 26, 'a' + k % 26);
+        unknownNames[k] = unknowns[k];
+    }
+    for (int k = 0; k < 64; k++) {
+        int length = snprintf(sources[k], sizeof(sources[k]), "(3-2*%s)*%s+1", unknowns[k], unknowns[k]);
+        if (k > 0) {
+            length += snprintf(sources[k] + length, sizeof(sources[k]) - length, "-%s", unknowns[k - 1]);
         }
+        if (k < 63) {
+            snprintf(sources[k] + length, sizeof(sources[k]) - length, "-2*%s", unknowns[k + 1]);
+        }
+        compileMultivariate(sources[k], unknownNames, 64, &shared->chain[k]);
+        shared->system[k] = -1;
+    }
+    checkStatus("newton_system_d 64 unknowns", newton_system_d(64, shared->chain, shared->system, JACOBIAN_DUAL, UPDATE_NEWTON, 1e-12, 0, &result), 0);
+
+    checkRandomMatrix(120, 120, shared->matrix, 7);
+    double* copy = (double*) malloc(120 * 120 * sizeof(double));
+    memcpy(copy, shared->matrix, 120 * 120 * sizeof(double));
+    invert_matrix_d(120, copy, shared->inverse);
+    free(copy);
+
+    for (int k = 0; k < 101; k++) {
+        knots[k] = k / 20.0;
+        heights[k] = sin(knots[k]);
+    }
+    spline_fit_d(&shared->spline, 101, knots, heights);
+    for (int i = 0; i < 5003; i++) {
+        shared->points[i] = 5.0 * i / 5002;
+    }
+    spline_eval_batch_d(&shared->spline, shared->points, shared->splined, 5003);
+    double* errors = (double*) malloc(5003 * sizeof(double));
+    ridders_batch_d(&shared->integrand, shared->points, 5003, 1, shared->ridders, errors);
+    free(errors);
 
-        return (3 * step / 8) * sum;
+    for (int t = 0; t < 4; t++) {
+        pthread_create(&threads[t], NULL, checkConcurrentCaller, shared);
     }
+    for (int t = 0; t < 4; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    checkStatus("pool routines from four threads", atomic_load(&shared->mismatches), 0);
 
-    return 0;
+    freeExpr(&shared->integrand);
+    freeExpr(&shared->sine);
+    freeExpr(&shared->surface);
+    for (int k = 0; k < 64; k++) {
+        freeExpr(&shared->chain[k]);
+    }
+    free(shared->chain);
+    free(shared->grid);
+    csr_free_d(&shared->A);
+    spline_free_d(&shared->spline);
+    free(shared);
+    free(rowIndex);
+    free(colIndex);
+    free(values);
 }
 
-float trapezoidal(float a, float b, Var* postfix) {
-    float step = (b-a)/100;
-    float sum = 0.5*(evalPostfix(postfix, a) + evalPostfix(postfix, b));
+/* f = exp(x) ln(x) at 2: f' = e^2 (ln 2 + 1/2). */
+void checkDerivatives() {
+    double first = exp(2.0) * (log(2.0) + 0.5);
+    double slope = 0;
+    float single = 0;
+    Expr expr;
+
+    compileExpression("exp(x)*ln(x)", &expr);
+    checkValue("central difference", finite_difference_d(&expr, 2, 3), first, 1e-8);
+    checkValue("forward difference", finite_difference_d(&expr, 2, 1), first, 1e-6);
+    checkValue("backward difference", finite_difference_d(&expr, 2, 2), first, 1e-6);
+    checkValue("evalDual_d value", evalDual_d(&expr, 2, &slope), exp(2.0) * log(2.0), 1e-15);
+    checkValue("evalDual_d", slope, first, 1e-14);
+    evalDual(&expr, 2, &single);
+    checkValue("evalDual (float)", single, first, 1e-6);
+    freeExpr(&expr);
+
+    /* Trigonometric functions take degrees: d/dx sin(x) = pi/180 cos(x). */
+    compileExpression("sin(x)", &expr);
+    evalDual_d(&expr, 60, &slope);
+    checkValue("evalDual_d sin in degrees", slope, M_PI / 360, 1e-14);
+    freeExpr(&expr);
+
+    /* cubed has only a float version, so its slope is a difference sized for float. */
+    long double wideSlope = 0;
+    compileExpression("cubed(x)+x", &expr);
+    evalDual_d(&expr, 2, &slope);
+    checkValue("evalDual_d through cubed", slope, 13, 1e-4);
+    evalDual_ld(&expr, 2, &wideSlope);
+    checkValue("evalDual_ld through cubed", wideSlope, 13, 1e-4);
+    evalDual(&expr, 2, &single);
+    checkValue("evalDual through cubed", single, 13, 1e-4);
+    freeExpr(&expr);
+}
 
-    for (int i = 1; i < 100; i++) {
-        float x = a + i * step;
-        sum += evalPostfix(postfix, x);
+/* The cubic x^3 - 2x through four points is reproduced exactly, by one fit or a fit per query. */
+void checkInterpolation() {
+    double xs[] = {0, 1, 2, 3};
+    double ys[] = {0, -1, 4, 21};
+    double queries[] = {-0.5, 0.25, 1.5, 2.75};
+    double repeated[] = {0, 1, 1, 3};
+    NewtonPoly_d poly;
+
+    for (int i = 0; i < 4; i++) {
+        double q = queries[i];
+        checkValue("newton_interpolate_d", newton_interpolate_d(4, xs, ys, q), q*q*q - 2*q, 1e-14);
     }
 
-    return sum*step;
+    checkStatus("newton_fit_d", newton_fit_d(&poly, 4, xs, ys), 0);
+    for (int i = 0; i < 4; i++) {
+        double q = queries[i];
+        checkValue("newton_eval_d", newton_eval_d(&poly, q), q*q*q - 2*q, 1e-14);
+    }
+    newton_free_d(&poly);
+    checkStatus("newton_fit_d repeated abscissa", newton_fit_d(&poly, 4, repeated, ys), -1);
+    newton_free_d(&poly);
+    checkStatus("newton_fit_d no points", newton_fit_d(&poly, 0, xs, ys), -1);
+    newton_free_d(&poly);
 }
 
-float gregory_newton(Var* postfix) {
-    int count;
-    printf("Enter number of data points: ");
-    scanf("%d", &count);
+/* newton_eval_batch agrees with newton_eval point for point, including a ragged last block. */
+void checkInterpolationBatch() {
+    enum {NODES = 12, QUERIES = 5003};
+    double xs[NODES];
+    double ys[NODES];
+    double* values = (double*) malloc(QUERIES * sizeof(double));
+    double* out = (double*) malloc(QUERIES * sizeof(double));
+    float xf[NODES];
+    float yf[NODES];
+    float valuesf[QUERIES];
+    float outf[QUERIES];
+    double batchError = 0;
+    double fitError = 0;
+    double floatError = 0;
+    NewtonPoly_d poly;
+    NewtonPoly polyf;
+
+    for (int k = 0; k < NODES; k++) {
+        xs[k] = cos(M_PI * (k + 0.5) / NODES);
+        ys[k] = exp(xs[k]);
+        xf[k] = xs[k];
+        yf[k] = ys[k];
+    }
+    for (int i = 0; i < QUERIES; i++) {
+        values[i] = valuesf[i] = -1 + 2.0 * i / (QUERIES - 1);
+    }
 
-    float x[count], y[count];
-    printf("Enter x data points:\n");
-    for (int i = 0; i < count; i++) {
-        scanf("%f", &x[i]);
+    newton_fit_d(&poly, NODES, xs, ys);
+    newton_eval_batch_d(&poly, values, out, QUERIES);
+    for (int i = 0; i < QUERIES; i++) {
+        batchError = fmax(batchError, fabs(out[i] - newton_eval_d(&poly, values[i])));
+        fitError = fmax(fitError, fabs(out[i] - exp(values[i])));
     }
+    checkValue("newton_eval_batch_d vs newton_eval_d", batchError, 0, 1e-15);
+    checkValue("newton_eval_batch_d vs exp", fitError, 0, 1e-11);
 
-    printf("Enter y data points:\n");
-    for (int i = 0; i < count; i++) {
-        scanf("%f", &y[i]);
+    newton_fit(&polyf, NODES, xf, yf);
+    newton_eval_batch(&polyf, valuesf, outf, QUERIES);
+    for (int i = 0; i < QUERIES; i++) {
+        floatError = fmax(floatError, fabs(outf[i] - newton_eval(&polyf, valuesf[i])));
     }
+    checkValue("newton_eval_batch vs newton_eval", floatError, 0, 1e-6);
 
-    float val;
-    printf("Enter value to interpolate: ");
-    scanf("%f", &val);
+    newton_free_d(&poly);
+    newton_free(&polyf);
+    free(values);
+    free(out);
+}
 
-    float diff[count];
-    for (int i = 0; i < count; i++) {
-        diff[i] = y[i];
+/* Binary round trip through a temporary file, text parsing, and rejection of malformed input. */
+void checkMatrixIO() {
+    char path[] = "/tmp/namatrixXXXXXX";
+    double values[12];
+    float singles[12];
+    MatrixData matrix = {.rows = 3, .cols = 4, .elementSize = MATRIX_DOUBLE, .data = values};
+    MatrixData loaded;
+    int fd = mkstemp(path);
+
+    checkStatus("mkstemp", fd >= 0, 1);
+    if (fd < 0) {
+        return;
+    }
+    close(fd);
+    for (int i = 0; i < 12; i++) {
+        values[i] = (i - 5.5) / 3;
+        singles[i] = (float) values[i];
     }
 
-    float result = y[0];
-    float term = 1;
+    checkStatus("saveMatrix double", saveMatrix(path, &matrix), 0);
+    checkStatus("loadMatrix double", loadMatrix(path, &loaded), 0);
+    checkStatus("loadMatrix double shape", loaded.rows == 3 && loaded.cols == 4 && loaded.elementSize == MATRIX_DOUBLE, 1);
+    checkStatus("loadMatrix double data", memcmp(loaded.data, values, sizeof(values)), 0);
+    freeMatrix(&loaded);
+
+    matrix.elementSize = MATRIX_FLOAT;
+    matrix.data = singles;
+    checkStatus("saveMatrix float", saveMatrix(path, &matrix), 0);
+    checkStatus("loadMatrix float", loadMatrix(path, &loaded), 0);
+    checkStatus("loadMatrix float shape", loaded.rows == 3 && loaded.cols == 4 && loaded.elementSize == MATRIX_FLOAT, 1);
+    checkStatus("loadMatrix float data", memcmp(loaded.data, singles, sizeof(singles)), 0);
+    freeMatrix(&loaded);
+
+    /* A header that promises more elements than the file holds. */
+    FILE* file = fopen(path, "r+b");
+    fseek(file, -(long) sizeof(float), SEEK_END);
+    checkStatus("truncate binary payload", ftruncate(fileno(file), ftell(file)), 0);
+    fclose(file);
+    checkStatus("loadMatrix short payload", loadMatrix(path, &loaded), -1);
+
+    const char* text = "1, 2, 3  # first row\n\n4;5 6\r\n-7.5e1,8,9\n";
+    file = fopen(path, "w");
+    fputs(text, file);
+    fclose(file);
+    checkStatus("loadMatrix text", loadMatrix(path, &loaded), 0);
+    checkStatus("loadMatrix text shape", loaded.rows == 3 && loaded.cols == 3, 1);
+    checkValue("loadMatrix text entry", ((double*) loaded.data)[6], -75, 0);
+    freeMatrix(&loaded);
+
+    const char* ragged = "1,2,3\n4,5\n";
+    checkStatus("parseMatrixText ragged rows", parseMatrixText(ragged, strlen(ragged), &loaded), -1);
+    const char* garbage = "1,2\n3,x\n";
+    checkStatus("parseMatrixText bad field", parseMatrixText(garbage, strlen(garbage), &loaded), -1);
+    remove(path);
+}
 
-    for (int i = 1; i < count; i++) {
-        for (int j = 0; j < count - i; j++) {
-            diff[j] = (diff[j + 1] - diff[j]) / (x[j + i] - x[j]);
+/* parseNumber must give the same double as strtod, on both its fast and its slow path. */
+void checkParseNumber() {
+    const char* fixed[] = {"0", "-0", "1", "0.1", "-2.5e-3", "1e22", "1e23", "9007199254740992", "9007199254740993",
+                           "123456789012345678901234567890", "0.000000000000000000000000001", "2.2250738585072011e-308",
+                           "4.9e-324", "1.7976931348623157e308", "1e400", "-inf", "+12.", ".5", "3.14159265358979323846"};
+    unsigned long long seed = 12345;
+    char text[64];
+    int mismatches = 0;
+
+    for (int i = 0; i < (int) (sizeof(fixed) / sizeof(fixed[0])) + 3000; i++) {
+        const char* s = text;
+        double parsed = 0;
+        double expected;
+
+        if (i < (int) (sizeof(fixed) / sizeof(fixed[0]))) {
+            s = fixed[i];
+        } else {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            double x = ldexp((double) (seed >> 11), (int) (seed % 120) - 110);
+            const char* formats[] = {"%.17g", "%.6f", "%.3e"};
+            snprintf(text, sizeof(text), formats[i % 3], (seed & 1) ? -x : x);
+        }
+        expected = strtod(s, NULL);
+        if (parseNumber(s, s + strlen(s), &parsed) == NULL || memcmp(&parsed, &expected, sizeof(double)) != 0) {
+            printf("     parseNumber(\"%s\") = %.17g, strtod gives %.17g\n", s, parsed, expected);
+            mismatches++;
         }
-        term *= (val - x[i - 1]);
-        result += (diff[0] * term);
     }
+    checkStatus("parseNumber against strtod", mismatches, 0);
+}
 
-    return result;
+/* Simple roots, a double root, a pole and a periodic function, refined on the pool. */
+void checkAllRoots() {
+    double roots[MAX_ROOTS];
+    char label[64];
+    Expr expr;
+
+    compileExpression("x^3-x", &expr);
+    int count = find_all_roots_d(-2, 2, &expr, 1000, 1e-12, roots, MAX_ROOTS, NULL);
+    checkStatus("find_all_roots_d x^3-x count", count, 3);
+    for (int i = 0; i < count && i < 3; i++) {
+        checkValue("find_all_roots_d x^3-x", roots[i], i - 1, 1e-12);
+    }
+    freeExpr(&expr);
+
+    compileExpression("(x-1)^2", &expr);
+    count = find_all_roots_d(0, 3, &expr, 1000, 1e-12, roots, MAX_ROOTS, NULL);
+    checkStatus("find_all_roots_d (x-1)^2 count", count, 1);
+    checkValue("find_all_roots_d (x-1)^2", roots[0], 1, 1e-6);
+    freeExpr(&expr);
+
+    /* The sign change across the pole is not a root. */
+    compileExpression("1/(x-1)", &expr);
+    checkStatus("find_all_roots_d 1/(x-1) count", find_all_roots_d(0, 3, &expr, 1000, 1e-12, roots, MAX_ROOTS, NULL), 0);
+    freeExpr(&expr);
+
+    /* sin takes degrees: zeros every 180 on [-200, 740]. */
+    compileExpression("sin(x)", &expr);
+    count = find_all_roots_d(-200, 740, &expr, 5000, 1e-12, roots, MAX_ROOTS, NULL);
+    checkStatus("find_all_roots_d sin count", count, 6);
+    for (int i = 0; i < count && i < 6; i++) {
+        snprintf(label, sizeof(label), "find_all_roots_d sin root %d", i);
+        checkValue(label, roots[i], 180 * (i - 1), 1e-12);
+    }
+    freeExpr(&expr);
 }
 
-float derive(Var* postfix, float x) {
-    return (evalPostfix(postfix, x+h) - evalPostfix(postfix, x)) / h;
+/* The symbolic derivative against hand-derived f' for every rule, trigonometric functions in degrees. */
+void checkSymbolic() {
+    const char* sources[] = {"exp(x)*ln(x)", "x^x", "2^x/x", "x_2+ln(x)", "sin(x)*tan(x)", "sqrt(x^2+1)", "arctan(x)-cosh(x)/3"};
+    double x = 2;
+    double deg = M_PI / 180;
+    double expected[] = {
+        exp(2.0) * (log(2.0) + 0.5),
+        4 * (log(2.0) + 1),
+        (4 * log(2.0) * 2 - 4) / 4,
+        1 / (2 * log(2.0)) + 0.5,
+        deg * (cos(2 * deg) * tan(2 * deg) + sin(2 * deg) / (cos(2 * deg) * cos(2 * deg))),
+        2 / sqrt(5.0),
+        1.0 / 5 - sinh(2.0) / 3
+    };
+    Expr expr;
+
+    for (int i = 0; i < (int) (sizeof(sources) / sizeof(sources[0])); i++) {
+        compileExpression(sources[i], &expr);
+        checkStatus(sources[i], expr.derivative != NULL, 1);
+        if (expr.derivative != NULL) {
+            checkValue(sources[i], evalExpr_d(expr.derivative, x), expected[i], 1e-14);
+        }
+        freeExpr(&expr);
+    }
+
+    /* A registered function has no known derivative, so none is attached. */
+    registerFunction("cubed", cubed, 0, NULL, NULL);
+    compileExpression("cubed(x)+x", &expr);
+    checkStatus("no derivative for cubed(x)+x", expr.derivative == NULL, 1);
+    freeExpr(&expr);
 }
 
-Node* createNode(Var data) {
-    Node* newNode = (Node*)malloc(sizeof(Node));
-    newNode->Variable = data;
-    newNode->next = NULL;
-    return newNode;
+void checkTaylor() {
+    double coefficients[MAX_TAYLOR + 1];
+    double reference[MAX_TAYLOR + 1];
+    double factorial = 1;
+    char label[64];
+    Expr expr;
+    Expr quotient;
+
+    compileExpression("exp(x)", &expr);
+    checkStatus("evalTaylor_d exp(x)", evalTaylor_d(&expr, 0, 8, coefficients), 0);
+    for (int k = 0; k <= 8; k++) {
+        factorial *= (k > 0) ? k : 1;
+        snprintf(label, sizeof(label), "taylor exp(x) at 0, c%d", k);
+        checkValue(label, coefficients[k], 1 / factorial, 1e-15);
+    }
+    freeExpr(&expr);
+
+    /* x^-3 at 1 is sum (-1)^k (k+1)(k+2)/2 (x-1)^k; x^(0-3) and 1/x^3 take different paths. */
+    compileExpression("x^(0-3)", &expr);
+    compileExpression("1/x^3", &quotient);
+    evalTaylor_d(&expr, 1, 6, coefficients);
+    evalTaylor_d(&quotient, 1, 6, reference);
+    for (int k = 0; k <= 6; k++) {
+        double exact = ((k % 2) ? -1 : 1) * (k + 1) * (k + 2) / 2.0;
+        snprintf(label, sizeof(label), "taylor x^(0-3) at 1, c%d", k);
+        checkValue(label, coefficients[k], exact, 1e-14);
+        snprintf(label, sizeof(label), "taylor 1/x^3 at 1, c%d", k);
+        checkValue(label, reference[k], exact, 1e-14);
+    }
+    freeExpr(&expr);
+    freeExpr(&quotient);
+
+    /* (x+1)^-5 at 1: c_k = (-1)^k C(k+4, 4) / 2^(k+5). */
+    compileExpression("(x+1)^(0-5)", &expr);
+    evalTaylor_d(&expr, 1, 5, coefficients);
+    for (int k = 0; k <= 5; k++) {
+        double binomial = (k + 1) * (k + 2) * (k + 3) * (k + 4) / 24.0;
+        snprintf(label, sizeof(label), "taylor (x+1)^(0-5) at 1, c%d", k);
+        checkValue(label, coefficients[k], ((k % 2) ? -1 : 1) * binomial / ldexp(1, k + 5), 1e-14);
+    }
+    freeExpr(&expr);
+
+    /* sin in degrees at 0: c_k = (pi/180)^k / k! for odd k, alternating in sign. */
+    compileExpression("sin(x)", &expr);
+    evalTaylor_d(&expr, 0, 5, coefficients);
+    checkValue("taylor sin at 0, c1", coefficients[1], M_PI / 180, 1e-15);
+    checkValue("taylor sin at 0, c2", coefficients[2], 0, 1e-15);
+    checkValue("taylor sin at 0, c3", coefficients[3], -pow(M_PI / 180, 3) / 6, 1e-15);
+    freeExpr(&expr);
+
+    registerFunction("cubed", cubed, 0, NULL, NULL);
+    compileExpression("cubed(x)", &expr);
+    checkStatus("evalTaylor_d of a registered function", evalTaylor_d(&expr, 1, 3, coefficients), -1);
+    freeExpr(&expr);
 }
 
-void insertAtBeginning(Node** headref, Var data) {
-    Node* newNode = createNode(data);
-    newNode->next = *headref;
-    *headref = newNode;
+/* Compiles func without optimizeExpression, the JIT or a derivative. */
+int checkParseRaw(const char* func, Expr* expr) {
+    Arena arena = {NULL};
+    Var* infix = NULL;
+    Var* postfix = NULL;
+    int status;
+
+    *expr = (Expr) {0};
+    int size = parse(func, &arena, &infix);
+    status = shuntingYard(infix, size, &arena, &postfix);
+    if (status >= 0) {
+        status = compilePostfix(postfix, status, expr);
+    }
+    arenaFree(&arena);
+    return status;
 }
 
-void popTop(Node** headref) {
-    if (*headref != NULL) {
-        Node* temp = *headref;
-        *headref = (*headref)->next;
-        free(temp);
+/* Folding and CSE keep every evaluator's values and shrink the bytecode. */
+void checkOptimizer() {
+    const char* sources[] = {"sin(x)*sin(x)+3*2^4", "(x+1)*(x+1)/(x+1)+x^2", "x*1+0*x+x^1-x/1", "exp(x)*exp(x)+exp(x)^2", "(x^2+1)^3-(x^2+1)"};
+    double xs[64];
+    double raw[64];
+    double out[64];
+    double coefficients[5];
+    double reference[5];
+    char label[80];
+    Expr expr;
+
+    checkStatus("sin(x)*sin(x)+3*2^4 compiles", checkParseRaw(sources[0], &expr), 0);
+    checkStatus("sin(x)*sin(x)+3*2^4 before", expr.length, 10);
+    optimizeExpression(&expr);
+    checkStatus("sin(x)*sin(x)+3*2^4 after", expr.length, 7);
+    freeExpr(&expr);
+
+    for (int i = 0; i < 64; i++) {
+        xs[i] = 0.1 + i / 16.0;
+    }
+    for (int k = 0; k < (int) (sizeof(sources) / sizeof(sources[0])); k++) {
+        double error = 0;
+        double slopeError = 0;
+        double slope;
+        double rawSlope;
+
+        checkStatus(sources[k], checkParseRaw(sources[k], &expr), 0);
+        int length = expr.length;
+        for (int i = 0; i < 64; i++) {
+            raw[i] = evalExpr_d(&expr, xs[i]);
+        }
+        evalDual_d(&expr, 1.5, &rawSlope);
+        evalTaylor_d(&expr, 1.5, 4, reference);
+
+        optimizeExpression(&expr);
+        snprintf(label, sizeof(label), "%s shrinks", sources[k]);
+        checkStatus(label, expr.length < length, 1);
+        evalBatch_d(&expr, xs, out, 64);
+        for (int i = 0; i < 64; i++) {
+            double scale = fmax(fabs(raw[i]), 1);
+            error = fmax(error, fabs(evalExpr_d(&expr, xs[i]) - raw[i]) / scale);
+            error = fmax(error, fabs(out[i] - raw[i]) / scale);
+        }
+        snprintf(label, sizeof(label), "%s values", sources[k]);
+        checkValue(label, error, 0, 1e-14);
+
+        evalDual_d(&expr, 1.5, &slope);
+        evalTaylor_d(&expr, 1.5, 4, coefficients);
+        for (int i = 0; i <= 4; i++) {
+            slopeError = fmax(slopeError, fabs(coefficients[i] - reference[i]) / fmax(fabs(reference[i]), 1));
+        }
+        snprintf(label, sizeof(label), "%s evalDual_d", sources[k]);
+        checkValue(label, slope, rawSlope, 1e-14);
+        snprintf(label, sizeof(label), "%s evalTaylor_d", sources[k]);
+        checkValue(label, slopeError, 0, 1e-13);
+        freeExpr(&expr);
     }
 }
 
-void freeList(Node* head) {
-    Node* current = head;
-    Node* temp;
+/* Bindings, the derivative in slot 0, and grid sweeps of a*x^2+b*y+x*y against its closed form. */
+void checkMultivariate() {
+    const char* names[] = {"x", "y", "a", "b"};
+    double xs[19];
+    double ys[1500];
+    double as[3] = {0.5, 2, 4};
+    double bindings[4] = {1.5, 0.5, 2, 3};
+    double batch[1500];
+    double* grid = (double*) malloc(3 * 19 * 1500 * sizeof(double));
+    float xf[19];
+    float yf[1500];
+    float gridf[19 * 1500];
+    double error = 0;
+    double slope;
+    Expr expr;
+    Expr theta;
+
+    compileMultivariate("a*x^2+b*y+x*y", names, 4, &expr);
+    checkStatus("lookupVariable b", lookupVariable(&expr, "b"), 3);
+    checkStatus("lookupVariable z", lookupVariable(&expr, "z"), -1);
+    checkStatus("setVariable x refused", setVariable(&expr, "x", 1), -1);
+    checkStatus("setVariable a", setVariable(&expr, "a", 2), 2);
+    setVariable(&expr, "b", 3);
+    setVariable(&expr, "y", 0.5);
+    checkValue("a*x^2+b*y+x*y", evalExpr_d(&expr, 1.5), 6.75, 1e-15);
+    checkValue("a*x^2+b*y+x*y evalBound_d", evalBound_d(&expr, bindings), 6.75, 1e-15);
+    checkValue("a*x^2+b*y+x*y evalDual_d", evalDual_d(&expr, 1.5, &slope), 6.75, 1e-15);
+    checkValue("a*x^2+b*y+x*y slope", slope, 6.5, 1e-15);
+    checkStatus("a*x^2+b*y+x*y derivative", expr.derivative != NULL, 1);
+    if (expr.derivative != NULL) {
+        checkValue("a*x^2+b*y+x*y derivative value", evalExpr_d(expr.derivative, 1.5), 6.5, 1e-15);
+    }
 
-    while (current != NULL) {
-        temp = current->next;
-        free(current);
-        current = temp;
+    for (int i = 0; i < 19; i++) {
+        xs[i] = xf[i] = -1 + i / 9.0f;
+    }
+    for (int j = 0; j < 1500; j++) {
+        ys[j] = yf[j] = -2 + j / 375.0f;
+    }
+    evalBoundBatch_d(&expr, bindings, 1, ys, batch, 1500);
+    for (int j = 0; j < 1500; j++) {
+        error = fmax(error, fabs(batch[j] - (4.5 + 3*ys[j] + 1.5*ys[j])));
+    }
+    checkValue("evalBoundBatch_d over y", error, 0, 1e-14);
+
+    int slots[3] = {2, 0, 1};
+    const double* axes[3] = {as, xs, ys};
+    int sizes[3] = {3, 19, 1500};
+    checkStatus("evalGrid_d 3-D", evalGrid_d(&expr, NULL, 3, slots, axes, sizes, grid), 0);
+    error = 0;
+    for (int k = 0; k < 3; k++) {
+        for (int i = 0; i < 19; i++) {
+            for (int j = 0; j < 1500; j++) {
+                double want = as[k]*xs[i]*xs[i] + 3*ys[j] + xs[i]*ys[j];
+                error = fmax(error, fabs(grid[(k*19 + i)*1500 + j] - want));
+            }
+        }
     }
+    checkValue("evalGrid_d 3-D values", error, 0, 1e-13);
+
+    const float* axesf[2] = {xf, yf};
+    float bindingsf[4] = {0, 0, 2, 3};
+    checkStatus("evalGrid 2-D", evalGrid(&expr, bindingsf, 2, slots + 1, axesf, sizes + 1, gridf), 0);
+    error = 0;
+    for (int i = 0; i < 19; i++) {
+        for (int j = 0; j < 1500; j++) {
+            double want = 2.0*xf[i]*xf[i] + 3.0*yf[j] + (double) xf[i]*yf[j];
+            error = fmax(error, fabs(gridf[i*1500 + j] - want) / fmax(fabs(want), 1));
+        }
+    }
+    checkValue("evalGrid 2-D values", error, 0, 1e-6);
+
+    int badSlot = 4;
+    checkStatus("evalGrid_d slot out of range", evalGrid_d(&expr, NULL, 1, &badSlot, axes, sizes, grid), -1);
+    checkStatus("evalGrid_d no axes", evalGrid_d(&expr, NULL, 0, slots, axes, sizes, grid), -1);
+    freeExpr(&expr);
+    free(grid);
+
+    const char* thetaName[] = {"theta"};
+    compileMultivariate("3theta+theta^2", thetaName, 1, &theta);
+    checkValue("3theta+theta^2", evalExpr_d(&theta, 2), 10, 1e-15);
+    freeExpr(&theta);
 }
 
-int matchStrings(char* string, int structNum) {
-    switch (structNum) {
-        case 0:
-            for (int i = 0; strcmp(operators[i].operator, "end") != 0; i++) {
-                if (strcmp(string, operators[i].operator) == 0) {
-                    return 1;
-                }
+/* newton_system on a circle and a line, on Broyden's tridiagonal system, and on a singular Jacobian. */
+void checkNewtonSystem() {
+    const char* names[] = {"x", "y", "r"};
+    const char* updates[] = {"newton", "frozen", "broyden"};
+    const char* jacobians[] = {"difference", "dual"};
+    char names20[21][4];
+    char sources[20][64];
+    const char* unknowns[21];
+    double reference[20];
+    char label[80];
+    Expr pair[2];
+    Expr chain[20];
+    SystemResult_d result;
+
+    compileMultivariate("x^2+y^2-r^2", names, 3, &pair[0]);
+    compileMultivariate("x-y+1", names, 3, &pair[1]);
+    checkStatus("setVariable r", setVariable(&pair[0], "r", sqrt(5)), 2);
+    double bindings[3] = {1, 1, sqrt(5)};
+    double slope;
+    checkValue("evalBoundDual_d", evalBoundDual_d(&pair[0], bindings, 1, &slope), -3, 1e-15);
+    checkValue("evalBoundDual_d slope in y", slope, 2, 1e-15);
+
+    for (int k = 0; k < 20; k++) {
+        snprintf(names20[k], sizeof(names20[k]), "u%c", 'a' + k);
+        unknowns[k] = names20[k];
+    }
+    unknowns[20] = "c";
+    for (int k = 0; k < 20; k++) {
+        int length = snprintf(sources[k], sizeof(sources[k]), "(3-2*%s)*%s+c", unknowns[k], unknowns[k]);
+        if (k > 0) {
+            length += snprintf(sources[k] + length, sizeof(sources[k]) - length, "-%s", unknowns[k - 1]);
+        }
+        if (k < 19) {
+            snprintf(sources[k] + length, sizeof(sources[k]) - length, "-2*%s", unknowns[k + 1]);
+        }
+        compileMultivariate(sources[k], unknowns, 21, &chain[k]);
+        setVariable(&chain[k], "c", 1);
+    }
+
+    for (int k = 0; k < 20; k++) {
+        reference[k] = -1;
+    }
+    checkStatus("Broyden tridiagonal reference", newton_system_d(20, chain, reference, JACOBIAN_DUAL, UPDATE_NEWTON, 1e-14, 0, &result), 0);
+
+    for (int update = UPDATE_NEWTON; update <= UPDATE_BROYDEN; update++) {
+        for (int jacobian = JACOBIAN_DIFFERENCE; jacobian <= JACOBIAN_DUAL; jacobian++) {
+            double x[20] = {1, 1};
+
+            snprintf(label, sizeof(label), "circle and line, %s, %s", updates[update], jacobians[jacobian]);
+            checkStatus(label, newton_system_d(2, pair, x, jacobian, update, 1e-12, 0, &result), 0);
+            checkValue(label, x[0], 1, 1e-10);
+            checkValue(label, x[1], 2, 1e-10);
+
+            for (int k = 0; k < 20; k++) {
+                x[k] = -1;
             }
-            break;
-        case 1:
-            for (int i = 0; strcmp(functions[i].name, "end") != 0; i++) {
-                if (strcmp(string, functions[i].name) == 0) {
-                    return 1;
-                }
+            snprintf(label, sizeof(label), "Broyden tridiagonal, %s, %s", updates[update], jacobians[jacobian]);
+            checkStatus(label, newton_system_d(20, chain, x, jacobian, update, 1e-12, 0, &result), 0);
+            checkStatus(label, result.residual <= 1e-12, 1);
+            if (update == UPDATE_BROYDEN) {
+                checkStatus(label, result.jacobians < result.iterations, 1);
             }
-            break;
+            double error = 0;
+            for (int k = 0; k < 20; k++) {
+                error = fmax(error, fabs(x[k] - reference[k]));
+            }
+            checkValue(label, error, 0, 1e-10);
+        }
     }
 
-    return 0;
+    Expr singular[2];
+    double x[2] = {0, 1};
+    compileMultivariate("x^2", names, 2, &singular[0]);
+    compileMultivariate("y", names, 2, &singular[1]);
+    checkStatus("singular Jacobian", newton_system_d(2, singular, x, JACOBIAN_DUAL, UPDATE_NEWTON, 1e-12, 0, &result), -2);
+
+    for (int k = 0; k < 2; k++) {
+        freeExpr(&pair[k]);
+        freeExpr(&singular[k]);
+    }
+    for (int k = 0; k < 20; k++) {
+        freeExpr(&chain[k]);
+    }
 }
 
-int findStruct(char* string, int structNum) {
-    switch (structNum) {
-        case 0:
-            for (int i = 0; strcmp(operators[i].operator, "end") != 0; i++) {
-                if (strcmp(string, operators[i].operator) == 0) {
-                    return i;
-                }
-            }
-            break;
-        case 1:
-            for (int i = 0; strcmp(functions[i].name, "end") != 0; i++) {
-                if (strcmp(string, functions[i].name) == 0) {
-                    return i;
-                }
-            }
-            break;
+/* Barycentric fits: exact polynomials, Runge's function, batch agreement and refused inputs. */
+void checkBarycentric() {
+    enum {RUNGE = 41, QUERIES = 5003};
+    double xs[] = {0, 1, 2, 3};
+    double ys[] = {0, -1, 4, 21};
+    double backwards[] = {3, 2, 1, 0};
+    double rx[RUNGE];
+    double ry[RUNGE];
+    double* values = (double*) malloc(QUERIES * sizeof(double));
+    double* out = (double*) malloc(QUERIES * sizeof(double));
+    double polynomialError = 0;
+    double rationalError = 0;
+    double batchError = 0;
+    Barycentric_d fit;
+
+    checkStatus("barycentric_fit_d cubic", barycentric_fit_d(&fit, 4, xs, ys, -1), 0);
+    checkStatus("barycentric_fit_d degree", fit.degree, 3);
+    for (double q = -0.5; q <= 3.5; q += 0.375) {
+        checkValue("barycentric_eval_d cubic", barycentric_eval_d(&fit, q), q*q*q - 2*q, 1e-13);
+    }
+    checkValue("barycentric_eval_d at a node", barycentric_eval_d(&fit, 2), 4, 0);
+    barycentric_free_d(&fit);
+    checkStatus("barycentric_fit_d decreasing", barycentric_fit_d(&fit, 4, backwards, ys, 2), -1);
+    barycentric_free_d(&fit);
+
+    for (int k = 0; k < RUNGE; k++) {
+        rx[k] = -1 + 2.0 * k / (RUNGE - 1);
+        ry[k] = 1 / (1 + 25 * rx[k] * rx[k]);
+    }
+    for (int i = 0; i < QUERIES; i++) {
+        values[i] = -1 + 2.0 * i / (QUERIES - 1);
     }
 
-    return 0;
+    barycentric_fit_d(&fit, RUNGE, rx, ry, RUNGE - 1);
+    for (int i = 0; i < QUERIES; i++) {
+        polynomialError = fmax(polynomialError, fabs(barycentric_eval_d(&fit, values[i]) - 1 / (1 + 25 * values[i] * values[i])));
+    }
+    barycentric_free_d(&fit);
+    checkStatus("Runge, full degree diverges", polynomialError > 1, 1);
+
+    barycentric_fit_d(&fit, RUNGE, rx, ry, 3);
+    barycentric_eval_batch_d(&fit, values, out, QUERIES);
+    for (int i = 0; i < QUERIES; i++) {
+        rationalError = fmax(rationalError, fabs(out[i] - 1 / (1 + 25 * values[i] * values[i])));
+        batchError = fmax(batchError, fabs(out[i] - barycentric_eval_d(&fit, values[i])));
+    }
+    barycentric_free_d(&fit);
+    checkValue("Runge, degree 3", rationalError, 0, 1e-3);
+    checkValue("barycentric_eval_batch_d vs barycentric_eval_d", batchError, 0, 0);
+
+    free(values);
+    free(out);
 }
 
-int isInt(char* string) {
-    if (string[0] == '-' || string[0] == '+') {
-        if (isdigit(string[1])) {
-            return 1;
+/* Natural splines on uniform and graded knots: exact at the knots and on lines, close to sin, batch agreement. */
+void checkSpline() {
+    enum {KNOTS = 101, QUERIES = 5003};
+    double uniform[KNOTS];
+    double graded[KNOTS];
+    double su[KNOTS];
+    double sg[KNOTS];
+    double line[KNOTS];
+    double* values = (double*) malloc(QUERIES * sizeof(double));
+    double* out = (double*) malloc(QUERIES * sizeof(double));
+    double one[] = {0};
+    Spline_d spline;
+    Spline_d gradedSpline;
+
+    for (int k = 0; k < KNOTS; k++) {
+        uniform[k] = 3.0 * k / (KNOTS - 1);
+        graded[k] = 3.0 * k * k / ((KNOTS - 1) * (KNOTS - 1));
+        su[k] = sin(uniform[k]);
+        sg[k] = sin(graded[k]);
+        line[k] = 2 * graded[k] - 1;
+    }
+    for (int i = 0; i < QUERIES; i++) {
+        values[i] = 0.5 + 2.0 * i / (QUERIES - 1);
+    }
+
+    checkStatus("spline_fit_d one knot", spline_fit_d(&spline, 1, one, one), -1);
+    spline_free_d(&spline);
+    checkStatus("spline_fit_d line", spline_fit_d(&spline, KNOTS, graded, line), 0);
+    checkStatus("spline_fit_d graded is not uniform", spline.uniform, 0);
+    checkValue("spline_eval_d line", spline_eval_d(&spline, 1.2345), 1.469, 1e-14);
+    checkValue("spline_eval_d line extrapolated", spline_eval_d(&spline, 4), 7, 1e-13);
+    spline_free_d(&spline);
+
+    spline_fit_d(&spline, KNOTS, uniform, su);
+    spline_fit_d(&gradedSpline, KNOTS, graded, sg);
+    checkStatus("spline_fit_d uniform", spline.uniform, 1);
+    double knotError = 0;
+    for (int k = 0; k < KNOTS; k++) {
+        knotError = fmax(knotError, fabs(spline_eval_d(&spline, uniform[k]) - su[k]));
+        knotError = fmax(knotError, fabs(spline_eval_d(&gradedSpline, graded[k]) - sg[k]));
+    }
+    checkValue("spline_eval_d at the knots", knotError, 0, 1e-15);
+
+    Spline_d* fits[2] = {&spline, &gradedSpline};
+    const char* labels[2] = {"uniform", "graded"};
+    char label[80];
+    for (int f = 0; f < 2; f++) {
+        double sinError = 0;
+        double batchError = 0;
+        spline_eval_batch_d(fits[f], values, out, QUERIES);
+        for (int i = 0; i < QUERIES; i++) {
+            sinError = fmax(sinError, fabs(out[i] - sin(values[i])));
+            batchError = fmax(batchError, fabs(out[i] - spline_eval_d(fits[f], values[i])));
         }
-    } else if (isdigit(*string)) {
-        return 1;
+        snprintf(label, sizeof(label), "spline %s vs sin", labels[f]);
+        checkValue(label, sinError, 0, 1e-6);
+        snprintf(label, sizeof(label), "spline_eval_batch_d %s vs spline_eval_d", labels[f]);
+        checkValue(label, batchError, 0, 0);
     }
+    spline_free_d(&spline);
+    spline_free_d(&gradedSpline);
 
-    return 0;
+    free(values);
+    free(out);
 }
 
-void printList(Node* head) {
-    Node* temp = head;
-    int count = 1;
+/* Ridders' derivatives of exp(x)*ln(x) against hand-derived values, and ridders_batch against ridders_derivative. */
+void checkRidders() {
+    enum {POINTS = 2500};
+    double e2 = exp(2.0);
+    double l2 = log(2.0);
+    double want[5] = {0, e2 * (l2 + 0.5), e2 * (l2 + 1 - 0.25), e2 * (l2 + 1.5 - 0.75 + 0.25), e2 * (l2 + 2 - 1.5 + 1 - 0.375)};
+    double tolerance[5] = {0, 1e-12, 1e-9, 1e-7, 1e-5};
+    double* xs = (double*) malloc(POINTS * sizeof(double));
+    double* values = (double*) malloc(POINTS * sizeof(double));
+    double* errors = (double*) malloc(POINTS * sizeof(double));
+    char label[80];
+    Derivative_d result;
+    Expr expr;
+
+    compileExpression("exp(x)*ln(x)", &expr);
+    for (int order = 1; order <= 4; order++) {
+        snprintf(label, sizeof(label), "ridders_derivative_d order %d", order);
+        checkStatus(label, ridders_derivative_d(&expr, 2, order, &result), 0);
+        checkValue(label, result.value, want[order], tolerance[order]);
+        snprintf(label, sizeof(label), "ridders_derivative_d order %d error estimate", order);
+        checkStatus(label, fabs(result.value - want[order]) <= 10 * result.error + 1e-15 * fabs(want[order]), 1);
+    }
+    checkStatus("ridders_derivative_d order 0", ridders_derivative_d(&expr, 2, 0, &result), -1);
+    checkStatus("ridders_derivative_d order too high", ridders_derivative_d(&expr, 2, MAX_DERIVATIVE + 1, &result), -1);
+    checkStatus("ridders_batch_d order too high", ridders_batch_d(&expr, xs, POINTS, MAX_DERIVATIVE + 1, values, errors), -1);
 
-    while (temp != NULL) {
-        printf("%s,", temp->Variable.input);
-        temp = temp->next;
-        count++;
+    for (int i = 0; i < POINTS; i++) {
+        xs[i] = 0.5 + 3.0 * i / POINTS;
+    }
+    for (int order = 1; order <= 2; order++) {
+        double valueGap = 0;
+        double errorGap = 0;
+
+        checkStatus("ridders_batch_d", ridders_batch_d(&expr, xs, POINTS, order, values, errors), 0);
+        for (int i = 0; i < POINTS; i++) {
+            ridders_derivative_d(&expr, xs[i], order, &result);
+            valueGap = fmax(valueGap, fabs(values[i] - result.value) / fmax(fabs(result.value), 1));
+            errorGap = fmax(errorGap, fabs(errors[i] - result.error) / fmax(result.error, 1e-300));
+        }
+        snprintf(label, sizeof(label), "ridders_batch_d order %d values", order);
+        checkValue(label, valueGap, 0, 0);
+        snprintf(label, sizeof(label), "ridders_batch_d order %d error estimates", order);
+        checkValue(label, errorGap, 0, 0);
     }
+    freeExpr(&expr);
+    free(xs);
+    free(values);
+    free(errors);
+}
 
+const char* checkCompileSources[] = {"x^2+3*x-1", "sin(x)*cos(x)", "(x+1)/(x-1)+ln(x)", "exp(x/4)-x_2", "sqrt(x)*abs(1-x)", "cubed(x)-2*x"};
+double checkCompileExpected[6];
+atomic_int checkCompileMismatches;
+
+/* Compiles every source ten times per index and counts results that differ from the serial ones. */
+void checkCompileRange(void* ctx, int lo, int hi) {
+    (void) ctx;
+    for (int i = lo; i < hi; i++) {
+        int k = i % 6;
+        Expr expr;
+        for (int repeat = 0; repeat < 10; repeat++) {
+            if (compileExpression(checkCompileSources[k], &expr) != 0) {
+                atomic_fetch_add(&checkCompileMismatches, 1);
+                continue;
+            }
+            if (evalExpr_d(&expr, 3) != checkCompileExpected[k]) {
+                atomic_fetch_add(&checkCompileMismatches, 1);
+            }
+            freeExpr(&expr);
+        }
+    }
 }
 
-void takeIntervals(float *a, float *b, Var* postfix) {
-    printf("Input intervals [a, b]:\n");
-    printf("a:");
-    scanf("%f", a);
-    printf("b:");
-    scanf("%f", b);
-}
\ No newline at end of file
+/* Compiling is re-entrant: 2000 compiles over four pool threads match a serial compile of each source. */
+void checkConcurrentCompile() {
+    Expr expr;
+
+    for (int k = 0; k < 6; k++) {
+        compileExpression(checkCompileSources[k], &expr);
+        checkCompileExpected[k] = evalExpr_d(&expr, 3);
+        freeExpr(&expr);
+    }
+    checkCompileMismatches = 0;
+    setThreadCount(4);
+    parallelFor(0, 200, 1, checkCompileRange, NULL);
+    checkStatus("concurrent compiles", atomic_load(&checkCompileMismatches), 0);
+}
+#endif
@@ -0,0 +1,289 @@
+/*
+ * Public interface of the numerical library: expression compilation, root
+ * finders, quadrature, dense and sparse linear solvers, interpolation. Every
+ * routine takes its data as arguments and returns results and statistics;
+ * nothing here reads input or prints. The precision-generic routines exist
+ * for float (no suffix), double (_d) and long double (_ld).
+ *
+ * NumAnalysis.c is the library and NumAnalysisCli.c the command line front
+ * end: cc -O2 -pthread NumAnalysis.c NumAnalysisCli.c -lm
+ * Add -DSELFCHECK to run the self-check in place of the front end.
+ */
+#ifndef NUMANALYSIS_H
+#define NUMANALYSIS_H
+
+#include <ctype.h>
+#include <float.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#define JIT_X86_64
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#ifndef M_E
+#define M_E 2.71828182845904523536
+#endif
+
+#define PI_L 3.141592653589793238462643383279502884L
+#define E_L 2.718281828459045235360287471352662498L
+
+#define CAT_(a, b) a##b
+#define CAT(a, b) CAT_(a, b)
+
+#define EPSILON 0.0001
+#define MAX_ITERATIONS 1000
+#define MAX_ROOTS 256
+#define BATCH_BLOCK 64
+#define MAX_POWI 32
+#define MAX_CHAIN 2
+#define MAX_TAYLOR 32
+#define MAX_DERIVATIVE 8
+#define MAX_RIDDERS 10
+#define RIDDERS_SHRINK 1.4
+#define RIDDERS_CHUNK 1024
+#define MAX_BROYDEN 20
+#define SYSTEM_CONTRACTION 0.5
+#define ARENA_BLOCK 4096
+#define MAX_FUNCTIONS 64
+#define LU_BLOCK 64
+#define LU_TILE 256
+#define RELAX_CHUNK 512
+#define MAX_ROMBERG 30
+#define MATRIX_DATA_OFFSET 64
+
+enum {ASSOC_NONE = 0, ASSOC_LEFT, ASSOC_RIGHT};
+enum {RELAX_JACOBI = 0, RELAX_MULTICOLOR};
+enum {JACOBIAN_DIFFERENCE = 0, JACOBIAN_DUAL};
+enum {COMPILE_PARENTHESES = -1, COMPILE_IDENTIFIER = -2, COMPILE_MALFORMED = -3};
+enum {UPDATE_NEWTON = 0, UPDATE_FROZEN, UPDATE_BROYDEN};
+enum {MATRIX_FLOAT = 4, MATRIX_DOUBLE = 8};
+enum {TOKEN_UNKNOWN = 0, TOKEN_NUMBER, TOKEN_VARIABLE, TOKEN_OPERATOR, TOKEN_FUNCTION, TOKEN_LOG, TOKEN_LOGBASE, TOKEN_LPAREN, TOKEN_RPAREN};
+enum {OP_CONST = 0, OP_VAR, OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_POWI, OP_BINARY, OP_UNARY, OP_UNARY_DEG, OP_LOGBASE, OP_STORE, OP_LOAD};
+
+typedef struct {
+    char* operator;
+    int prec;
+    int assoc;
+    float(*func)(float a, float b);
+    double (*func_d)(double a, double b);
+    long double (*func_ld)(long double a, long double b);
+} Operator;
+
+typedef struct {
+    char *name;
+    float (*func)(float val);
+    int degrees;
+    double (*func_d)(double val);
+    long double (*func_ld)(long double val);
+} Function;
+
+typedef struct {
+    char* input;
+    int type;
+    int index;
+} Var;
+
+typedef struct {
+    int op;
+    int index;
+    long double wide;
+    union {
+        float value;
+        int exponent;
+        float (*binary)(float a, float b);
+        float (*unary)(float val);
+    };
+} Instr;
+
+/*
+ * Compiled expression. OP_STORE copies the top of the stack into slot
+ * index and OP_LOAD pushes it back. OP_VAR pushes variable slot index:
+ * names[k] is the variable of slot k, slot 0 is the free variable the
+ * single-variable routines bind (x unless named otherwise), and values[k]
+ * is the value setVariable gave slot k. derivative, when not NULL, is the
+ * compiled df/d(slot 0) and is owned by the expression.
+ */
+typedef struct Expr {
+    Instr* code;
+    int length;
+    int depth;
+    int slots;
+    int variables;
+    char** names;
+    long double* values;
+    float (*native)(float x);
+    void (*nativeBatch)(const float* xs, float* out, size_t n);
+    void* nativeCode;
+    size_t nativeSize;
+    struct Expr* derivative;
+} Expr;
+
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t used;
+    size_t capacity;
+    _Alignas(16) char data[];
+} ArenaBlock;
+
+typedef struct {
+    ArenaBlock* head;
+} Arena;
+
+/*
+ * Header of the binary matrix format. elementSize is MATRIX_FLOAT or
+ * MATRIX_DOUBLE; the rows * cols row-major elements start at
+ * MATRIX_DATA_OFFSET, so a mapped file is 64-byte aligned.
+ */
+typedef struct {
+    char magic[4];
+    unsigned int elementSize;
+    unsigned long long rows;
+    unsigned long long cols;
+} MatrixFileHeader;
+
+/*
+ * A matrix or dataset read by loadMatrix, row-major with cols entries per
+ * row. Binary files are used in place: data points into a private mapping
+ * (written pages are copied on write, never back to the file). Text files
+ * are parsed into heap memory as doubles.
+ */
+typedef struct {
+    int rows;
+    int cols;
+    int elementSize;
+    void* data;
+    void* mapping;
+    size_t mappingSize;
+} MatrixData;
+
+extern Function functions[MAX_FUNCTIONS];
+extern Operator operators[];
+
+void* alignedAlloc(size_t bytes);
+
+/*
+ * One process-wide thread pool, started by the first parallelFor. It runs
+ * one job at a time: a parallelFor made from inside a body, or while
+ * another thread's job holds the pool, runs its range serially on the
+ * calling thread instead of waiting. So every routine that takes the pool
+ * may be called from several threads, and from inside each other, at the
+ * cost of parallelism for all but one caller. setThreadCount waits for
+ * the running job and is ignored from inside a body.
+ */
+void parallelFor(int begin, int end, int chunk, void (*body)(void* ctx, int lo, int hi), void* ctx);
+void setThreadCount(int count);
+
+void* arenaAlloc(Arena* arena, size_t bytes);
+void arenaFree(Arena* arena);
+
+int parse(const char* func, Arena* arena, Var** infix);
+int shuntingYard(Var* infix, int size, Arena* arena, Var** postfix);
+int compilePostfix(Var* postfix, int size, Expr* expr);
+int compileExpression(const char* func, Expr* expr);
+int compileMultivariate(const char* func, const char* const* names, int count, Expr* expr);
+const char* compileError(int status);
+int lookupVariable(Expr* expr, const char* name);
+int setVariable(Expr* expr, const char* name, long double value);
+void freeExpr(Expr* expr);
+int differentiateExpression(Expr* expr, Expr* derivative);
+void optimizeExpression(Expr* expr);
+int jitCompile(Expr* expr);
+
+int registerFunction(const char* name, float (*func)(float val), int degrees, double (*func_d)(double val), long double (*func_ld)(long double val));
+
+int loadMatrix(const char* path, MatrixData* matrix);
+int parseMatrixText(const char* text, size_t length, MatrixData* matrix);
+int saveMatrix(const char* path, const MatrixData* matrix);
+void freeMatrix(MatrixData* matrix);
+const char* parseNumber(const char* text, const char* end, double* value);
+
+#include "NumAnalysisPrecision.h"
+
+#ifdef BENCHMARK
+void benchmark();
+void benchmarkPrecision();
+void benchmarkLU(int n);
+void benchmarkInverse(int n);
+void benchmarkSparse(int grid);
+void benchmarkQuadrature();
+void benchmarkBatchQuadrature(int count);
+void benchmarkMatrixIO(int n);
+void benchmarkRoots();
+void benchmarkAllRoots(int samples);
+void benchmarkDerivatives();
+void benchmarkOptimizer();
+void benchmarkGrid(int n);
+void benchmarkSystem(int n);
+void benchmarkInterpolation(int count, int queries);
+void benchmarkLookup(int count, int queries);
+void benchmarkRidders(int count);
+void poissonMatrix(CSRMatrix_d* A, int grid);
+double secondsSince(clock_t start);
+#endif
+
+#ifdef SELFCHECK
+int selfCheck();
+void checkValue(const char* label, double got, double want, double tolerance);
+void checkStatus(const char* label, int got, int want);
+void checkBytecode();
+void checkCompileErrors();
+void checkBatch();
+void checkSinCos();
+void checkTrapezoidal();
+void checkJit();
+void checkArena();
+void checkSymbols();
+void checkWideFunctions();
+void checkPrecision();
+void checkRoots();
+void checkQuadrature();
+void checkRandomMatrix(int n, int cols, double* matrix, unsigned seed);
+double checkResidual(int n, const double* system, const double* x);
+void checkDense();
+void checkLargeDense();
+void checkMarkRange(void* ctx, int lo, int hi);
+void checkParallelFor();
+void checkNestedRange(void* ctx, int lo, int hi);
+void* checkPoolCaller(void* arg);
+void checkPoolSharing();
+void checkSparse();
+void checkRelax();
+void checkIntegrateBatch();
+void* checkConcurrentCaller(void* arg);
+void checkConcurrentCallers();
+void checkDerivatives();
+void checkInterpolation();
+void checkInterpolationBatch();
+void checkMatrixIO();
+void checkParseNumber();
+void checkAllRoots();
+void checkSymbolic();
+void checkTaylor();
+int checkParseRaw(const char* func, Expr* expr);
+void checkOptimizer();
+void checkMultivariate();
+void checkNewtonSystem();
+void checkBarycentric();
+void checkSpline();
+void checkRidders();
+void checkCompileRange(void* ctx, int lo, int hi);
+void checkConcurrentCompile();
+#endif
+
+#endif /* NUMANALYSIS_H */
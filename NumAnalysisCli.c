@@ -0,0 +1,915 @@
+#include "NumAnalysis.h"
+
+float findRoot(int method, float a, float b, Expr* expr);
+void allRoots(float a, float b, Expr* expr);
+float numerical_derivative(Expr* expr);
+float simpsons(float a, float b, Expr* expr);
+float trapezoidal_method(float a, float b, Expr* expr);
+float gregory_newton();
+void inverse_matrix();
+void gauus_elimination();
+void gauss_seidal();
+void takeIntervals(float *a, float *b);
+
+int runJobs(FILE* file);
+int runJob(char* line, int number);
+int reportCompile(int status, const char* func, int number);
+int nextNumber(double* value);
+int nextNumbers(double* values, int count);
+void printVector(const double* values, int count);
+double* widenMatrix(MatrixData* matrix);
+
+/*
+ * Without arguments the method, function and data are prompted for. With a
+ * job file (or - for stdin) every line is one problem, solved in double
+ * precision without prompts; see runJob for the format.
+ */
+int main(int argc, char** argv) {
+#ifdef BENCHMARK
+    benchmark();
+    return 0;
+#endif
+
+#ifdef SELFCHECK
+    return selfCheck();
+#endif
+
+    if (argc > 1) {
+        FILE* file = (strcmp(argv[1], "-") == 0) ? stdin : fopen(argv[1], "r");
+        if (file == NULL) {
+            printf("Cannot open %s.\n", argv[1]);
+            exit(1);
+        }
+        int failed = runJobs(file);
+        if (file != stdin) {
+            fclose(file);
+        }
+        return failed > 0;
+    }
+
+    char* input = (char*) calloc(100, sizeof(char));
+    Expr expr = {0};
+
+    int funcNeeded[] = {1, 2, 3, 7, 8, 9, 11, 12};
+
+    int methodSelected = 0;
+    printf("Choose a method:\n");
+    printf("1. Bisection Method\n");
+    printf("2. Regula-Falsi Method\n");
+    printf("3. Newton-Raphson\n");
+    printf("4. Inverse of an NxN Matrix\n");
+    printf("5. Gauus Elimination\n");
+    printf("6. Gauss Seidal Methods\n");
+    printf("7. Numerical Derviative\n");
+    printf("8. Simpson Method\n");
+    printf("9. Trapezoidal Method\n");
+    printf("10. Gregory Newton Interpolation\n");
+    printf("11. Brent's Method\n");
+    printf("12. All Roots in an Interval\n");
+    printf("Method (1-12): ");
+    scanf("%d", &methodSelected);
+
+    if (methodSelected > 12 || methodSelected < 1) {
+        printf("out of bounds.");
+        exit(1);
+    }
+
+    getchar();
+
+    for (int i = 0; i < 8; i++) {
+        if (methodSelected == funcNeeded[i]) {
+            printf("(Use _ for base, ^ for exponent, *,/,+,- for arithmetics, arc for inverse trig, csc/sec/cot for reciprocals of sin/cos/tan, exp/ln/sqrt/abs/sinh/cosh/tanh)\n");
+            printf("Input Function: ");
+            fgets(input, 100, stdin);
+
+            for (int i = 0; input[i] != '\0'; i++) {
+                if (input[i] == '\n') {
+                    input[i] = '\0';
+                }
+            }
+
+            int status = compileExpression(input, &expr);
+            if (status != 0) {
+                printf("Cannot compile %s: %s.\n", input, compileError(status));
+                exit(1);
+            }
+        }
+    }
+    free(input);
+
+    float a = 0;
+    float b = 0;
+    float root = 0;
+
+    switch (methodSelected) {
+        case 1:
+        case 2:
+        case 3:
+            takeIntervals(&a, &b);
+            root = findRoot(methodSelected, a, b, &expr);
+            printf("Root is %lf", root);
+            break;
+        case 4:
+            inverse_matrix();
+            break;
+        case 5:
+            gauus_elimination();
+            break;
+        case 6:
+            gauss_seidal();
+            break;
+        case 7:
+            root = numerical_derivative(&expr);
+            printf("Answer is %lf", root);
+            break;
+        case 8:
+            takeIntervals(&a, &b);
+            root = simpsons(a, b, &expr);
+            printf("Answer is %lf", root);
+            break;
+        case 9:
+            takeIntervals(&a, &b);
+            root = trapezoidal_method(a, b, &expr);
+            printf("Answer is %lf", root);
+            break;
+        case 10:
+            root = gregory_newton();
+            printf("Answer is %lf", root);
+            break; 
+        case 11:
+            takeIntervals(&a, &b);
+            root = findRoot(4, a, b, &expr);
+            printf("Root is %lf", root);
+            break;
+        case 12:
+            takeIntervals(&a, &b);
+            allRoots(a, b, &expr);
+            break;
+    }
+
+    freeExpr(&expr);
+}
+
+/* Runs bisection (1), regula falsi (2), Newton-Raphson (3) or Brent (4) and prints its iteration table afterwards. */
+float findRoot(int method, float a, float b, Expr* expr) {
+    Iteration* history = (Iteration*) malloc(MAX_ITERATIONS * sizeof(Iteration));
+    RootResult result = {0};
+    int status = 0;
+
+    result.history = history;
+    result.historyCapacity = MAX_ITERATIONS;
+    switch (method) {
+        case 1:
+            status = bisection(a, b, expr, EPSILON, MAX_ITERATIONS, &result);
+            break;
+        case 2:
+            status = regula_falsi(a, b, expr, EPSILON, MAX_ITERATIONS, &result);
+            break;
+        case 3:
+            status = newton_raphson(a, b, expr, EPSILON, MAX_ITERATIONS, &result);
+            break;
+        case 4:
+            status = brent(a, b, expr, EPSILON, MAX_ITERATIONS, &result);
+            break;
+    }
+
+    if (method == 3) {
+        printf("i\tx\t\tf'(x)\t\tx1\t\tf(x1)\n");
+    } else {
+        printf("i\ta\t\tb\t\tc\t\tf(c)\n");
+    }
+    for (int i = 0; i < result.iterations && i < result.historyCapacity; i++) {
+        printf("%d\t%lf\t%lf\t%lf\t%lf\t\n", i, history[i].a, history[i].b, history[i].c, history[i].fc);
+    }
+    if (status != 0) {
+        printf("Did not converge in %d iterations (or [a, b] does not bracket a root).\n", MAX_ITERATIONS);
+    }
+    printf("%d function evaluations.\n", result.evaluations);
+
+    free(history);
+    return result.root;
+}
+
+void inverse_matrix() {
+    int n;
+    printf("Enter size of matrix: ");
+    scanf("%d", &n);
+
+    float* matrix = (float*) malloc((size_t) n * n * sizeof(float));
+    float* inverse = (float*) malloc((size_t) n * n * sizeof(float));
+
+    printf("Enter elements of matrix:\n");
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            printf("(%d, %d): ", i+1, j+1);
+            scanf("%f", &matrix[i*n + j]);
+        }
+    }
+
+    if (invert_matrix(n, matrix, inverse) != 0) {
+        printf("The matrix is singular.\n");
+        exit(1);
+    }
+
+    printf("Inverse of the matrix:\n");
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            printf("%f\t", inverse[i*n + j]);
+        }
+        printf("\n");
+    }
+
+    free(matrix);
+    free(inverse);
+}
+
+void gauus_elimination() {
+    int numEq;
+
+    printf("Enter num of equations: ");
+    scanf("%d", &numEq);
+
+    float* matrix = (float*) malloc((size_t) numEq * (numEq+1) * sizeof(float));
+    float* solution = (float*) malloc(numEq * sizeof(float));
+
+    printf("Enter coefficients of matrix:\n");
+    for (int i = 0; i < numEq; i++) {
+        for (int j = 0; j <= numEq; j++) {
+            printf("(%d, %d): ", i+1, j+1);
+            scanf("%f", &matrix[i*(numEq+1) + j]);
+        }
+    }
+
+    if (gauss_solve(numEq, matrix, solution) != 0) {
+        printf("The matrix is singular.\n");
+        exit(1);
+    }
+
+    printf("The solution is:\n");
+    for (int i = 0; i < numEq; i++) {
+        printf("matrix[%d] = %f\n", i+1, solution[i]);
+    }
+
+    free(matrix);
+    free(solution);
+}
+
+void gauss_seidal() {
+    int numEq;
+    float omega = 1;
+
+    printf("Enter num of equations: ");
+    scanf("%d", &numEq);
+
+    float* matrix = (float*) malloc((size_t) numEq * (numEq+1) * sizeof(float));
+    float* rhs = (float*) malloc(numEq * sizeof(float));
+    float* guess = (float*) calloc(numEq, sizeof(float));
+
+    printf("Enter coefficients of matrix:\n");
+    for (int i = 0; i < numEq; i++) {
+        for (int j = 0; j <= numEq; j++) {
+            printf("(%d, %d): ", i+1, j+1);
+            scanf("%f", &matrix[i*(numEq+1) + j]);
+        }
+        rhs[i] = matrix[i*(numEq+1) + numEq];
+    }
+
+    printf("Relaxation factor w (1 for Gauss-Seidel, 1-2 for SOR): ");
+    scanf("%f", &omega);
+
+    CSRMatrix A;
+    csr_from_dense(&A, numEq, numEq, matrix, numEq+1);
+    int iterations = sor_solve(&A, rhs, guess, omega, EPSILON, 100);
+    csr_free(&A);
+
+    if (iterations < 0) {
+        printf("Did not converge in 100 iterations (or a diagonal entry is zero).\n");
+    } else {
+        printf("Converged after %d iterations.\n", iterations);
+    }
+
+    printf("The solution is:\n");
+    for(int i = 0; i < numEq; i++) {
+        printf("matrix[%d] = %f\n", i, guess[i]);
+    }
+
+    free(matrix);
+    free(rhs);
+    free(guess);
+}
+
+void allRoots(float a, float b, Expr* expr) {
+    float roots[MAX_ROOTS];
+    int evaluations = 0;
+    int count = find_all_roots(a, b, expr, 1000, EPSILON, roots, MAX_ROOTS, &evaluations);
+
+    printf("%d root(s) found with %d function evaluations:\n", count, evaluations);
+    for (int i = 0; i < count; i++) {
+        printf("%lf\n", roots[i]);
+    }
+}
+
+float numerical_derivative(Expr* expr) {
+    int method = 0;
+    float x = 0;
+    printf("Choose a method: \n1. Forward\n2. Backward\n3. Central\n4. Exact (automatic differentiation)\n5. Extrapolated (Ridders)\nMethod(1-5): ");
+    scanf("%d", &method);
+
+    if (method > 5 || method < 1) {
+        printf("Out of bounds.");
+        exit(1);
+    }
+
+    printf("Enter point x: ");
+    scanf("%f", &x);
+
+    if (method == 4) {
+        float slope = 0;
+        evalDual(expr, x, &slope);
+        return slope;
+    }
+    if (method == 5) {
+        Derivative result;
+        ridders_derivative(expr, x, 1, &result);
+        printf("Error estimate %g after %d evaluations.\n", result.error, result.evaluations);
+        return result.value;
+    }
+    return finite_difference(expr, x, method);
+}
+
+float simpsons(float a, float b, Expr* expr) {
+    int method= 0;
+    printf("Select a method\n1. (1/3)\n2. (3/8)\n3. Adaptive (Gauss-Kronrod)\n");
+    scanf("%d", &method);
+
+    if (method == 3) {
+        Quadrature result;
+        if (gauss_kronrod(a, b, expr, EPSILON, 1e-6, 1000, &result) != 0) {
+            printf("Tolerance not reached.\n");
+        }
+        printf("Error estimate %g after %d evaluations.\n", result.error, result.evaluations);
+        return result.value;
+    }
+
+    return simpsons_rule(a, b, expr, method);
+}
+
+float trapezoidal_method(float a, float b, Expr* expr) {
+    int method = 0;
+    printf("Select a method\n1. Fixed (100 panels)\n2. Romberg\n");
+    scanf("%d", &method);
+
+    if (method == 2) {
+        Quadrature result;
+        if (romberg(a, b, expr, EPSILON, 1e-6, 20, &result) != 0) {
+            printf("Tolerance not reached.\n");
+        }
+        printf("Error estimate %g after %d evaluations.\n", result.error, result.evaluations);
+        return result.value;
+    }
+
+    return trapezoidal(a, b, expr);
+}
+
+float gregory_newton() {
+    int count;
+    printf("Enter number of data points: ");
+    scanf("%d", &count);
+
+    float* x = (float*) malloc(count * sizeof(float));
+    float* y = (float*) malloc(count * sizeof(float));
+    printf("Enter x data points:\n");
+    for (int i = 0; i < count; i++) {
+        scanf("%f", &x[i]);
+    }
+
+    printf("Enter y data points:\n");
+    for (int i = 0; i < count; i++) {
+        scanf("%f", &y[i]);
+    }
+
+    float val;
+    printf("Enter value to interpolate: ");
+    scanf("%f", &val);
+
+    float result = newton_interpolate(count, x, y, val);
+    free(x);
+    free(y);
+    return result;
+}
+
+void takeIntervals(float *a, float *b) {
+    printf("Input intervals [a, b]:\n");
+    printf("a:");
+    scanf("%f", a);
+    printf("b:");
+    scanf("%f", b);
+}
+
+int runJobs(FILE* file) {
+    char* line = NULL;
+    size_t capacity = 0;
+    int number = 0;
+    int failed = 0;
+
+    while (getline(&line, &capacity, file) != -1) {
+        number++;
+        if (runJob(line, number) != 0) {
+            failed++;
+        }
+    }
+
+    free(line);
+    return failed;
+}
+
+/*
+ * One job per line, fields separated by blanks; the function must not
+ * contain blanks. Blank lines and lines starting with # are skipped.
+ *
+ *   bisection|regula-falsi|brent <f> <a> <b> [tol]
+ *   newton <f> <x0> [tol]
+ *   roots <f> <a> <b> [samples]        every root in [a, b]
+ *   derivative <f> <x> [1|2|3|4]       forward, backward, central, exact
+ *   taylor <f> <x> <order>             f(x), f'(x), ... up to f(order)(x)
+ *   ridders <f> <x> [order]            extrapolated difference, with error
+ *   grid <f> <v>=<a>:<b>:<n> ... [<v>=<value> ...]
+ *                                      f on the grid of n points from a to b
+ *                                      per swept variable, last fastest
+ *   system <v1>,...,<vn> <f1> ... <fn> <n starting values> [update] [jacobian]
+ *                                      F(v) = 0; update 0 Newton, 1 frozen,
+ *                                      2 Broyden; jacobian 0 differences, 1 exact
+ *   simpson|simpson38|trapezoid <f> <a> <b>
+ *   kronrod|romberg <f> <a> <b> [tol]
+ *   inverse <n> <n*n entries>
+ *   solve <n> <n*(n+1) augmented entries>
+ *   seidel <n> <n*(n+1) augmented entries> [omega]
+ *   interpolate|barycentric|spline <n> <n x values> <n y values> <x> [<x> ...]
+ *                                      Newton or barycentric polynomial, or
+ *                                      natural cubic spline (increasing x)
+ *
+ * In the last four, @<file> can replace the size and entries: a binary
+ * matrix file (see MatrixFileHeader) or text/CSV with one row per line,
+ * n x 2 of (x, y) rows for interpolate.
+ *
+ * Prints the method name, the result and its statistics on one line, or an
+ * error on stderr. Returns 0 on success.
+ */
+int runJob(char* line, int number) {
+    char* method = strtok(line, " \t\r\n");
+    int status = 0;
+
+    if (method == NULL || method[0] == '#') {
+        return 0;
+    }
+
+    int root = !strcmp(method, "bisection") || !strcmp(method, "regula-falsi") || !strcmp(method, "newton")
+               || !strcmp(method, "brent");
+    if (!strcmp(method, "roots")) {
+        char* func = strtok(NULL, " \t\r\n");
+        double a = 0, b = 0, samples = 0;
+        double roots[MAX_ROOTS];
+        int evaluations = 0;
+        Expr expr;
+
+        if (func == NULL || nextNumber(&a) != 1 || nextNumber(&b) != 1 || nextNumber(&samples) < 0) {
+            fprintf(stderr, "line %d: usage: roots <f> <a> <b> [samples]\n", number);
+            return -1;
+        }
+        if (reportCompile(compileExpression(func, &expr), func, number) != 0) {
+            return -1;
+        }
+        int count = find_all_roots_d(a, b, &expr, (int) samples, 1e-12, roots, MAX_ROOTS, &evaluations);
+        printf("%s count=%d evaluations=%d", method, count, evaluations);
+        printVector(roots, count);
+        freeExpr(&expr);
+        return 0;
+    }
+
+    if (!strcmp(method, "taylor")) {
+        char* func = strtok(NULL, " \t\r\n");
+        double x = 0, order = 0;
+        double derivatives[MAX_TAYLOR + 1];
+        Expr expr;
+
+        if (func == NULL || nextNumber(&x) != 1 || nextNumber(&order) != 1 || order < 0 || order > MAX_TAYLOR) {
+            fprintf(stderr, "line %d: usage: taylor <f> <x> <order>, order at most %d\n", number, MAX_TAYLOR);
+            return -1;
+        }
+        if (reportCompile(compileExpression(func, &expr), func, number) != 0) {
+            return -1;
+        }
+        status = evalTaylor_d(&expr, x, (int) order, derivatives);
+        if (status != 0) {
+            fprintf(stderr, "line %d: %s has no known derivatives\n", number, func);
+        } else {
+            double factorial = 1;
+            for (int k = 1; k <= (int) order; k++) {
+                factorial *= k;
+                derivatives[k] *= factorial;
+            }
+            printf("%s", method);
+            printVector(derivatives, (int) order + 1);
+        }
+        freeExpr(&expr);
+        return status;
+    }
+
+    if (!strcmp(method, "grid")) {
+        char* func = strtok(NULL, " \t\r\n");
+        const char* names[16];
+        double* axes[16];
+        double fixed[16];
+        int slots[16];
+        int sizes[16];
+        int dims = 0;
+        int count = 0;
+        size_t points = 1;
+        Expr expr;
+
+        /* Swept variables take the first slots, in order, then the fixed ones. */
+        for (char* field = strtok(NULL, " \t\r\n"); field != NULL; field = strtok(NULL, " \t\r\n")) {
+            char* value = strchr(field, '=');
+            double a = 0, b = 0, n = 0;
+            int sweep = 0;
+
+            if (value == NULL || value == field || count == 16) {
+                count = -1;
+                break;
+            }
+            *value++ = '\0';
+            if (sscanf(value, "%lf:%lf:%lf", &a, &b, &n) == 3) {
+                if (n < 1 || dims < count) {
+                    count = -1;
+                    break;
+                }
+                sweep = 1;
+            } else if (sscanf(value, "%lf", &a) != 1) {
+                count = -1;
+                break;
+            }
+            names[count] = field;
+            fixed[count] = a;
+            if (sweep) {
+                sizes[dims] = (int) n;
+                axes[dims] = (double*) malloc(sizes[dims] * sizeof(double));
+                for (int i = 0; i < sizes[dims]; i++) {
+                    axes[dims][i] = (sizes[dims] > 1) ? a + (b - a) * i / (sizes[dims] - 1) : a;
+                }
+                slots[dims] = count;
+                points *= sizes[dims];
+                dims++;
+            }
+            count++;
+        }
+
+        if (func == NULL || count < 0 || dims == 0) {
+            fprintf(stderr, "line %d: usage: grid <f> <v>=<a>:<b>:<n> ... [<v>=<value> ...], swept variables first\n", number);
+            for (int k = 0; k < dims; k++) {
+                free(axes[k]);
+            }
+            return -1;
+        }
+        if (reportCompile(compileMultivariate(func, names, count, &expr), func, number) != 0) {
+            for (int k = 0; k < dims; k++) {
+                free(axes[k]);
+            }
+            return -1;
+        }
+        double* out = (double*) malloc(points * sizeof(double));
+        status = evalGrid_d(&expr, fixed, dims, slots, (const double* const*) axes, sizes, out);
+        printf("%s points=%zu", method, points);
+        printVector(out, (int) points);
+        free(out);
+        for (int k = 0; k < dims; k++) {
+            free(axes[k]);
+        }
+        freeExpr(&expr);
+        return status;
+    }
+
+    if (!strcmp(method, "system")) {
+        char* list = strtok(NULL, " \t\r\n");
+        int n = 0;
+
+        if (list != NULL) {
+            n = 1;
+            for (char* c = list; *c; c++) {
+                n += (*c == ',');
+            }
+        }
+
+        const char* names[n + 1];
+        char* funcs[n + 1];
+        double x[n + 1];
+        double update = UPDATE_NEWTON, jacobian = JACOBIAN_DUAL;
+        int complete = (list != NULL);
+
+        for (int i = 0; i < n; i++) {
+            names[i] = strsep(&list, ",");
+            complete = complete && names[i][0] != '\0';
+        }
+        for (int i = 0; i < n && complete; i++) {
+            funcs[i] = strtok(NULL, " \t\r\n");
+            complete = (funcs[i] != NULL);
+        }
+        if (!complete || !nextNumbers(x, n) || nextNumber(&update) < 0 || nextNumber(&jacobian) < 0 ||
+            update < UPDATE_NEWTON || update > UPDATE_BROYDEN || jacobian < JACOBIAN_DIFFERENCE || jacobian > JACOBIAN_DUAL) {
+            fprintf(stderr, "line %d: usage: system <v1>,...,<vn> <f1> ... <fn> <n starting values> [update] [jacobian], "
+                    "update %d to %d, jacobian %d to %d\n", number, UPDATE_NEWTON, UPDATE_BROYDEN, JACOBIAN_DIFFERENCE, JACOBIAN_DUAL);
+            return -1;
+        }
+
+        Expr* equations = (Expr*) malloc(n * sizeof(Expr));
+        SystemResult_d result;
+        for (int i = 0; i < n; i++) {
+            if (reportCompile(compileMultivariate(funcs[i], names, n, &equations[i]), funcs[i], number) != 0) {
+                while (i-- > 0) {
+                    freeExpr(&equations[i]);
+                }
+                free(equations);
+                return -1;
+            }
+        }
+        status = newton_system_d(n, equations, x, (int) jacobian, (int) update, 1e-12, 0, &result);
+        if (status == -2) {
+            fprintf(stderr, "line %d: the Jacobian is singular\n", number);
+        } else {
+            printf("%s residual=%.3g iterations=%d evaluations=%d jacobians=%d%s", method, result.residual, result.iterations,
+                   result.evaluations, result.jacobians, status ? " not-converged" : "");
+            printVector(x, n);
+        }
+        for (int i = 0; i < n; i++) {
+            freeExpr(&equations[i]);
+        }
+        free(equations);
+        return status;
+    }
+
+    if (!strcmp(method, "ridders")) {
+        char* func = strtok(NULL, " \t\r\n");
+        double x = 0, order = 1;
+        Derivative_d result;
+        Expr expr;
+
+        if (func == NULL || nextNumber(&x) != 1 || nextNumber(&order) < 0 || order < 1 || order > MAX_DERIVATIVE) {
+            fprintf(stderr, "line %d: usage: ridders <f> <x> [order], order 1 to %d\n", number, MAX_DERIVATIVE);
+            return -1;
+        }
+        if (reportCompile(compileExpression(func, &expr), func, number) != 0) {
+            return -1;
+        }
+        ridders_derivative_d(&expr, x, (int) order, &result);
+        printf("%s %.15g error=%.3g evaluations=%d\n", method, result.value, result.error, result.evaluations);
+        freeExpr(&expr);
+        return 0;
+    }
+
+    int quadrature = !strcmp(method, "simpson") || !strcmp(method, "simpson38") || !strcmp(method, "trapezoid")
+                     || !strcmp(method, "kronrod") || !strcmp(method, "romberg");
+
+    if (root || quadrature || !strcmp(method, "derivative")) {
+        char* func = strtok(NULL, " \t\r\n");
+        double a = 0, b = 0, option = 0;
+        Expr expr;
+
+        if (func == NULL || nextNumber(&a) != 1 || (strcmp(method, "newton") && strcmp(method, "derivative") && nextNumber(&b) != 1)
+            || nextNumber(&option) < 0) {
+            fprintf(stderr, "line %d: usage: %s <f> <a> [<b>] [option]\n", number, method);
+            return -1;
+        }
+        if (reportCompile(compileExpression(func, &expr), func, number) != 0) {
+            return -1;
+        }
+
+        if (root) {
+            RootResult_d result = {0};
+            if (!strcmp(method, "bisection")) {
+                status = bisection_d(a, b, &expr, option, 0, &result);
+            } else if (!strcmp(method, "regula-falsi")) {
+                status = regula_falsi_d(a, b, &expr, option, 0, &result);
+            } else if (!strcmp(method, "brent")) {
+                status = brent_d(a, b, &expr, option, 0, &result);
+            } else {
+                status = newton_raphson_d(a, 0, &expr, option, 0, &result);
+            }
+            printf("%s %.15g f=%.3g iterations=%d evaluations=%d%s\n", method, result.root, result.value,
+                   result.iterations, result.evaluations, status ? " not-converged" : "");
+        } else if (!strcmp(method, "kronrod") || !strcmp(method, "romberg")) {
+            Quadrature_d result;
+            double tolerance = (option > 0) ? option : 1e-10;
+            if (!strcmp(method, "kronrod")) {
+                status = gauss_kronrod_d(a, b, &expr, tolerance, tolerance, 1000, &result);
+            } else {
+                status = romberg_d(a, b, &expr, tolerance, tolerance, 25, &result);
+            }
+            printf("%s %.15g error=%.3g evaluations=%d%s\n", method, result.value, result.error,
+                   result.evaluations, status ? " not-converged" : "");
+        } else if (!strcmp(method, "trapezoid")) {
+            printf("%s %.15g\n", method, trapezoidal_d(a, b, &expr));
+        } else if (!strcmp(method, "derivative")) {
+            double slope = 0;
+            if (option == 4) {
+                evalDual_d(&expr, a, &slope);
+            } else {
+                slope = finite_difference_d(&expr, a, (option > 0) ? (int) option : 3);
+            }
+            printf("%s %.15g\n", method, slope);
+        } else {
+            printf("%s %.15g\n", method, simpsons_rule_d(a, b, &expr, strcmp(method, "simpson") ? 2 : 1));
+        }
+
+        freeExpr(&expr);
+        return status;
+    }
+
+    int interpolate = !strcmp(method, "interpolate") || !strcmp(method, "barycentric") || !strcmp(method, "spline");
+    if (strcmp(method, "inverse") && strcmp(method, "solve") && strcmp(method, "seidel") && !interpolate) {
+        fprintf(stderr, "line %d: unknown job: %s\n", number, method);
+        return -1;
+    }
+
+    int square = !strcmp(method, "inverse");
+    char* field = strtok(NULL, " \t\r\n");
+    MatrixData loaded = {0};
+    double* data = NULL;
+    int n = 0;
+
+    if (field != NULL && field[0] == '@') {
+        if (loadMatrix(field + 1, &loaded) != 0) {
+            fprintf(stderr, "line %d: cannot read %s\n", number, field + 1);
+            return -1;
+        }
+        n = loaded.rows;
+        int cols = interpolate ? 2 : (square ? n : n + 1);
+        if (loaded.cols != cols) {
+            fprintf(stderr, "line %d: %s is %dx%d, expected %d columns\n", number, field + 1, loaded.rows, loaded.cols, cols);
+            freeMatrix(&loaded);
+            return -1;
+        }
+        data = widenMatrix(&loaded);
+    } else {
+        char* end = NULL;
+        double size = (field != NULL) ? strtod(field, &end) : 0;
+        if (field == NULL || *end != '\0' || size < 1) {
+            fprintf(stderr, "line %d: usage: %s <n> <data> | @<file>\n", number, method);
+            return -1;
+        }
+        n = (int) size;
+        int count = interpolate ? 2*n : (square ? n*n : n*(n+1));
+        data = (double*) malloc(count * sizeof(double));
+        if (!nextNumbers(data, count)) {
+            fprintf(stderr, "line %d: expected %d numbers\n", number, count);
+            free(data);
+            return -1;
+        }
+    }
+
+    double* solution = (double*) calloc(square ? (size_t) n*n : (size_t) n, sizeof(double));
+
+    if (interpolate) {
+        NewtonPoly_d poly;
+        Barycentric_d barycentric;
+        Spline_d spline;
+        double* values = NULL;
+        int count = 0;
+        int read = 0;
+        double value = 0;
+
+        if (loaded.data != NULL) {
+            /* The file holds (x, y) rows; the job line holds all x, then all y. */
+            for (int i = 0; i < n; i++) {
+                solution[i] = data[2*i + 1];
+                data[i] = data[2*i];
+            }
+            memcpy(data + n, solution, n * sizeof(double));
+        }
+        while ((read = nextNumber(&value)) == 1) {
+            values = (double*) realloc(values, (count + 1) * sizeof(double));
+            values[count++] = value;
+        }
+        if (count == 0 || read < 0) {
+            fprintf(stderr, "line %d: missing or malformed points to interpolate at\n", number);
+            status = -1;
+        } else {
+            if (!strcmp(method, "spline")) {
+                status = spline_fit_d(&spline, n, data, data + n);
+                if (status == 0) {
+                    spline_eval_batch_d(&spline, values, values, count);
+                    spline_free_d(&spline);
+                }
+            } else if (!strcmp(method, "barycentric")) {
+                status = barycentric_fit_d(&barycentric, n, data, data + n, -1);
+                if (status == 0) {
+                    barycentric_eval_batch_d(&barycentric, values, values, count);
+                    barycentric_free_d(&barycentric);
+                }
+            } else {
+                status = newton_fit_d(&poly, n, data, data + n);
+                if (status == 0) {
+                    newton_eval_batch_d(&poly, values, values, count);
+                    newton_free_d(&poly);
+                }
+            }
+            if (status == 0) {
+                printf("%s", method);
+                printVector(values, count);
+            } else {
+                fprintf(stderr, "line %d: the x values must be %s\n", number, strcmp(method, "interpolate") ? "increasing" : "distinct");
+            }
+        }
+        free(values);
+    } else if (square) {
+        status = invert_matrix_d(n, data, solution);
+        if (status == 0) {
+            printf("%s", method);
+            printVector(solution, n*n);
+        } else {
+            fprintf(stderr, "line %d: the matrix is singular\n", number);
+        }
+    } else if (!strcmp(method, "solve")) {
+        status = gauss_solve_d(n, data, solution);
+        if (status == 0) {
+            printf("%s", method);
+            printVector(solution, n);
+        } else {
+            fprintf(stderr, "line %d: the matrix is singular\n", number);
+        }
+    } else {
+        double omega = 1;
+        double* rhs = (double*) malloc(n * sizeof(double));
+        CSRMatrix_d A;
+
+        if (nextNumber(&omega) < 0) {
+            omega = 1;
+        }
+        for (int i = 0; i < n; i++) {
+            rhs[i] = data[(size_t) i*(n+1) + n];
+        }
+        csr_from_dense_d(&A, n, n, data, n+1);
+        int sweeps = sor_solve_d(&A, rhs, solution, omega, 1e-12, 10000);
+        csr_free_d(&A);
+        free(rhs);
+
+        status = (sweeps < 0) ? -1 : 0;
+        printf("%s sweeps=%d%s", method, sweeps, status ? " not-converged" : "");
+        printVector(solution, n);
+    }
+
+    if (data != loaded.data) {
+        free(data);
+    }
+    freeMatrix(&loaded);
+    free(solution);
+    return status;
+}
+
+/* The batch jobs run in double: double data is used in place, float data is widened into a heap copy. */
+double* widenMatrix(MatrixData* matrix) {
+    if (matrix->elementSize == MATRIX_DOUBLE) {
+        return (double*) matrix->data;
+    }
+
+    size_t count = (size_t) matrix->rows * matrix->cols;
+    double* wide = (double*) malloc((count > 0 ? count : 1) * sizeof(double));
+    for (size_t i = 0; i < count; i++) {
+        wide[i] = ((float*) matrix->data)[i];
+    }
+    return wide;
+}
+
+/* Reports a failed compileExpression or compileMultivariate of func on stderr. Returns status. */
+int reportCompile(int status, const char* func, int number) {
+    if (status != 0) {
+        fprintf(stderr, "line %d: %s: %s\n", number, func, compileError(status));
+    }
+    return status;
+}
+
+/* Parses the next field of the current job line. Returns 1, 0 if there is none, or -1 if it is not a number. */
+int nextNumber(double* value) {
+    char* token = strtok(NULL, " \t\r\n");
+    char* end;
+
+    if (token == NULL) {
+        return 0;
+    }
+    *value = strtod(token, &end);
+    return (*end == '\0') ? 1 : -1;
+}
+
+int nextNumbers(double* values, int count) {
+    for (int i = 0; i < count; i++) {
+        if (nextNumber(&values[i]) != 1) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void printVector(const double* values, int count) {
+    for (int i = 0; i < count; i++) {
+        printf(" %.15g", values[i]);
+    }
+    printf("\n");
+}
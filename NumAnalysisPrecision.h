@@ -0,0 +1,41 @@
+/*
+ * Instantiates NumAnalysisScalar.h for float, double and long double.
+ * NumAnalysis.h includes this for the types and prototypes; NumAnalysis.c
+ * includes it again with SCALAR_DEFINITIONS for the code.
+ */
+
+#define SCALAR float
+#define SFX
+#define MATH(name) name##f
+#define SCALAR_WIDE double
+#define SCALAR_PI M_PI
+#define SCALAR_CONST(instr) ((instr)->value)
+#define SCALAR_EPSILON EPSILON
+#define SCALAR_STEP h
+#define SCALAR_MACHEPS FLT_EPSILON
+#define SCALAR_IS_FLOAT 1
+#include "NumAnalysisScalar.h"
+
+#define SCALAR double
+#define SFX _d
+#define MATH(name) name
+#define SCALAR_WIDE double
+#define SCALAR_PI M_PI
+#define SCALAR_CONST(instr) ((double) (instr)->wide)
+#define SCALAR_EPSILON 1e-12
+#define SCALAR_STEP 1e-7
+#define SCALAR_MACHEPS DBL_EPSILON
+#define SCALAR_IS_FLOAT 0
+#include "NumAnalysisScalar.h"
+
+#define SCALAR long double
+#define SFX _ld
+#define MATH(name) name##l
+#define SCALAR_WIDE long double
+#define SCALAR_PI PI_L
+#define SCALAR_CONST(instr) ((instr)->wide)
+#define SCALAR_EPSILON 1e-15L
+#define SCALAR_STEP 1e-9L
+#define SCALAR_MACHEPS LDBL_EPSILON
+#define SCALAR_IS_FLOAT 0
+#include "NumAnalysisScalar.h"
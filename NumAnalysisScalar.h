@@ -0,0 +1,3116 @@
+/*
+ * Precision-generic numeric core. NumAnalysis.c includes this file once per
+ * scalar type after defining:
+ *
+ *   SCALAR           element type (float, double, long double)
+ *   SFX              suffix for every generated name (empty, _d, _ld)
+ *   MATH(name)       libm routine for SCALAR (sinf, sin, sinl, ...)
+ *   SCALAR_WIDE      type the degree-to-radian conversion is done in
+ *   SCALAR_PI        pi as a SCALAR_WIDE constant
+ *   SCALAR_CONST(i)  constant of an Instr at this precision
+ *   SCALAR_EPSILON   default convergence tolerance of the root finders
+ *   SCALAR_STEP      finite-difference step used by derive
+ *   SCALAR_MACHEPS   machine epsilon of SCALAR
+ *   SCALAR_IS_FLOAT  1 for the float instantiation, which keeps the JIT and
+ *                    the SIMD sin/cos kernel
+ *
+ * Without SCALAR_DEFINITIONS only the public types and prototypes are
+ * emitted (NumAnalysis.h); with it, the code (NumAnalysis.c). See
+ * NumAnalysisPrecision.h for the three instantiations. There is deliberately
+ * no include guard; everything is #undef'd at the end.
+ */
+
+#define NAME(name) CAT(name, SFX)
+
+#ifndef SCALAR_DEFINITIONS
+
+/* One row of a root finder's iteration table: bracket a, b and the new estimate c with f(c). */
+typedef struct {
+    SCALAR a;
+    SCALAR b;
+    SCALAR c;
+    SCALAR fc;
+} NAME(Iteration);
+
+/*
+ * Outcome of a root finder. history is optional and caller-owned: when not
+ * NULL, the first historyCapacity iterations are recorded there.
+ */
+typedef struct {
+    SCALAR root;
+    SCALAR value;
+    int iterations;
+    int evaluations;
+    NAME(Iteration)* history;
+    int historyCapacity;
+} NAME(RootResult);
+
+/* Result of ridders_derivative: the estimate, its error estimate and the evaluations spent. */
+typedef struct {
+    SCALAR value;
+    SCALAR error;
+    int evaluations;
+} NAME(Derivative);
+
+/* Result of an adaptive integration. */
+typedef struct {
+    SCALAR value;
+    SCALAR error;
+    int evaluations;
+    int intervals;
+} NAME(Quadrature);
+
+/*
+ * LU factorization with partial pivoting, PA = LU, stored in place: the unit
+ * lower triangle holds L and the upper triangle U. Rows are padded to a
+ * whole number of cache lines and the storage is 64-byte aligned.
+ */
+typedef struct {
+    int n;
+    int stride;
+    SCALAR* data;
+    int* pivots;
+} NAME(LUFactor);
+
+/* Outcome of newton_system. residual is max |F_i| at the returned point. */
+typedef struct {
+    SCALAR residual;
+    int iterations;
+    int evaluations;
+    int jacobians;
+} NAME(SystemResult);
+
+/*
+ * Newton form of the polynomial through count points: coefficients[k] is
+ * the divided difference f[x_0, ..., x_k]. Built once by newton_fit and
+ * owned until newton_free; evaluation only reads it, so one fit can be
+ * queried from several threads.
+ */
+typedef struct {
+    int count;
+    SCALAR* nodes;
+    SCALAR* coefficients;
+} NAME(NewtonPoly);
+
+/*
+ * Barycentric rational interpolant through count points with increasing
+ * abscissae (Floater-Hormann, blending degree `degree`): degree count - 1
+ * is the interpolating polynomial in Lagrange's barycentric form, smaller
+ * degrees stay well behaved on equally spaced points. Owned until
+ * barycentric_free.
+ */
+typedef struct {
+    int count;
+    int degree;
+    SCALAR* nodes;
+    SCALAR* values;
+    SCALAR* weights;
+} NAME(Barycentric);
+
+/*
+ * Natural cubic spline through count knots. coefficients holds y, b, c, d
+ * for each of the count - 1 intervals, p(t) = y + t(b + t(c + t d)) with t
+ * the distance to the interval's left knot. uniform is set when the knots
+ * are equally spaced, inverseStep being their inverse spacing from start.
+ */
+typedef struct {
+    int count;
+    int uniform;
+    SCALAR start;
+    SCALAR inverseStep;
+    SCALAR* knots;
+    SCALAR* coefficients;
+} NAME(Spline);
+
+/*
+ * Compressed sparse row matrix. Row i owns entries rowStart[i] up to
+ * rowStart[i+1] of cols/values; diag[i] is the position of its diagonal
+ * entry, or -1 if the row has none.
+ */
+typedef struct {
+    int rows;
+    int nnz;
+    int* rowStart;
+    int* cols;
+    SCALAR* values;
+    int* diag;
+} NAME(CSRMatrix);
+
+SCALAR NAME(powi)(SCALAR base, int n);
+SCALAR NAME(evalExpr)(Expr* expr, SCALAR x);
+SCALAR NAME(evalBound)(Expr* expr, const SCALAR* bindings);
+void NAME(evalBatch)(Expr* expr, const SCALAR* xs, SCALAR* out, size_t n);
+void NAME(evalBoundBatch)(Expr* expr, const SCALAR* bindings, int slot, const SCALAR* xs, SCALAR* out, size_t n);
+int NAME(evalGrid)(Expr* expr, const SCALAR* bindings, int dims, const int* slots, const SCALAR* const* axes, const int* sizes, SCALAR* out);
+SCALAR NAME(derive)(Expr* expr, SCALAR x);
+SCALAR NAME(evalDual)(Expr* expr, SCALAR x, SCALAR* slope);
+SCALAR NAME(evalBoundDual)(Expr* expr, const SCALAR* bindings, int slot, SCALAR* slope);
+int NAME(evalTaylor)(Expr* expr, SCALAR x, int order, SCALAR* coefficients);
+int NAME(bisection)(SCALAR a, SCALAR b, Expr* expr, SCALAR tolerance, int maxIterations, NAME(RootResult)* result);
+int NAME(regula_falsi)(SCALAR a, SCALAR b, Expr* expr, SCALAR tolerance, int maxIterations, NAME(RootResult)* result);
+int NAME(newton_raphson)(SCALAR a, SCALAR b, Expr* expr, SCALAR tolerance, int maxIterations, NAME(RootResult)* result);
+int NAME(brent)(SCALAR a, SCALAR b, Expr* expr, SCALAR tolerance, int maxIterations, NAME(RootResult)* result);
+int NAME(find_all_roots)(SCALAR a, SCALAR b, Expr* expr, int samples, SCALAR tolerance, SCALAR* roots, int maxRoots, int* evaluations);
+SCALAR NAME(finite_difference)(Expr* expr, SCALAR x, int method);
+int NAME(ridders_derivative)(Expr* expr, SCALAR x, int order, NAME(Derivative)* result);
+int NAME(ridders_batch)(Expr* expr, const SCALAR* xs, size_t n, int order, SCALAR* values, SCALAR* errors);
+SCALAR NAME(newton_interpolate)(int count, const SCALAR* x, const SCALAR* y, SCALAR value);
+int NAME(newton_fit)(NAME(NewtonPoly)* poly, int count, const SCALAR* x, const SCALAR* y);
+SCALAR NAME(newton_eval)(const NAME(NewtonPoly)* poly, SCALAR value);
+void NAME(newton_eval_batch)(const NAME(NewtonPoly)* poly, const SCALAR* values, SCALAR* out, size_t n);
+void NAME(newton_free)(NAME(NewtonPoly)* poly);
+int NAME(barycentric_fit)(NAME(Barycentric)* fit, int count, const SCALAR* x, const SCALAR* y, int degree);
+SCALAR NAME(barycentric_eval)(const NAME(Barycentric)* fit, SCALAR value);
+void NAME(barycentric_eval_batch)(const NAME(Barycentric)* fit, const SCALAR* values, SCALAR* out, size_t n);
+void NAME(barycentric_free)(NAME(Barycentric)* fit);
+int NAME(spline_fit)(NAME(Spline)* spline, int count, const SCALAR* x, const SCALAR* y);
+SCALAR NAME(spline_eval)(const NAME(Spline)* spline, SCALAR value);
+void NAME(spline_eval_batch)(const NAME(Spline)* spline, const SCALAR* values, SCALAR* out, size_t n);
+void NAME(spline_free)(NAME(Spline)* spline);
+SCALAR NAME(simpsons_rule)(SCALAR a, SCALAR b, Expr* expr, int method);
+SCALAR NAME(trapezoidal)(SCALAR a, SCALAR b, Expr* expr);
+int NAME(gauss_kronrod)(SCALAR a, SCALAR b, Expr* expr, SCALAR absTol, SCALAR relTol, int maxIntervals, NAME(Quadrature)* result);
+int NAME(integrate_batch)(Expr* expr, int count, const SCALAR* bounds, SCALAR absTol, SCALAR relTol, int maxIntervals, SCALAR* values, SCALAR* errors, int* evaluations);
+int NAME(romberg)(SCALAR a, SCALAR b, Expr* expr, SCALAR absTol, SCALAR relTol, int maxLevels, NAME(Quadrature)* result);
+int NAME(lu_factor)(NAME(LUFactor)* lu, int n, const SCALAR* matrix, int lda);
+void NAME(lu_solve)(NAME(LUFactor)* lu, SCALAR* rhs, int nrhs);
+void NAME(lu_free)(NAME(LUFactor)* lu);
+int NAME(gauss_solve)(int n, SCALAR* matrix, SCALAR* solution);
+int NAME(invert_matrix)(int n, SCALAR* matrix, SCALAR* inverse);
+int NAME(newton_system)(int n, Expr* equations, SCALAR* x, int jacobian, int update, SCALAR tolerance, int maxIterations, NAME(SystemResult)* result);
+void NAME(csr_alloc)(NAME(CSRMatrix)* csr, int rows, int nnz);
+void NAME(csr_find_diagonal)(NAME(CSRMatrix)* csr);
+void NAME(csr_from_dense)(NAME(CSRMatrix)* csr, int rows, int cols, const SCALAR* matrix, int lda);
+void NAME(csr_from_triplets)(NAME(CSRMatrix)* csr, int rows, int nnz, const int* rowIndex, const int* colIndex, const SCALAR* values);
+void NAME(csr_free)(NAME(CSRMatrix)* csr);
+int NAME(sor_solve)(NAME(CSRMatrix)* A, const SCALAR* b, SCALAR* x, SCALAR omega, SCALAR tolerance, int maxIterations);
+int NAME(sparse_gauss_seidel)(NAME(CSRMatrix)* A, const SCALAR* b, SCALAR* x, SCALAR tolerance, int maxIterations);
+int NAME(csr_color)(NAME(CSRMatrix)* A, int* colors);
+int NAME(parallel_relax)(NAME(CSRMatrix)* A, const SCALAR* b, SCALAR* x, int mode, SCALAR omega, SCALAR tolerance, int maxIterations);
+
+#else
+
+SCALAR NAME(eval_exp)(SCALAR a, SCALAR b) { return MATH(pow)(a, b); }
+SCALAR NAME(eval_add)(SCALAR a, SCALAR b) { return a+b; }
+SCALAR NAME(eval_sub)(SCALAR a, SCALAR b) { return a-b; }
+SCALAR NAME(eval_mult)(SCALAR a, SCALAR b) { return a*b; }
+SCALAR NAME(eval_div)(SCALAR a, SCALAR b) { return a/b; }
+SCALAR NAME(eval_log)(SCALAR a, SCALAR b) { return MATH(log10)(a)/MATH(log10)(b); }
+
+SCALAR NAME(powi)(SCALAR base, int n) {
+    unsigned int m = (n < 0) ? -n : n;
+    SCALAR result = 1;
+    while (m) {
+        if (m & 1) {
+            result *= base;
+        }
+        base *= base;
+        m >>= 1;
+    }
+    return (n < 0) ? 1/result : result;
+}
+
+SCALAR NAME(eval_sin)(SCALAR angle) { return MATH(sin)(angle); }
+SCALAR NAME(eval_cos)(SCALAR angle) { return MATH(cos)(angle); }
+SCALAR NAME(eval_tan)(SCALAR angle) { return MATH(tan)(angle); }
+SCALAR NAME(eval_csc)(SCALAR angle) { return 1/MATH(sin)(angle); }
+SCALAR NAME(eval_sec)(SCALAR angle) { return 1/MATH(cos)(angle); }
+SCALAR NAME(eval_cot)(SCALAR angle) { return 1/MATH(tan)(angle); }
+SCALAR NAME(eval_arcsin)(SCALAR angle) { return MATH(asin)(angle); }
+SCALAR NAME(eval_arccos)(SCALAR angle) { return MATH(acos)(angle); }
+SCALAR NAME(eval_arctan)(SCALAR angle) { return MATH(atan)(angle); }
+SCALAR NAME(eval_exp1)(SCALAR val) { return MATH(exp)(val); }
+SCALAR NAME(eval_ln)(SCALAR val) { return MATH(log)(val); }
+SCALAR NAME(eval_sqrt)(SCALAR val) { return MATH(sqrt)(val); }
+SCALAR NAME(eval_abs)(SCALAR val) { return MATH(fabs)(val); }
+SCALAR NAME(eval_sinh)(SCALAR val) { return MATH(sinh)(val); }
+SCALAR NAME(eval_cosh)(SCALAR val) { return MATH(cosh)(val); }
+SCALAR NAME(eval_tanh)(SCALAR val) { return MATH(tanh)(val); }
+
+/* Registered functions may only provide the float version; widen its result. */
+SCALAR NAME(applyFunction)(Function* function, SCALAR val) {
+#if SCALAR_IS_FLOAT
+    return function->func(val);
+#else
+    if (function->NAME(func) != NULL) {
+        return function->NAME(func)(val);
+    }
+    return (SCALAR) function->func((float) val);
+#endif
+}
+
+/* Fills bindings with the values setVariable gave expr's slots; slot 0, the free variable, is zeroed for the caller to set. */
+void NAME(loadBindings)(Expr* expr, SCALAR* bindings) {
+    bindings[0] = 0;
+    for (int k = 1; k < expr->variables; k++) {
+        bindings[k] = (SCALAR) expr->values[k];
+    }
+}
+
+SCALAR NAME(evalExpr)(Expr* expr, SCALAR x) {
+#if SCALAR_IS_FLOAT
+    if (expr->native != NULL) {
+        return expr->native(x);
+    }
+#endif
+
+    if (expr->variables <= 1) {
+        return NAME(evalBound)(expr, &x);
+    }
+    SCALAR bindings[expr->variables];
+    NAME(loadBindings)(expr, bindings);
+    bindings[0] = x;
+    return NAME(evalBound)(expr, bindings);
+}
+
+/* Evaluates expr with variable slot k bound to bindings[k]. */
+SCALAR NAME(evalBound)(Expr* expr, const SCALAR* bindings) {
+    SCALAR stack[expr->depth];
+    SCALAR saved[expr->slots + 1];
+    int top = -1;
+
+    for (Instr* instr = expr->code, *end = expr->code + expr->length; instr < end; instr++) {
+        switch (instr->op) {
+            case OP_CONST:
+                stack[++top] = SCALAR_CONST(instr);
+                break;
+            case OP_STORE:
+                saved[instr->index] = stack[top];
+                break;
+            case OP_LOAD:
+                stack[++top] = saved[instr->index];
+                break;
+            case OP_VAR:
+                stack[++top] = bindings[instr->index];
+                break;
+            case OP_ADD:
+                top--;
+                stack[top] += stack[top+1];
+                break;
+            case OP_SUB:
+                top--;
+                stack[top] -= stack[top+1];
+                break;
+            case OP_MUL:
+                top--;
+                stack[top] *= stack[top+1];
+                break;
+            case OP_DIV:
+                top--;
+                stack[top] /= stack[top+1];
+                break;
+            case OP_POWI:
+                stack[top] = NAME(powi)(stack[top], instr->exponent);
+                break;
+            case OP_BINARY:
+                top--;
+#if SCALAR_IS_FLOAT
+                stack[top] = instr->binary(stack[top], stack[top+1]);
+#else
+                stack[top] = operators[instr->index].NAME(func)(stack[top], stack[top+1]);
+#endif
+                break;
+            case OP_UNARY:
+                stack[top] = NAME(applyFunction)(&functions[instr->index], stack[top]);
+                break;
+            case OP_UNARY_DEG:
+                stack[top] = NAME(applyFunction)(&functions[instr->index], (SCALAR) (stack[top] * SCALAR_PI / 180));
+                break;
+            case OP_LOGBASE:
+                stack[top] = NAME(eval_log)(stack[top], SCALAR_CONST(instr));
+                break;
+        }
+    }
+
+    return stack[0];
+}
+
+void NAME(batchPowi)(SCALAR* vals, int count, int n) {
+    SCALAR result[BATCH_BLOCK];
+    unsigned int m = (n < 0) ? -n : n;
+
+    for (int i = 0; i < count; i++) { result[i] = 1; }
+    while (m) {
+        if (m & 1) {
+            for (int i = 0; i < count; i++) { result[i] *= vals[i]; }
+        }
+        m >>= 1;
+        if (m) {
+            for (int i = 0; i < count; i++) { vals[i] *= vals[i]; }
+        }
+    }
+
+    if (n < 0) {
+        for (int i = 0; i < count; i++) { vals[i] = 1 / result[i]; }
+    } else {
+        memcpy(vals, result, count * sizeof(SCALAR));
+    }
+}
+
+/* Evaluates the expression at the n points xs of its free variable. */
+void NAME(evalBatch)(Expr* expr, const SCALAR* xs, SCALAR* out, size_t n) {
+    SCALAR bindings[expr->variables + 1];
+
+    NAME(loadBindings)(expr, bindings);
+    NAME(evalBoundBatch)(expr, bindings, 0, xs, out, n);
+}
+
+/*
+ * Evaluates the expression at n points, with variable slot `slot` taking
+ * the values xs and every other slot k fixed at bindings[k]. Each
+ * instruction is applied to a whole block of BATCH_BLOCK points at a time,
+ * so the inner loops are simple enough for the compiler to vectorize and
+ * the interpreter dispatch cost is paid once per block instead of once per
+ * point.
+ */
+void NAME(evalBoundBatch)(Expr* expr, const SCALAR* bindings, int slot, const SCALAR* xs, SCALAR* out, size_t n) {
+    SCALAR stack[expr->depth][BATCH_BLOCK];
+    SCALAR saved[expr->slots + 1][BATCH_BLOCK];
+
+    for (size_t start = 0; start < n; start += BATCH_BLOCK) {
+        int count = (n - start < BATCH_BLOCK) ? (int) (n - start) : BATCH_BLOCK;
+        const SCALAR* x = xs + start;
+        int top = -1;
+
+        for (Instr* instr = expr->code, *end = expr->code + expr->length; instr < end; instr++) {
+            SCALAR* a;
+            SCALAR* b;
+
+            switch (instr->op) {
+                case OP_CONST:
+                    a = stack[++top];
+                    for (int i = 0; i < count; i++) { a[i] = SCALAR_CONST(instr); }
+                    break;
+                case OP_VAR:
+                    a = stack[++top];
+                    if (instr->index == slot) {
+                        for (int i = 0; i < count; i++) { a[i] = x[i]; }
+                    } else {
+                        for (int i = 0; i < count; i++) { a[i] = bindings[instr->index]; }
+                    }
+                    break;
+                case OP_STORE:
+                    memcpy(saved[instr->index], stack[top], count * sizeof(SCALAR));
+                    break;
+                case OP_LOAD:
+                    memcpy(stack[++top], saved[instr->index], count * sizeof(SCALAR));
+                    break;
+                case OP_ADD:
+                    b = stack[top--];
+                    a = stack[top];
+                    for (int i = 0; i < count; i++) { a[i] += b[i]; }
+                    break;
+                case OP_SUB:
+                    b = stack[top--];
+                    a = stack[top];
+                    for (int i = 0; i < count; i++) { a[i] -= b[i]; }
+                    break;
+                case OP_MUL:
+                    b = stack[top--];
+                    a = stack[top];
+                    for (int i = 0; i < count; i++) { a[i] *= b[i]; }
+                    break;
+                case OP_DIV:
+                    b = stack[top--];
+                    a = stack[top];
+                    for (int i = 0; i < count; i++) { a[i] /= b[i]; }
+                    break;
+                case OP_POWI:
+                    a = stack[top];
+                    NAME(batchPowi)(a, count, instr->exponent);
+                    break;
+                case OP_BINARY:
+                    b = stack[top--];
+                    a = stack[top];
+#if SCALAR_IS_FLOAT
+                    for (int i = 0; i < count; i++) { a[i] = instr->binary(a[i], b[i]); }
+#else
+                    for (int i = 0; i < count; i++) { a[i] = operators[instr->index].NAME(func)(a[i], b[i]); }
+#endif
+                    break;
+                case OP_UNARY:
+                case OP_UNARY_DEG: {
+                    Function* function = &functions[instr->index];
+                    SCALAR_WIDE scale = (instr->op == OP_UNARY_DEG) ? SCALAR_PI / 180 : 1;
+                    a = stack[top];
+#if SCALAR_IS_FLOAT
+                    if (function->func == eval_sin || function->func == eval_cos) {
+                        batchSinCos(a, count, scale, function->func == eval_cos);
+                        break;
+                    }
+#endif
+                    for (int i = 0; i < count; i++) { a[i] = NAME(applyFunction)(function, (SCALAR) (a[i] * scale)); }
+                    break;
+                }
+                case OP_LOGBASE:
+                    a = stack[top];
+                    for (int i = 0; i < count; i++) { a[i] = NAME(eval_log)(a[i], SCALAR_CONST(instr)); }
+                    break;
+            }
+        }
+
+        memcpy(out + start, stack[0], count * sizeof(SCALAR));
+    }
+}
+
+typedef struct {
+    Expr* expr;
+    const SCALAR* bindings;
+    int dims;
+    const int* slots;
+    const SCALAR* const* axes;
+    const int* sizes;
+    SCALAR* out;
+} NAME(GridSweep);
+
+/* Evaluates grid rows [lo, hi): the row number fixes every swept variable but the last, which runs as one batch. */
+void NAME(gridRows)(void* ctx, int lo, int hi) {
+    NAME(GridSweep)* c = (NAME(GridSweep)*) ctx;
+    int last = c->dims - 1;
+    int count = (c->expr->variables > 1) ? c->expr->variables : 1;
+    SCALAR bindings[count];
+
+    memcpy(bindings, c->bindings, count * sizeof(SCALAR));
+    for (int row = lo; row < hi; row++) {
+        int rest = row;
+        for (int k = last - 1; k >= 0; k--) {
+            bindings[c->slots[k]] = c->axes[k][rest % c->sizes[k]];
+            rest /= c->sizes[k];
+        }
+        NAME(evalBoundBatch)(c->expr, bindings, c->slots[last], c->axes[last], c->out + (size_t) row * c->sizes[last], c->sizes[last]);
+    }
+}
+
+/*
+ * Evaluates expr on the Cartesian product of dims axes: axis k sweeps
+ * variable slot slots[k] (see lookupVariable) through the sizes[k] values
+ * axes[k]. Every other slot keeps its value in bindings, one per slot, or
+ * the value setVariable gave it when bindings is NULL. out receives one
+ * value per grid point, row-major with the last axis fastest. Rows are
+ * spread over the thread pool and each is evaluated as one batch. Returns
+ * 0, or -1 if dims < 1 or a slot is out of range.
+ */
+int NAME(evalGrid)(Expr* expr, const SCALAR* bindings, int dims, const int* slots, const SCALAR* const* axes, const int* sizes, SCALAR* out) {
+    int count = (expr->variables > 1) ? expr->variables : 1;
+    SCALAR fixed[count];
+    int rows = 1;
+
+    if (dims < 1) {
+        return -1;
+    }
+    for (int k = 0; k < dims; k++) {
+        if (slots[k] < 0 || slots[k] >= count) {
+            return -1;
+        }
+        if (sizes[k] <= 0) {
+            return 0;
+        }
+        if (k < dims - 1) {
+            rows *= sizes[k];
+        }
+    }
+
+    if (bindings != NULL) {
+        memcpy(fixed, bindings, count * sizeof(SCALAR));
+    } else {
+        NAME(loadBindings)(expr, fixed);
+    }
+
+    NAME(GridSweep) ctx = {expr, fixed, dims, slots, axes, sizes, out};
+    int rowLength = sizes[dims - 1];
+    parallelFor(0, rows, (rowLength >= 1024) ? 1 : 1024 / rowLength, NAME(gridRows), &ctx);
+    return 0;
+}
+
+SCALAR NAME(derive)(Expr* expr, SCALAR x) {
+    return (NAME(evalExpr)(expr, x+SCALAR_STEP) - NAME(evalExpr)(expr, x)) / SCALAR_STEP;
+}
+
+/*
+ * Slope of a built-in function at u given fu = f(u). A registered function
+ * with no known derivative gets a central difference of that function alone.
+ */
+SCALAR NAME(functionSlope)(Function* function, SCALAR u, SCALAR fu) {
+    float (*func)(float val) = function->func;
+
+    if (func == eval_sin) return MATH(cos)(u);
+    if (func == eval_cos) return -MATH(sin)(u);
+    if (func == eval_tan) return 1 + fu*fu;
+    if (func == eval_csc) return -fu / MATH(tan)(u);
+    if (func == eval_sec) return fu * MATH(tan)(u);
+    if (func == eval_cot) return -(1 + fu*fu);
+    if (func == eval_arcsin) return 1 / MATH(sqrt)(1 - u*u);
+    if (func == eval_arccos) return -1 / MATH(sqrt)(1 - u*u);
+    if (func == eval_arctan) return 1 / (1 + u*u);
+    if (func == eval_exp1) return fu;
+    if (func == eval_ln) return 1 / u;
+    if (func == eval_sqrt) return 1 / (2*fu);
+    if (func == eval_abs) return (u > 0) - (u < 0);
+    if (func == eval_sinh) return MATH(cosh)(u);
+    if (func == eval_cosh) return MATH(sinh)(u);
+    if (func == eval_tanh) return 1 - fu*fu;
+
+    /*
+     * Central difference with a step sized for the precision the function
+     * runs in, float unless it has a SCALAR version. The points are rounded
+     * to that precision, so the divisor is the step actually taken.
+     */
+#if SCALAR_IS_FLOAT
+    int single = 1;
+#else
+    int single = function->NAME(func) == NULL;
+#endif
+    SCALAR step = MATH(cbrt)(single ? FLT_EPSILON : SCALAR_MACHEPS) * (1 + MATH(fabs)(u));
+    SCALAR above = single ? (SCALAR) (float) (u + step) : u + step;
+    SCALAR below = single ? (SCALAR) (float) (u - step) : u - step;
+
+    return (NAME(applyFunction)(function, above) - NAME(applyFunction)(function, below)) / (above - below);
+}
+
+/*
+ * Evaluates expr over dual numbers: next to every stack value runs its
+ * derivative with respect to x, pushed through each instruction by the
+ * chain rule. Returns f(x) and stores f'(x) in *slope, exact up to
+ * rounding, for the price of a single pass.
+ */
+SCALAR NAME(evalDual)(Expr* expr, SCALAR x, SCALAR* slope) {
+    if (expr->variables <= 1) {
+        return NAME(evalBoundDual)(expr, &x, 0, slope);
+    }
+    SCALAR bindings[expr->variables];
+    NAME(loadBindings)(expr, bindings);
+    bindings[0] = x;
+    return NAME(evalBoundDual)(expr, bindings, 0, slope);
+}
+
+/* evalDual with variable slot k bound to bindings[k], differentiating with respect to slot `slot`. */
+SCALAR NAME(evalBoundDual)(Expr* expr, const SCALAR* bindings, int slot, SCALAR* slope) {
+    SCALAR value[expr->depth];
+    SCALAR dot[expr->depth];
+    SCALAR savedValue[expr->slots + 1];
+    SCALAR savedDot[expr->slots + 1];
+    int top = -1;
+
+    for (Instr* instr = expr->code, *end = expr->code + expr->length; instr < end; instr++) {
+        switch (instr->op) {
+            case OP_CONST:
+                value[++top] = SCALAR_CONST(instr);
+                dot[top] = 0;
+                break;
+            case OP_VAR:
+                value[++top] = bindings[instr->index];
+                dot[top] = (instr->index == slot);
+                break;
+            case OP_STORE:
+                savedValue[instr->index] = value[top];
+                savedDot[instr->index] = dot[top];
+                break;
+            case OP_LOAD:
+                value[++top] = savedValue[instr->index];
+                dot[top] = savedDot[instr->index];
+                break;
+            case OP_ADD:
+                top--;
+                value[top] += value[top+1];
+                dot[top] += dot[top+1];
+                break;
+            case OP_SUB:
+                top--;
+                value[top] -= value[top+1];
+                dot[top] -= dot[top+1];
+                break;
+            case OP_MUL:
+                top--;
+                dot[top] = dot[top] * value[top+1] + value[top] * dot[top+1];
+                value[top] *= value[top+1];
+                break;
+            case OP_DIV:
+                top--;
+                value[top] /= value[top+1];
+                dot[top] = (dot[top] - value[top] * dot[top+1]) / value[top+1];
+                break;
+            case OP_POWI: {
+                int n = instr->exponent;
+                dot[top] *= (n == 0) ? 0 : n * NAME(powi)(value[top], n - 1);
+                value[top] = NAME(powi)(value[top], n);
+                break;
+            }
+            case OP_BINARY: {
+                top--;
+                SCALAR a = value[top], b = value[top+1];
+                SCALAR da = dot[top], db = dot[top+1];
+                if (operators[instr->index].func == eval_log) {
+                    /* log(a)/log(b) */
+                    SCALAR lb = MATH(log)(b);
+                    value[top] = MATH(log)(a) / lb;
+                    dot[top] = (da/a - value[top] * db/b) / lb;
+                } else {
+                    value[top] = MATH(pow)(a, b);
+                    dot[top] = (db == 0) ? b * MATH(pow)(a, b - 1) * da : value[top] * (db * MATH(log)(a) + b * da/a);
+                }
+                break;
+            }
+            case OP_UNARY:
+            case OP_UNARY_DEG: {
+                Function* function = &functions[instr->index];
+                SCALAR_WIDE scale = (instr->op == OP_UNARY_DEG) ? SCALAR_PI / 180 : 1;
+                SCALAR u = (SCALAR) (value[top] * scale);
+                value[top] = NAME(applyFunction)(function, u);
+                dot[top] *= (SCALAR) (NAME(functionSlope)(function, u, value[top]) * scale);
+                break;
+            }
+            case OP_LOGBASE:
+                dot[top] /= value[top] * MATH(log)(SCALAR_CONST(instr));
+                value[top] = NAME(eval_log)(value[top], SCALAR_CONST(instr));
+                break;
+        }
+    }
+
+    *slope = dot[0];
+    return value[0];
+}
+
+/*
+ * Truncated Taylor series arithmetic for evalTaylor. A series of n terms
+ * holds the coefficients f(k)(x)/k! for k < n. Products are computed from
+ * the highest term down, so out may alias either operand; the quotient may
+ * overwrite its dividend but not its divisor. The others need distinct
+ * output arrays.
+ */
+void NAME(seriesMul)(const SCALAR* a, const SCALAR* b, SCALAR* out, int n) {
+    for (int k = n - 1; k >= 0; k--) {
+        SCALAR sum = 0;
+        for (int j = 0; j <= k; j++) {
+            sum += a[j] * b[k-j];
+        }
+        out[k] = sum;
+    }
+}
+
+void NAME(seriesDiv)(const SCALAR* a, const SCALAR* b, SCALAR* out, int n) {
+    for (int k = 0; k < n; k++) {
+        SCALAR sum = a[k];
+        for (int j = 0; j < k; j++) {
+            sum -= out[j] * b[k-j];
+        }
+        out[k] = sum / b[0];
+    }
+}
+
+void NAME(seriesExp)(const SCALAR* u, SCALAR* out, int n) {
+    out[0] = MATH(exp)(u[0]);
+    for (int k = 1; k < n; k++) {
+        SCALAR sum = 0;
+        for (int j = 1; j <= k; j++) {
+            sum += j * u[j] * out[k-j];
+        }
+        out[k] = sum / k;
+    }
+}
+
+void NAME(seriesLog)(const SCALAR* u, SCALAR* out, int n) {
+    out[0] = MATH(log)(u[0]);
+    for (int k = 1; k < n; k++) {
+        SCALAR sum = 0;
+        for (int j = 1; j < k; j++) {
+            sum += j * out[j] * u[k-j];
+        }
+        out[k] = (u[k] - sum / k) / u[0];
+    }
+}
+
+/* Sine and cosine of u together, or sinh and cosh when hyperbolic is set. */
+void NAME(seriesSinCos)(const SCALAR* u, SCALAR* s, SCALAR* c, int n, int hyperbolic) {
+    s[0] = hyperbolic ? MATH(sinh)(u[0]) : MATH(sin)(u[0]);
+    c[0] = hyperbolic ? MATH(cosh)(u[0]) : MATH(cos)(u[0]);
+    for (int k = 1; k < n; k++) {
+        SCALAR sumS = 0, sumC = 0;
+        for (int j = 1; j <= k; j++) {
+            sumS += j * u[j] * c[k-j];
+            sumC += j * u[j] * s[k-j];
+        }
+        s[k] = sumS / k;
+        c[k] = hyperbolic ? sumC / k : -sumC / k;
+    }
+}
+
+void NAME(seriesSqrt)(const SCALAR* u, SCALAR* out, int n) {
+    out[0] = MATH(sqrt)(u[0]);
+    for (int k = 1; k < n; k++) {
+        SCALAR sum = u[k];
+        for (int j = 1; j < k; j++) {
+            sum -= out[j] * out[k-j];
+        }
+        out[k] = sum / (2 * out[0]);
+    }
+}
+
+/* u^p for a constant p; needs u(x) != 0. */
+void NAME(seriesPow)(const SCALAR* u, SCALAR p, SCALAR* out, int n) {
+    out[0] = MATH(pow)(u[0], p);
+    for (int k = 1; k < n; k++) {
+        SCALAR sum = 0;
+        for (int j = 1; j <= k; j++) {
+            sum += ((p + 1) * j - k) * u[j] * out[k-j];
+        }
+        out[k] = sum / (k * u[0]);
+    }
+}
+
+/* u^m by repeated squaring; exact for u(x) = 0 too. */
+void NAME(seriesPowi)(const SCALAR* u, int m, SCALAR* out, int n) {
+    SCALAR base[n];
+    unsigned int bits = (m < 0) ? -m : m;
+
+    memcpy(base, u, n * sizeof(SCALAR));
+    for (int k = 0; k < n; k++) {
+        out[k] = (k == 0);
+    }
+    while (bits) {
+        if (bits & 1) {
+            NAME(seriesMul)(out, base, out, n);
+        }
+        bits >>= 1;
+        if (bits) {
+            NAME(seriesMul)(base, base, base, n);
+        }
+    }
+    if (m < 0) {
+        for (int k = 0; k < n; k++) {
+            base[k] = (k == 0);
+        }
+        NAME(seriesDiv)(base, out, base, n);
+        memcpy(out, base, n * sizeof(SCALAR));
+    }
+}
+
+/* The series whose derivative is u'/w, starting at value; for the inverse trigonometric functions. */
+void NAME(seriesIntegrateRatio)(const SCALAR* u, const SCALAR* w, SCALAR value, SCALAR* out, int n) {
+    SCALAR du[n];
+
+    du[n-1] = 0;
+    for (int k = 0; k + 1 < n; k++) {
+        du[k] = (k + 1) * u[k+1];
+    }
+    NAME(seriesDiv)(du, w, du, n - 1);
+    out[0] = value;
+    for (int k = 1; k < n; k++) {
+        out[k] = du[k-1] / k;
+    }
+}
+
+/*
+ * Evaluates the Taylor coefficients c[k] = f(k)(x)/k! of expr at x for
+ * k = 0..order in one pass of truncated series arithmetic, so the k-th
+ * derivative is k! * c[k]. Every operator and built-in function is
+ * covered, including the degree conversion of the trigonometric functions.
+ * Returns 0, or -1 if order is outside 0..MAX_TAYLOR or expr calls a
+ * registered function whose derivatives are unknown.
+ */
+int NAME(evalTaylor)(Expr* expr, SCALAR x, int order, SCALAR* coefficients) {
+    if (order < 0 || order > MAX_TAYLOR) {
+        return -1;
+    }
+
+    int n = order + 1;
+    SCALAR stack[expr->depth][n];
+    SCALAR saved[expr->slots + 1][n];
+    SCALAR u[n], s[n], c[n];
+    int top = -1;
+
+    for (Instr* instr = expr->code, *end = expr->code + expr->length; instr < end; instr++) {
+        SCALAR* a = (top >= 0) ? stack[top] : NULL;
+        SCALAR* b = (top >= 1) ? stack[top-1] : NULL;
+
+        switch (instr->op) {
+            case OP_CONST:
+            case OP_VAR:
+                a = stack[++top];
+                for (int k = 0; k < n; k++) {
+                    a[k] = 0;
+                }
+                if (instr->op == OP_CONST) {
+                    a[0] = SCALAR_CONST(instr);
+                } else if (instr->index != 0) {
+                    a[0] = (SCALAR) expr->values[instr->index];
+                } else {
+                    a[0] = x;
+                    if (n > 1) {
+                        a[1] = 1;
+                    }
+                }
+                break;
+            case OP_STORE:
+                memcpy(saved[instr->index], a, n * sizeof(SCALAR));
+                break;
+            case OP_LOAD:
+                memcpy(stack[++top], saved[instr->index], n * sizeof(SCALAR));
+                break;
+            case OP_ADD:
+                for (int k = 0; k < n; k++) { b[k] += a[k]; }
+                top--;
+                break;
+            case OP_SUB:
+                for (int k = 0; k < n; k++) { b[k] -= a[k]; }
+                top--;
+                break;
+            case OP_MUL:
+                NAME(seriesMul)(b, a, b, n);
+                top--;
+                break;
+            case OP_DIV:
+                NAME(seriesDiv)(b, a, b, n);
+                top--;
+                break;
+            case OP_POWI:
+                memcpy(u, a, n * sizeof(SCALAR));
+                NAME(seriesPowi)(u, instr->exponent, a, n);
+                break;
+            case OP_BINARY: {
+                int constant = 1;
+                for (int k = 1; k < n; k++) {
+                    constant = constant && a[k] == 0;
+                }
+                if (operators[instr->index].func == eval_log) {
+                    /* log(b)/log(a) */
+                    NAME(seriesLog)(b, u, n);
+                    NAME(seriesLog)(a, s, n);
+                    NAME(seriesDiv)(u, s, b, n);
+                } else if (constant) {
+                    memcpy(u, b, n * sizeof(SCALAR));
+                    NAME(seriesPow)(u, a[0], b, n);
+                } else {
+                    /* b^a = exp(a ln b) */
+                    NAME(seriesLog)(b, u, n);
+                    NAME(seriesMul)(u, a, u, n);
+                    NAME(seriesExp)(u, b, n);
+                }
+                top--;
+                break;
+            }
+            case OP_UNARY:
+            case OP_UNARY_DEG: {
+                Function* function = &functions[instr->index];
+                float (*func)(float val) = function->func;
+                SCALAR_WIDE scale = (instr->op == OP_UNARY_DEG) ? SCALAR_PI / 180 : 1;
+
+                for (int k = 0; k < n; k++) {
+                    u[k] = (SCALAR) (a[k] * scale);
+                }
+                if (func == eval_sin || func == eval_cos || func == eval_tan || func == eval_csc || func == eval_sec || func == eval_cot) {
+                    NAME(seriesSinCos)(u, s, c, n, 0);
+                    if (func == eval_sin) {
+                        memcpy(a, s, n * sizeof(SCALAR));
+                    } else if (func == eval_cos) {
+                        memcpy(a, c, n * sizeof(SCALAR));
+                    } else if (func == eval_tan) {
+                        NAME(seriesDiv)(s, c, a, n);
+                    } else if (func == eval_cot) {
+                        NAME(seriesDiv)(c, s, a, n);
+                    } else {
+                        for (int k = 0; k < n; k++) {
+                            u[k] = (k == 0);
+                        }
+                        NAME(seriesDiv)(u, (func == eval_csc) ? s : c, a, n);
+                    }
+                } else if (func == eval_sinh || func == eval_cosh || func == eval_tanh) {
+                    NAME(seriesSinCos)(u, s, c, n, 1);
+                    if (func == eval_tanh) {
+                        NAME(seriesDiv)(s, c, a, n);
+                    } else {
+                        memcpy(a, (func == eval_sinh) ? s : c, n * sizeof(SCALAR));
+                    }
+                } else if (func == eval_arcsin || func == eval_arccos || func == eval_arctan) {
+                    /* Integrate u'/sqrt(1 - u^2), -u'/sqrt(1 - u^2) or u'/(1 + u^2). */
+                    NAME(seriesMul)(u, u, s, n);
+                    for (int k = 0; k < n; k++) {
+                        s[k] = (func == eval_arctan) ? s[k] : -s[k];
+                    }
+                    s[0] += 1;
+                    if (func != eval_arctan) {
+                        NAME(seriesSqrt)(s, c, n);
+                        memcpy(s, c, n * sizeof(SCALAR));
+                    }
+                    if (func == eval_arccos) {
+                        for (int k = 0; k < n; k++) { s[k] = -s[k]; }
+                    }
+                    NAME(seriesIntegrateRatio)(u, s, NAME(applyFunction)(function, u[0]), a, n);
+                } else if (func == eval_exp1) {
+                    NAME(seriesExp)(u, a, n);
+                } else if (func == eval_ln) {
+                    NAME(seriesLog)(u, a, n);
+                } else if (func == eval_sqrt) {
+                    NAME(seriesSqrt)(u, a, n);
+                } else if (func == eval_abs) {
+                    for (int k = 0; k < n; k++) { a[k] = (u[0] < 0) ? -u[k] : u[k]; }
+                } else if (n == 1) {
+                    a[0] = NAME(applyFunction)(function, u[0]);
+                } else {
+                    return -1;
+                }
+                break;
+            }
+            case OP_LOGBASE:
+                NAME(seriesLog)(a, u, n);
+                for (int k = 0; k < n; k++) {
+                    a[k] = u[k] / MATH(log)(SCALAR_CONST(instr));
+                }
+                break;
+        }
+    }
+
+    memcpy(coefficients, stack[0], n * sizeof(SCALAR));
+    return 0;
+}
+
+/* Stores iteration i in result->history when there is room for it. */
+void NAME(recordIteration)(NAME(RootResult)* result, int i, SCALAR a, SCALAR b, SCALAR c, SCALAR fc) {
+    if (result->history != NULL && i < result->historyCapacity) {
+        NAME(Iteration) row = {a, b, c, fc};
+        result->history[i] = row;
+    }
+}
+
+/*
+ * Halves [a, b] until it is narrower than tolerance. Each iteration
+ * evaluates only the midpoint; f(a) is carried along. Returns 0, or -1 if
+ * maxIterations ran out. A tolerance or maxIterations <= 0 selects the
+ * defaults (SCALAR_EPSILON, MAX_ITERATIONS).
+ */
+int NAME(bisection)(SCALAR a, SCALAR b, Expr* expr, SCALAR tolerance, int maxIterations, NAME(RootResult)* result) {
+    SCALAR fa = NAME(evalExpr)(expr, a);
+    SCALAR c = a;
+    SCALAR fc = fa;
+    int i = 0;
+
+    tolerance = (tolerance > 0) ? tolerance : SCALAR_EPSILON;
+    maxIterations = (maxIterations > 0) ? maxIterations : MAX_ITERATIONS;
+    for (; MATH(fabs)(b-a) >= tolerance && i < maxIterations; i++) {
+        c = (a+b)/2;
+        fc = NAME(evalExpr)(expr, c);
+        NAME(recordIteration)(result, i, a, b, c, fc);
+
+        if (fc == 0) {
+            i++;
+            break;
+        }
+        if (fc * fa < 0) {
+            b = c;
+        } else {
+            a = c;
+            fa = fc;
+        }
+    }
+
+    result->root = c;
+    result->value = fc;
+    result->iterations = i;
+    result->evaluations = i + 1;
+    return (fc == 0 || MATH(fabs)(b-a) < tolerance) ? 0 : -1;
+}
+
+/*
+ * False position on [a, b] until |f(c)| <= tolerance; one evaluation per
+ * iteration. Illinois variant: when the same endpoint survives twice in a
+ * row its stored f is halved, so a convex f can no longer pin one end and
+ * crawl in from the other. Same conventions as bisection.
+ */
+int NAME(regula_falsi)(SCALAR a, SCALAR b, Expr* expr, SCALAR tolerance, int maxIterations, NAME(RootResult)* result) {
+    SCALAR fa = NAME(evalExpr)(expr, a);
+    SCALAR fb = NAME(evalExpr)(expr, b);
+    SCALAR c = a;
+    SCALAR fc = fa;
+    int side = 0;
+    int i = 0;
+
+    tolerance = (tolerance > 0) ? tolerance : SCALAR_EPSILON;
+    maxIterations = (maxIterations > 0) ? maxIterations : MAX_ITERATIONS;
+    do {
+        c = a - (a - b) * fa / (fa - fb);
+        fc = NAME(evalExpr)(expr, c);
+        NAME(recordIteration)(result, i, a, b, c, fc);
+
+        if (fc * fa < 0) {
+            b = c;
+            fb = fc;
+            if (side == -1) {
+                fa /= 2;
+            }
+            side = -1;
+        } else {
+            a = c;
+            fa = fc;
+            if (side == 1) {
+                fb /= 2;
+            }
+            side = 1;
+        }
+        i++;
+    } while (MATH(fabs)(fc) > tolerance && i < maxIterations);
+
+    result->root = c;
+    result->value = fc;
+    result->iterations = i;
+    result->evaluations = i + 2;
+    return (MATH(fabs)(fc) <= tolerance) ? 0 : -1;
+}
+
+/*
+ * Brent's method on a bracket [a, b] with f(a) and f(b) of opposite sign.
+ * Each iteration takes an inverse quadratic or secant step when it stays
+ * well inside the bracket and shrinks it fast enough, and a bisection step
+ * otherwise, so it is never slower than bisection and superlinear near a
+ * simple root. One evaluation per iteration; the bracket ends keep their
+ * values. Converges when the bracket is narrower than tolerance (plus
+ * rounding). history rows hold the bracket and the new iterate. Returns -1
+ * if [a, b] does not bracket a root or maxIterations ran out.
+ */
+int NAME(brent)(SCALAR a, SCALAR b, Expr* expr, SCALAR tolerance, int maxIterations, NAME(RootResult)* result) {
+    SCALAR fa = NAME(evalExpr)(expr, a);
+    SCALAR fb = NAME(evalExpr)(expr, b);
+    SCALAR c = b;
+    SCALAR fc = fb;
+    SCALAR d = b - a;
+    SCALAR e = d;
+    int status = -1;
+    int i = 0;
+
+    tolerance = (tolerance > 0) ? tolerance : SCALAR_EPSILON;
+    maxIterations = (maxIterations > 0) ? maxIterations : MAX_ITERATIONS;
+    result->evaluations = 2;
+    if ((fa > 0 && fb > 0) || (fa < 0 && fb < 0)) {
+        result->root = b;
+        result->value = fb;
+        result->iterations = 0;
+        return -1;
+    }
+
+    for (; i <= maxIterations; i++) {
+        /* Keep b the best estimate and c on the other side of the root. */
+        if ((fb > 0 && fc > 0) || (fb < 0 && fc < 0)) {
+            c = a;
+            fc = fa;
+            d = e = b - a;
+        }
+        if (MATH(fabs)(fc) < MATH(fabs)(fb)) {
+            a = b;
+            b = c;
+            c = a;
+            fa = fb;
+            fb = fc;
+            fc = fa;
+        }
+
+        SCALAR tol = 2 * SCALAR_MACHEPS * MATH(fabs)(b) + tolerance / 2;
+        SCALAR mid = (c - b) / 2;
+        if (MATH(fabs)(mid) <= tol || fb == 0) {
+            status = 0;
+            break;
+        }
+        if (i == maxIterations) {
+            break;
+        }
+
+        if (MATH(fabs)(e) >= tol && MATH(fabs)(fa) > MATH(fabs)(fb)) {
+            SCALAR s = fb / fa;
+            SCALAR p, q;
+            if (a == c) {
+                p = 2 * mid * s;
+                q = 1 - s;
+            } else {
+                SCALAR r = fb / fc;
+                q = fa / fc;
+                p = s * (2 * mid * q * (q - r) - (b - a) * (r - 1));
+                q = (q - 1) * (r - 1) * (s - 1);
+            }
+            if (p > 0) {
+                q = -q;
+            } else {
+                p = -p;
+            }
+
+            SCALAR limit = 3 * mid * q - MATH(fabs)(tol * q);
+            if (MATH(fabs)(e * q) < limit) {
+                limit = MATH(fabs)(e * q);
+            }
+            if (2 * p < limit) {
+                e = d;
+                d = p / q;
+            } else {
+                d = mid;
+                e = d;
+            }
+        } else {
+            d = mid;
+            e = d;
+        }
+
+        SCALAR low = (b < c) ? b : c;
+        SCALAR high = (b < c) ? c : b;
+        a = b;
+        fa = fb;
+        b += (MATH(fabs)(d) > tol) ? d : (mid > 0 ? tol : -tol);
+        fb = NAME(evalExpr)(expr, b);
+        result->evaluations++;
+        NAME(recordIteration)(result, i, low, high, b, fb);
+    }
+
+    result->root = b;
+    result->value = fb;
+    result->iterations = i;
+    return status;
+}
+
+/*
+ * Newton's method from a with exact slopes. Interpreted, one evalDual pass
+ * yields f and f' together; when the JIT has compiled both f and the
+ * symbolic derivative compileExpression attaches, two native calls are
+ * cheaper and are used instead. history rows hold x, f'(x), the next x and
+ * its residual. b is ignored; it keeps the signature of the bracketing
+ * methods. Same conventions as bisection; stops with -1 at the last good
+ * estimate when f'(x) = 0 or a step is not finite or leaves f's domain.
+ */
+int NAME(newton_raphson)(SCALAR a, SCALAR b, Expr* expr, SCALAR tolerance, int maxIterations, NAME(RootResult)* result) {
+#if SCALAR_IS_FLOAT
+    Expr* derivative = (expr->native != NULL && expr->derivative != NULL && expr->derivative->native != NULL) ? expr->derivative : NULL;
+#else
+    Expr* derivative = NULL;
+#endif
+    SCALAR ga = 0;
+    SCALAR gb = 0;
+    SCALAR fa = (derivative != NULL) ? NAME(evalExpr)(expr, a) : NAME(evalDual)(expr, a, &ga);
+    int evaluations = 1;
+    int i = 0;
+
+    (void) b;
+    tolerance = (tolerance > 0) ? tolerance : SCALAR_EPSILON;
+    maxIterations = (maxIterations > 0) ? maxIterations : MAX_ITERATIONS;
+    while (MATH(fabs)(fa) > tolerance && i < maxIterations) {
+        if (derivative != NULL) {
+            ga = NAME(evalExpr)(derivative, a);
+            evaluations++;
+        }
+
+        SCALAR step = fa/ga;
+        if (ga == 0 || !isfinite(step)) {
+            break;
+        }
+        SCALAR next = a - step;
+        SCALAR fnext = (derivative != NULL) ? NAME(evalExpr)(expr, next) : NAME(evalDual)(expr, next, &gb);
+        evaluations++;
+        if (!isfinite(fnext)) {
+            break;
+        }
+        NAME(recordIteration)(result, i, a, ga, next, fnext);
+
+        a = next;
+        fa = fnext;
+        ga = gb;
+        i++;
+    }
+
+    result->root = a;
+    result->value = fa;
+    result->iterations = i;
+    result->evaluations = evaluations;
+    return (MATH(fabs)(fa) <= tolerance) ? 0 : -1;
+}
+
+/* Golden-section search for the minimum of |f| on [low, high]; adds its evaluations to *evaluations. */
+SCALAR NAME(minimizeAbs)(Expr* expr, SCALAR low, SCALAR high, SCALAR tolerance, int* evaluations) {
+    const SCALAR ratio = (SCALAR) 0.6180339887498948482L;
+    SCALAR x1 = high - ratio * (high - low);
+    SCALAR x2 = low + ratio * (high - low);
+    SCALAR f1 = MATH(fabs)(NAME(evalExpr)(expr, x1));
+    SCALAR f2 = MATH(fabs)(NAME(evalExpr)(expr, x2));
+
+    *evaluations += 2;
+    for (int i = 0; i < MAX_ITERATIONS && high - low > 2 * (MATH(sqrt)(SCALAR_MACHEPS) * MATH(fabs)(x1) + tolerance); i++) {
+        if (f1 < f2) {
+            high = x2;
+            x2 = x1;
+            f2 = f1;
+            x1 = high - ratio * (high - low);
+            f1 = MATH(fabs)(NAME(evalExpr)(expr, x1));
+        } else {
+            low = x1;
+            x1 = x2;
+            f1 = f2;
+            x2 = low + ratio * (high - low);
+            f2 = MATH(fabs)(NAME(evalExpr)(expr, x2));
+        }
+        (*evaluations)++;
+    }
+    return (f1 < f2) ? x1 : x2;
+}
+
+typedef struct {
+    Expr* expr;
+    SCALAR tolerance;
+    const SCALAR* brackets;
+    const int* minima;
+    SCALAR* roots;
+    int* found;
+    atomic_int evaluations;
+} NAME(RootScan);
+
+/* Refines candidates [lo, hi): brent on sign changes, a |f| minimisation on touching minima. */
+void NAME(refineRoots)(void* ctx, int lo, int hi) {
+    NAME(RootScan)* c = (NAME(RootScan)*) ctx;
+    int evaluations = 0;
+
+    for (int k = lo; k < hi; k++) {
+        SCALAR a = c->brackets[2*k];
+        SCALAR b = c->brackets[2*k + 1];
+
+        if (a == b) {
+            c->roots[k] = a;
+            c->found[k] = MATH(fabs)(NAME(evalExpr)(c->expr, a)) <= c->tolerance;
+            evaluations++;
+        } else if (c->minima[k]) {
+            SCALAR x = NAME(minimizeAbs)(c->expr, a, b, c->tolerance, &evaluations);
+            SCALAR fx = NAME(evalExpr)(c->expr, x);
+            evaluations++;
+            c->roots[k] = x;
+            c->found[k] = MATH(fabs)(fx) <= c->tolerance;
+        } else {
+            NAME(RootResult) result = {0};
+            int status = NAME(brent)(a, b, c->expr, c->tolerance, 0, &result);
+            SCALAR fa = NAME(evalExpr)(c->expr, a);
+            SCALAR fb = NAME(evalExpr)(c->expr, b);
+            evaluations += result.evaluations + 2;
+            /* A sign change through a pole converges to the pole; |f| grows there instead of vanishing. */
+            c->roots[k] = result.root;
+            c->found[k] = status == 0 && (MATH(fabs)(result.value) <= c->tolerance
+                || (MATH(fabs)(result.value) <= MATH(fabs)(fa) && MATH(fabs)(result.value) <= MATH(fabs)(fb)));
+        }
+    }
+    atomic_fetch_add(&c->evaluations, evaluations);
+}
+
+int NAME(compareScalars)(const void* left, const void* right) {
+    SCALAR x = *(const SCALAR*) left;
+    SCALAR y = *(const SCALAR*) right;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Finds the roots of expr on [a, b]. The interval is sampled at samples+1
+ * evenly spaced points with evalBatch; every sign change becomes a bracket
+ * for brent, and every local minimum of |f| without a sign change next to
+ * it (an even-multiplicity root such as (x-1)^2) is minimised and kept if
+ * |f| <= tolerance there. Samples where |f| <= tolerance are roots as they
+ * stand. The candidates are refined concurrently on the thread pool. Writes at most maxRoots sorted, deduplicated roots and
+ * returns how many; evaluations, if not NULL, receives the total count.
+ * Roots closer together than the sample spacing can be missed.
+ */
+int NAME(find_all_roots)(SCALAR a, SCALAR b, Expr* expr, int samples, SCALAR tolerance, SCALAR* roots, int maxRoots, int* evaluations) {
+    samples = (samples > 1) ? samples : 1000;
+    tolerance = (tolerance > 0) ? tolerance : SCALAR_EPSILON;
+
+    SCALAR* xs = (SCALAR*) malloc((samples + 1) * sizeof(SCALAR));
+    SCALAR* ys = (SCALAR*) malloc((samples + 1) * sizeof(SCALAR));
+    SCALAR* brackets = (SCALAR*) malloc(4 * (samples + 1) * sizeof(SCALAR));
+    int* minima = (int*) malloc(2 * (samples + 1) * sizeof(int));
+    int count = 0;
+
+    for (int i = 0; i <= samples; i++) {
+        xs[i] = (i == samples) ? b : a + (b - a) * i / samples;
+    }
+    NAME(evalBatch)(expr, xs, ys, samples + 1);
+
+    for (int i = 0; i < samples; i++) {
+        int signChange = (ys[i] < 0 && ys[i+1] > 0) || (ys[i] > 0 && ys[i+1] < 0);
+        if (MATH(fabs)(ys[i]) <= tolerance) {
+            brackets[2*count] = brackets[2*count + 1] = xs[i];
+            minima[count++] = 0;
+        }
+        if (signChange) {
+            brackets[2*count] = xs[i];
+            brackets[2*count + 1] = xs[i+1];
+            minima[count++] = 0;
+        } else if (i > 0 && MATH(fabs)(ys[i]) > tolerance && MATH(fabs)(ys[i]) < MATH(fabs)(ys[i-1]) && MATH(fabs)(ys[i]) <= MATH(fabs)(ys[i+1])
+                   && (ys[i-1] > 0) == (ys[i] > 0) && (ys[i+1] > 0) == (ys[i] > 0)) {
+            brackets[2*count] = xs[i-1];
+            brackets[2*count + 1] = xs[i+1];
+            minima[count++] = 1;
+        }
+    }
+    if (MATH(fabs)(ys[samples]) <= tolerance) {
+        brackets[2*count] = brackets[2*count + 1] = xs[samples];
+        minima[count++] = 0;
+    }
+
+    int* found = (int*) calloc((count > 0) ? count : 1, sizeof(int));
+    SCALAR* candidates = (SCALAR*) malloc(((count > 0) ? count : 1) * sizeof(SCALAR));
+    NAME(RootScan) ctx = {expr, tolerance, brackets, minima, candidates, found, samples + 1};
+
+    parallelFor(0, count, 1, NAME(refineRoots), &ctx);
+
+    int kept = 0;
+    for (int k = 0; k < count; k++) {
+        if (found[k]) {
+            candidates[kept++] = candidates[k];
+        }
+    }
+    qsort(candidates, kept, sizeof(SCALAR), NAME(compareScalars));
+
+    int written = 0;
+    for (int k = 0; k < kept && written < maxRoots; k++) {
+        SCALAR gap = 2 * tolerance + 16 * SCALAR_MACHEPS * MATH(fabs)(candidates[k]);
+        if (written > 0 && candidates[k] - roots[written-1] <= gap) {
+            continue;
+        }
+        roots[written++] = candidates[k];
+    }
+
+    if (evaluations != NULL) {
+        *evaluations = atomic_load(&ctx.evaluations);
+    }
+    free(xs);
+    free(ys);
+    free(brackets);
+    free(minima);
+    free(found);
+    free(candidates);
+    return written;
+}
+
+/* Step eps^power times |x| (or 1 for |x| < 1), rounded so that x + step is exact. */
+SCALAR NAME(differenceStep)(SCALAR x, SCALAR_WIDE power) {
+    SCALAR scale = (MATH(fabs)(x) > 1) ? MATH(fabs)(x) : 1;
+    SCALAR step = (SCALAR) (scale * pow(SCALAR_MACHEPS, power));
+    SCALAR shifted = x + step;
+
+    return shifted - x;
+}
+
+/*
+ * Forward (method 1), backward (2) or central (3) difference of expr at x.
+ * The step balances truncation against cancellation: sqrt(eps) for the
+ * one-sided differences and cbrt(eps) for the central one, times |x| when
+ * that exceeds 1.
+ */
+SCALAR NAME(finite_difference)(Expr* expr, SCALAR x, int method) {
+    SCALAR step = NAME(differenceStep)(x, (method == 3) ? 1.0L / 3 : 0.5L);
+
+    switch (method) {
+        case 1:
+            return (NAME(evalExpr)(expr, x+step) - NAME(evalExpr)(expr, x)) / step;
+        case 2:
+            return (NAME(evalExpr)(expr, x) - NAME(evalExpr)(expr, x-step)) / step;
+        case 3:
+            return (NAME(evalExpr)(expr, x+step) - NAME(evalExpr)(expr, x-step)) / (2*step);
+    }
+    return 0;
+}
+
+/*
+ * Central difference of the given order from the values f at the order + 1
+ * points x + (order/2 - j) step, j = 0..order: the sum of (-1)^j C(order, j)
+ * f_j over step^order. Its error is a series in even powers of step, plus
+ * the rounding of the f_j, estimated in *noise.
+ */
+SCALAR NAME(centralDifference)(const SCALAR* f, int order, SCALAR step, SCALAR* noise) {
+    SCALAR sum = 0;
+    SCALAR magnitude = 0;
+    SCALAR binomial = 1;
+    SCALAR scale = NAME(powi)(step, order);
+
+    for (int j = 0; j <= order; j++) {
+        sum += (j & 1) ? -binomial * f[j] : binomial * f[j];
+        magnitude += binomial * MATH(fabs)(f[j]);
+        binomial = binomial * (order - j) / (j + 1);
+    }
+    *noise = SCALAR_MACHEPS * magnitude / scale;
+    return sum / scale;
+}
+
+/*
+ * One column of Ridders' tableau. column[0] holds the difference with the
+ * newest, smallest step and column[j] its j-th Richardson extrapolation,
+ * each step being RIDDERS_SHRINK times the previous one; previous is the
+ * column before (level entries). The best entry so far is kept in *best
+ * with its error estimate *error, which is never below the rounding noise
+ * of the newest difference. Returns 1 once the error has grown well past
+ * the best, when further levels only add rounding error.
+ */
+int NAME(riddersLevel)(SCALAR* column, const SCALAR* previous, int level, SCALAR noise, SCALAR* best, SCALAR* error) {
+    SCALAR factor = (SCALAR) (RIDDERS_SHRINK * RIDDERS_SHRINK);
+    SCALAR power = factor;
+
+    for (int j = 1; j <= level; j++) {
+        column[j] = (column[j-1] * power - previous[j-1]) / (power - 1);
+        power *= factor;
+        SCALAR a = MATH(fabs)(column[j] - column[j-1]);
+        SCALAR b = MATH(fabs)(column[j] - previous[j-1]);
+        SCALAR estimate = (a > b) ? a : b;
+        estimate = (estimate > noise) ? estimate : noise;
+        if (estimate <= *error) {
+            *error = estimate;
+            *best = column[j];
+        }
+    }
+    return MATH(fabs)(column[level] - previous[level-1]) >= 2 * *error;
+}
+
+/*
+ * The order-th derivative of expr at x by Ridders' method: central
+ * differences with steps shrinking by RIDDERS_SHRINK, extrapolated to step
+ * zero in a Richardson tableau of at most MAX_RIDDERS levels, stopping
+ * once the tableau's error estimate starts to grow. The first step is
+ * eps^(1/(order+8)) times |x| (or 1): far larger than a plain difference
+ * could afford, since the extrapolation removes the truncation error, and
+ * larger for higher orders, whose differences cancel more. Returns 0, or -1
+ * if order is not in 1..MAX_DERIVATIVE.
+ */
+int NAME(ridders_derivative)(Expr* expr, SCALAR x, int order, NAME(Derivative)* result) {
+    SCALAR tableau[2][MAX_RIDDERS];
+    SCALAR f[MAX_DERIVATIVE + 1];
+    SCALAR step;
+    SCALAR noise;
+    SCALAR center = 0;
+
+    *result = (NAME(Derivative)) {0};
+    if (order < 1 || order > MAX_DERIVATIVE) {
+        return -1;
+    }
+
+    step = NAME(differenceStep)(x, 1.0L / (order + 8));
+    if (order % 2 == 0) {
+        center = NAME(evalExpr)(expr, x);
+        result->evaluations++;
+    }
+
+    result->error = (SCALAR) INFINITY;
+    for (int level = 0; level < MAX_RIDDERS; level++) {
+        SCALAR* column = tableau[level & 1];
+        for (int j = 0; j <= order; j++) {
+            f[j] = (2*j == order) ? center : NAME(evalExpr)(expr, x + (order - 2*j) * step / 2);
+        }
+        result->evaluations += order + (order & 1);
+        column[0] = NAME(centralDifference)(f, order, step, &noise);
+        if (level == 0) {
+            result->value = column[0];
+        } else if (NAME(riddersLevel)(column, tableau[(level - 1) & 1], level, noise, &result->value, &result->error)) {
+            break;
+        }
+        step /= (SCALAR) RIDDERS_SHRINK;
+    }
+    return 0;
+}
+
+typedef struct {
+    Expr* expr;
+    const SCALAR* xs;
+    size_t n;
+    int order;
+    SCALAR* values;
+    SCALAR* errors;
+} NAME(RiddersBatch);
+
+/*
+ * ridders_derivative for points [lo*RIDDERS_CHUNK, hi*RIDDERS_CHUNK). Each
+ * level gathers the difference points of every point still refining into
+ * one array and evaluates them with a single evalBatch call.
+ */
+void NAME(riddersChunks)(void* ctx, int lo, int hi) {
+    NAME(RiddersBatch)* c = (NAME(RiddersBatch)*) ctx;
+    int order = c->order;
+    int width = order + (order & 1);
+    SCALAR* tableau = (SCALAR*) malloc(2 * RIDDERS_CHUNK * MAX_RIDDERS * sizeof(SCALAR));
+    SCALAR* steps = (SCALAR*) malloc(RIDDERS_CHUNK * sizeof(SCALAR));
+    SCALAR* center = (SCALAR*) malloc(RIDDERS_CHUNK * sizeof(SCALAR));
+    SCALAR* points = (SCALAR*) malloc((size_t) RIDDERS_CHUNK * width * sizeof(SCALAR));
+    SCALAR* f = (SCALAR*) malloc((size_t) RIDDERS_CHUNK * width * sizeof(SCALAR));
+    int* active = (int*) malloc(RIDDERS_CHUNK * sizeof(int));
+
+    for (size_t start = (size_t) lo * RIDDERS_CHUNK; start < (size_t) hi * RIDDERS_CHUNK && start < c->n; start += RIDDERS_CHUNK) {
+        int count = (c->n - start < RIDDERS_CHUNK) ? (int) (c->n - start) : RIDDERS_CHUNK;
+        const SCALAR* xs = c->xs + start;
+        SCALAR* values = c->values + start;
+        SCALAR* errors = c->errors + start;
+        int live = count;
+
+        for (int i = 0; i < count; i++) {
+            steps[i] = NAME(differenceStep)(xs[i], 1.0L / (order + 8));
+            errors[i] = (SCALAR) INFINITY;
+            active[i] = i;
+        }
+        if (order % 2 == 0) {
+            NAME(evalBatch)(c->expr, xs, center, count);
+        }
+
+        for (int level = 0; level < MAX_RIDDERS && live > 0; level++) {
+            /* The difference points of the live points, the center left out. */
+            for (int a = 0; a < live; a++) {
+                int i = active[a];
+                for (int j = 0, k = 0; j <= order; j++) {
+                    if (2*j != order) {
+                        points[(size_t) a*width + k++] = xs[i] + (order - 2*j) * steps[i] / 2;
+                    }
+                }
+            }
+            NAME(evalBatch)(c->expr, points, f, (size_t) live * width);
+
+            int kept = 0;
+            for (int a = 0; a < live; a++) {
+                int i = active[a];
+                SCALAR g[MAX_DERIVATIVE + 1];
+                for (int j = 0, k = 0; j <= order; j++) {
+                    g[j] = (2*j == order) ? center[i] : f[(size_t) a*width + k++];
+                }
+                SCALAR* column = tableau + ((size_t) (level & 1) * RIDDERS_CHUNK + i) * MAX_RIDDERS;
+                SCALAR* previous = tableau + ((size_t) ((level - 1) & 1) * RIDDERS_CHUNK + i) * MAX_RIDDERS;
+                SCALAR noise;
+                column[0] = NAME(centralDifference)(g, order, steps[i], &noise);
+                steps[i] /= (SCALAR) RIDDERS_SHRINK;
+                if (level == 0) {
+                    values[i] = column[0];
+                } else if (NAME(riddersLevel)(column, previous, level, noise, &values[i], &errors[i])) {
+                    continue;
+                }
+                active[kept++] = i;
+            }
+            live = kept;
+        }
+    }
+
+    free(tableau);
+    free(steps);
+    free(center);
+    free(points);
+    free(f);
+    free(active);
+}
+
+/*
+ * ridders_derivative at the n points xs: values[i] receives the order-th
+ * derivative at xs[i] and errors[i] its error estimate. Points are taken
+ * RIDDERS_CHUNK at a time over the thread pool, and within a chunk every
+ * level of the tableau is one batched evaluation. Returns 0, or -1 if
+ * order is not in 1..MAX_DERIVATIVE.
+ */
+int NAME(ridders_batch)(Expr* expr, const SCALAR* xs, size_t n, int order, SCALAR* values, SCALAR* errors) {
+    NAME(RiddersBatch) ctx = {expr, xs, n, order, values, errors};
+
+    if (order < 1 || order > MAX_DERIVATIVE) {
+        return -1;
+    }
+    parallelFor(0, (int) ((n + RIDDERS_CHUNK - 1) / RIDDERS_CHUNK), 1, NAME(riddersChunks), &ctx);
+    return 0;
+}
+
+/*
+ * Newton divided-difference interpolation of the count points (x, y) at
+ * value. To query the same points more than once, fit them with newton_fit
+ * and evaluate the fit instead.
+ */
+SCALAR NAME(newton_interpolate)(int count, const SCALAR* x, const SCALAR* y, SCALAR value) {
+    NAME(NewtonPoly) poly;
+    SCALAR result = NAME(newton_fit)(&poly, count, x, y) == 0 ? NAME(newton_eval)(&poly, value) : (SCALAR) NAN;
+
+    NAME(newton_free)(&poly);
+    return result;
+}
+
+/*
+ * Builds the divided-difference coefficients of the count points (x, y)
+ * in place, one column of the table at a time, in O(count^2). Returns 0,
+ * or -1 if count < 1 or two abscissae coincide.
+ */
+int NAME(newton_fit)(NAME(NewtonPoly)* poly, int count, const SCALAR* x, const SCALAR* y) {
+    *poly = (NAME(NewtonPoly)) {0};
+    if (count < 1) {
+        return -1;
+    }
+
+    SCALAR* nodes = (SCALAR*) malloc(count * sizeof(SCALAR));
+    SCALAR* c = (SCALAR*) malloc(count * sizeof(SCALAR));
+    memcpy(nodes, x, count * sizeof(SCALAR));
+    memcpy(c, y, count * sizeof(SCALAR));
+
+    /* After column i, c[j] for j >= i is f[x_(j-i), ..., x_j]. */
+    for (int i = 1; i < count; i++) {
+        for (int j = count - 1; j >= i; j--) {
+            SCALAR width = nodes[j] - nodes[j - i];
+            if (width == 0) {
+                free(nodes);
+                free(c);
+                return -1;
+            }
+            c[j] = (c[j] - c[j - 1]) / width;
+        }
+    }
+
+    poly->count = count;
+    poly->nodes = nodes;
+    poly->coefficients = c;
+    return 0;
+}
+
+/* Evaluates the fit at value by nested multiplication, in O(count). */
+SCALAR NAME(newton_eval)(const NAME(NewtonPoly)* poly, SCALAR value) {
+    const SCALAR* c = poly->coefficients;
+    const SCALAR* nodes = poly->nodes;
+    SCALAR result = c[poly->count - 1];
+
+    for (int k = poly->count - 2; k >= 0; k--) {
+        result = result * (value - nodes[k]) + c[k];
+    }
+    return result;
+}
+
+/* A batch of interpolation queries; fit is the NewtonPoly, Barycentric or Spline being evaluated. */
+typedef struct {
+    const void* fit;
+    const SCALAR* values;
+    SCALAR* out;
+    size_t n;
+} NAME(InterpolationQueries);
+
+/*
+ * Evaluates queries [lo*BATCH_BLOCK, hi*BATCH_BLOCK). The nested
+ * multiplication runs for a whole block at once; the last block is padded
+ * so every inner loop has the fixed length BATCH_BLOCK, which the compiler
+ * vectorizes even at -O2, and each coefficient is loaded once per block.
+ */
+void NAME(newtonBlocks)(void* ctx, int lo, int hi) {
+    NAME(InterpolationQueries)* q = (NAME(InterpolationQueries)*) ctx;
+    const NAME(NewtonPoly)* poly = (const NAME(NewtonPoly)*) q->fit;
+    const SCALAR* c = poly->coefficients;
+    const SCALAR* nodes = poly->nodes;
+    int last = poly->count - 1;
+    SCALAR v[BATCH_BLOCK];
+    SCALAR result[BATCH_BLOCK];
+
+    for (size_t start = (size_t) lo * BATCH_BLOCK; start < (size_t) hi * BATCH_BLOCK && start < q->n; start += BATCH_BLOCK) {
+        int count = (q->n - start < BATCH_BLOCK) ? (int) (q->n - start) : BATCH_BLOCK;
+
+        memcpy(v, q->values + start, count * sizeof(SCALAR));
+        memset(v + count, 0, (BATCH_BLOCK - count) * sizeof(SCALAR));
+        for (int i = 0; i < BATCH_BLOCK; i++) {
+            result[i] = c[last];
+        }
+        for (int k = last - 1; k >= 0; k--) {
+            SCALAR node = nodes[k], ck = c[k];
+            for (int i = 0; i < BATCH_BLOCK; i++) {
+                result[i] = result[i] * (v[i] - node) + ck;
+            }
+        }
+        memcpy(q->out + start, result, count * sizeof(SCALAR));
+    }
+}
+
+/* newton_eval at the n points values, in blocks spread over the thread pool. */
+void NAME(newton_eval_batch)(const NAME(NewtonPoly)* poly, const SCALAR* values, SCALAR* out, size_t n) {
+    NAME(InterpolationQueries) q = {poly, values, out, n};
+    int blocks = (int) ((n + BATCH_BLOCK - 1) / BATCH_BLOCK);
+    int work = poly->count * BATCH_BLOCK;
+
+    parallelFor(0, blocks, (work >= 16384) ? 1 : 16384 / work, NAME(newtonBlocks), &q);
+}
+
+void NAME(newton_free)(NAME(NewtonPoly)* poly) {
+    free(poly->nodes);
+    free(poly->coefficients);
+    *poly = (NAME(NewtonPoly)) {0};
+}
+
+/* Whether the count abscissae x strictly increase. */
+int NAME(increasing)(int count, const SCALAR* x) {
+    for (int i = 1; i < count; i++) {
+        if (!(x[i] > x[i-1])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Computes the barycentric weights in O(count * degree), O(count^2) for
+ * the full polynomial. Distances are scaled by 4/(x_max - x_min) and the
+ * weights normalized so they neither overflow nor underflow. A degree
+ * outside [0, count - 1] means count - 1. Returns 0, or -1 if count < 1 or
+ * x does not strictly increase.
+ */
+int NAME(barycentric_fit)(NAME(Barycentric)* fit, int count, const SCALAR* x, const SCALAR* y, int degree) {
+    *fit = (NAME(Barycentric)) {0};
+    if (count < 1 || !NAME(increasing)(count, x)) {
+        return -1;
+    }
+    if (degree < 0 || degree > count - 1) {
+        degree = count - 1;
+    }
+
+    SCALAR_WIDE scale = (count > 1) ? 4 / ((SCALAR_WIDE) x[count-1] - x[0]) : 1;
+    SCALAR_WIDE* wide = (SCALAR_WIDE*) malloc(count * sizeof(SCALAR_WIDE));
+    SCALAR_WIDE largest = 0;
+
+    /* w_k = (-1)^(k-d) sum over i in [k-d, k] of prod over j in [i, i+d], j != k, of 1/|x_k - x_j|. */
+    for (int k = 0; k < count; k++) {
+        int lo = (k - degree > 0) ? k - degree : 0;
+        int hi = (k < count - 1 - degree) ? k : count - 1 - degree;
+        SCALAR_WIDE sum = 0;
+        for (int i = lo; i <= hi; i++) {
+            SCALAR_WIDE term = 1;
+            for (int j = i; j <= i + degree; j++) {
+                if (j != k) {
+                    term /= scale * ((x[k] > x[j]) ? (SCALAR_WIDE) x[k] - x[j] : (SCALAR_WIDE) x[j] - x[k]);
+                }
+            }
+            sum += term;
+        }
+        wide[k] = ((k + degree) & 1) ? -sum : sum;
+        largest = (sum > largest) ? sum : largest;
+    }
+
+    fit->count = count;
+    fit->degree = degree;
+    fit->nodes = (SCALAR*) malloc(count * sizeof(SCALAR));
+    fit->values = (SCALAR*) malloc(count * sizeof(SCALAR));
+    fit->weights = (SCALAR*) malloc(count * sizeof(SCALAR));
+    memcpy(fit->nodes, x, count * sizeof(SCALAR));
+    memcpy(fit->values, y, count * sizeof(SCALAR));
+    for (int k = 0; k < count; k++) {
+        fit->weights[k] = (SCALAR) (wide[k] / largest);
+    }
+    free(wide);
+    return 0;
+}
+
+/* Evaluates the barycentric formula at value in O(count); exact at the nodes. */
+SCALAR NAME(barycentric_eval)(const NAME(Barycentric)* fit, SCALAR value) {
+    SCALAR numerator = 0;
+    SCALAR denominator = 0;
+
+    for (int k = 0; k < fit->count; k++) {
+        SCALAR diff = value - fit->nodes[k];
+        if (diff == 0) {
+            return fit->values[k];
+        }
+        SCALAR t = fit->weights[k] / diff;
+        numerator += t * fit->values[k];
+        denominator += t;
+    }
+    return numerator / denominator;
+}
+
+/* Evaluates queries [lo*BATCH_BLOCK, hi*BATCH_BLOCK), a padded block at a time like newtonBlocks. */
+void NAME(barycentricBlocks)(void* ctx, int lo, int hi) {
+    NAME(InterpolationQueries)* q = (NAME(InterpolationQueries)*) ctx;
+    const NAME(Barycentric)* fit = (const NAME(Barycentric)*) q->fit;
+    SCALAR v[BATCH_BLOCK];
+    SCALAR numerator[BATCH_BLOCK];
+    SCALAR denominator[BATCH_BLOCK];
+    int node[BATCH_BLOCK];
+
+    for (size_t start = (size_t) lo * BATCH_BLOCK; start < (size_t) hi * BATCH_BLOCK && start < q->n; start += BATCH_BLOCK) {
+        int count = (q->n - start < BATCH_BLOCK) ? (int) (q->n - start) : BATCH_BLOCK;
+
+        memcpy(v, q->values + start, count * sizeof(SCALAR));
+        memset(v + count, 0, (BATCH_BLOCK - count) * sizeof(SCALAR));
+        for (int i = 0; i < BATCH_BLOCK; i++) {
+            numerator[i] = 0;
+            denominator[i] = 0;
+            node[i] = -1;
+        }
+        for (int k = 0; k < fit->count; k++) {
+            SCALAR xk = fit->nodes[k], yk = fit->values[k], wk = fit->weights[k];
+            for (int i = 0; i < BATCH_BLOCK; i++) {
+                SCALAR diff = v[i] - xk;
+                SCALAR t = wk / diff;
+                node[i] = (diff == 0) ? k : node[i];
+                numerator[i] += t * yk;
+                denominator[i] += t;
+            }
+        }
+        /* A query on a node divided by zero above; it takes the node's value. */
+        for (int i = 0; i < count; i++) {
+            q->out[start + i] = (node[i] >= 0) ? fit->values[node[i]] : numerator[i] / denominator[i];
+        }
+    }
+}
+
+/* barycentric_eval at the n points values, in blocks spread over the thread pool. */
+void NAME(barycentric_eval_batch)(const NAME(Barycentric)* fit, const SCALAR* values, SCALAR* out, size_t n) {
+    NAME(InterpolationQueries) q = {fit, values, out, n};
+    int blocks = (int) ((n + BATCH_BLOCK - 1) / BATCH_BLOCK);
+    int work = fit->count * BATCH_BLOCK;
+
+    parallelFor(0, blocks, (work >= 16384) ? 1 : 16384 / work, NAME(barycentricBlocks), &q);
+}
+
+void NAME(barycentric_free)(NAME(Barycentric)* fit) {
+    free(fit->nodes);
+    free(fit->values);
+    free(fit->weights);
+    *fit = (NAME(Barycentric)) {0};
+}
+
+/*
+ * Fits the natural cubic spline (zero second derivative at both ends)
+ * through the count knots (x, y): the second derivatives at the interior
+ * knots solve a tridiagonal system, eliminated in O(count) by the Thomas
+ * algorithm. Returns 0, or -1 if count < 2 or x does not strictly increase.
+ */
+int NAME(spline_fit)(NAME(Spline)* spline, int count, const SCALAR* x, const SCALAR* y) {
+    *spline = (NAME(Spline)) {0};
+    if (count < 2 || !NAME(increasing)(count, x)) {
+        return -1;
+    }
+
+    SCALAR* m = (SCALAR*) calloc(count, sizeof(SCALAR));
+    SCALAR* upper = (SCALAR*) calloc(count, sizeof(SCALAR));
+
+    /* Row i, with w_i = x_(i+1) - x_i: w_(i-1) m_(i-1) + 2 (w_(i-1) + w_i) m_i + w_i m_(i+1) = 6 (slope_i - slope_(i-1)). */
+    for (int i = 1; i < count - 1; i++) {
+        SCALAR left = x[i] - x[i-1];
+        SCALAR right = x[i+1] - x[i];
+        SCALAR rhs = 6 * ((y[i+1] - y[i]) / right - (y[i] - y[i-1]) / left);
+        SCALAR pivot = 2 * (left + right) - left * upper[i-1];
+        upper[i] = right / pivot;
+        m[i] = (rhs - left * m[i-1]) / pivot;
+    }
+    for (int i = count - 3; i >= 1; i--) {
+        m[i] -= upper[i] * m[i+1];
+    }
+
+    SCALAR* c = (SCALAR*) malloc(4 * (size_t) (count - 1) * sizeof(SCALAR));
+    for (int i = 0; i < count - 1; i++) {
+        SCALAR width = x[i+1] - x[i];
+        c[4*i] = y[i];
+        c[4*i + 1] = (y[i+1] - y[i]) / width - width * (2 * m[i] + m[i+1]) / 6;
+        c[4*i + 2] = m[i] / 2;
+        c[4*i + 3] = (m[i+1] - m[i]) / (6 * width);
+    }
+    free(m);
+    free(upper);
+
+    /* Equally spaced knots, to within rounding, allow the interval to be computed instead of searched. */
+    SCALAR step = (x[count-1] - x[0]) / (count - 1);
+    SCALAR slack = 4 * SCALAR_MACHEPS * ((MATH(fabs)(x[0]) > MATH(fabs)(x[count-1])) ? MATH(fabs)(x[0]) : MATH(fabs)(x[count-1]));
+    spline->uniform = 1;
+    for (int i = 1; i < count && spline->uniform; i++) {
+        spline->uniform = MATH(fabs)(x[i] - (x[0] + i * step)) <= slack;
+    }
+
+    spline->count = count;
+    spline->start = x[0];
+    spline->inverseStep = 1 / step;
+    spline->knots = (SCALAR*) malloc(count * sizeof(SCALAR));
+    memcpy(spline->knots, x, count * sizeof(SCALAR));
+    spline->coefficients = c;
+    return 0;
+}
+
+/*
+ * Index of the interval holding value: computed directly on uniform knots,
+ * otherwise by a branch-free binary search. Values outside the knots use
+ * the first or last interval.
+ */
+int NAME(splineInterval)(const NAME(Spline)* spline, SCALAR value) {
+    int last = spline->count - 2;
+
+    if (spline->uniform) {
+        SCALAR t = (value - spline->start) * spline->inverseStep;
+        if (!(t > 0)) {
+            return 0;
+        }
+        return (t >= last) ? last : (int) t;
+    }
+
+    const SCALAR* knots = spline->knots;
+    int base = 0;
+    for (int length = last + 1; length > 1; ) {
+        int half = length / 2;
+        base = (knots[base + half] <= value) ? base + half : base;
+        length -= half;
+    }
+    return base;
+}
+
+/* Evaluates the spline at value: O(1) on uniform knots, O(log count) otherwise. Outside the knots the end cubics extrapolate. */
+SCALAR NAME(spline_eval)(const NAME(Spline)* spline, SCALAR value) {
+    int i = NAME(splineInterval)(spline, value);
+    const SCALAR* c = spline->coefficients + 4*i;
+    SCALAR t = value - spline->knots[i];
+
+    return c[0] + t * (c[1] + t * (c[2] + t * c[3]));
+}
+
+void NAME(splineBlocks)(void* ctx, int lo, int hi) {
+    NAME(InterpolationQueries)* q = (NAME(InterpolationQueries)*) ctx;
+    size_t end = ((size_t) hi * BATCH_BLOCK < q->n) ? (size_t) hi * BATCH_BLOCK : q->n;
+
+    for (size_t i = (size_t) lo * BATCH_BLOCK; i < end; i++) {
+        q->out[i] = NAME(spline_eval)((const NAME(Spline)*) q->fit, q->values[i]);
+    }
+}
+
+/* spline_eval at the n points values, spread over the thread pool. */
+void NAME(spline_eval_batch)(const NAME(Spline)* spline, const SCALAR* values, SCALAR* out, size_t n) {
+    NAME(InterpolationQueries) q = {spline, values, out, n};
+    int blocks = (int) ((n + BATCH_BLOCK - 1) / BATCH_BLOCK);
+
+    parallelFor(0, blocks, 64, NAME(splineBlocks), &q);
+}
+
+void NAME(spline_free)(NAME(Spline)* spline) {
+    free(spline->knots);
+    free(spline->coefficients);
+    *spline = (NAME(Spline)) {0};
+}
+
+/* Fills xs with the panels+1 abscissae a, a+step, ..., b. */
+void NAME(tabulate)(SCALAR a, SCALAR b, SCALAR step, int panels, SCALAR* xs) {
+    for (int i = 0; i < panels; i++) {
+        xs[i] = a + i * step;
+    }
+    xs[panels] = b;
+}
+
+/* Composite Simpson rule: method 1 is 1/3 over 100 panels, method 2 is 3/8 over 99. */
+SCALAR NAME(simpsons_rule)(SCALAR a, SCALAR b, Expr* expr, int method) {
+    if (method == 1) {
+        SCALAR step = (b-a)/100;
+        SCALAR xs[101], ys[101];
+        NAME(tabulate)(a, b, step, 100, xs);
+        NAME(evalBatch)(expr, xs, ys, 101);
+
+        SCALAR sum = ys[0] + ys[100];
+        for (int i = 1; i < 100; i++) {
+            if (i % 2 == 0) {
+                sum += 2 * ys[i];
+            } else {
+                sum += 4 * ys[i];
+            }
+        }
+
+        return (step / 3) * sum;
+    } else if (method == 2) {
+        SCALAR step = (b-a)/99;
+        SCALAR xs[100], ys[100];
+        NAME(tabulate)(a, b, step, 99, xs);
+        NAME(evalBatch)(expr, xs, ys, 100);
+
+        SCALAR sum = ys[0] + ys[99];
+        for (int i = 1; i < 99; i++) {
+            if (i % 3 == 0) {
+                sum += 2 * ys[i];
+            } else {
+                sum += 3 * ys[i];
+            }
+        }
+
+        return (3 * step / 8) * sum;
+    }
+
+    return 0;
+}
+
+SCALAR NAME(trapezoidal)(SCALAR a, SCALAR b, Expr* expr) {
+    SCALAR step = (b-a)/100;
+    SCALAR xs[101], ys[101];
+    NAME(tabulate)(a, b, step, 100, xs);
+    NAME(evalBatch)(expr, xs, ys, 101);
+
+    SCALAR sum = 0.5*(ys[0] + ys[100]);
+    for (int i = 1; i < 100; i++) {
+        sum += ys[i];
+    }
+
+    return sum*step;
+}
+
+typedef struct {
+    SCALAR a;
+    SCALAR b;
+    SCALAR value;
+    SCALAR error;
+} NAME(QuadInterval);
+
+/*
+ * Applies the 15-point Kronrod rule to count intervals at once: all nodes
+ * go through a single evalBatch, using work (30 * count scalars) for the
+ * abscissae and values. The error of each interval is the QUADPACK estimate
+ * built from the embedded 7-point Gauss rule.
+ */
+void NAME(kronrodIntervals)(Expr* expr, NAME(QuadInterval)* intervals, int count, SCALAR* work) {
+    SCALAR* xs = work;
+    SCALAR* ys = work + 15 * count;
+
+    for (int k = 0; k < count; k++) {
+        SCALAR center = (intervals[k].a + intervals[k].b) / 2;
+        SCALAR half = (intervals[k].b - intervals[k].a) / 2;
+        xs[15*k] = center;
+        for (int j = 0; j < 7; j++) {
+            xs[15*k + 1 + 2*j] = center - half * (SCALAR) kronrodNodes[j];
+            xs[15*k + 2 + 2*j] = center + half * (SCALAR) kronrodNodes[j];
+        }
+    }
+    NAME(evalBatch)(expr, xs, ys, 15 * count);
+
+    for (int k = 0; k < count; k++) {
+        SCALAR* y = ys + 15*k;
+        SCALAR half = (intervals[k].b - intervals[k].a) / 2;
+        SCALAR kronrod = (SCALAR) kronrodWeights[7] * y[0];
+        SCALAR gauss = (SCALAR) gaussWeights[3] * y[0];
+        for (int j = 0; j < 7; j++) {
+            SCALAR pair = y[1 + 2*j] + y[2 + 2*j];
+            kronrod += (SCALAR) kronrodWeights[j] * pair;
+            if (j % 2 == 1) {
+                gauss += (SCALAR) gaussWeights[j / 2] * pair;
+            }
+        }
+
+        SCALAR mean = kronrod / 2;
+        SCALAR spread = (SCALAR) kronrodWeights[7] * MATH(fabs)(y[0] - mean);
+        for (int j = 0; j < 7; j++) {
+            spread += (SCALAR) kronrodWeights[j] * (MATH(fabs)(y[1 + 2*j] - mean) + MATH(fabs)(y[2 + 2*j] - mean));
+        }
+        spread *= MATH(fabs)(half);
+
+        SCALAR error = MATH(fabs)((kronrod - gauss) * half);
+        if (spread != 0 && error != 0) {
+            SCALAR scale = MATH(pow)(200 * error / spread, (SCALAR) 1.5);
+            error = spread * (scale < 1 ? scale : 1);
+        }
+        intervals[k].value = kronrod * half;
+        intervals[k].error = error;
+    }
+}
+
+/* Restores the max-heap on error after heap[index] grew or was appended. */
+void NAME(quadSiftUp)(NAME(QuadInterval)* heap, int index) {
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (heap[parent].error >= heap[index].error) {
+            break;
+        }
+        NAME(QuadInterval) temp = heap[parent];
+        heap[parent] = heap[index];
+        heap[index] = temp;
+        index = parent;
+    }
+}
+
+void NAME(quadSiftDown)(NAME(QuadInterval)* heap, int count, int index) {
+    for (;;) {
+        int largest = index;
+        int left = 2*index + 1;
+        int right = left + 1;
+        if (left < count && heap[left].error > heap[largest].error) {
+            largest = left;
+        }
+        if (right < count && heap[right].error > heap[largest].error) {
+            largest = right;
+        }
+        if (largest == index) {
+            break;
+        }
+        NAME(QuadInterval) temp = heap[largest];
+        heap[largest] = heap[index];
+        heap[index] = temp;
+        index = largest;
+    }
+}
+
+/*
+ * Globally adaptive Gauss-Kronrod 7-15 integration of expr over [a, b].
+ * The interval with the largest error estimate is bisected until the summed
+ * estimate drops below max(absTol, relTol * |value|) or maxIntervals is
+ * reached. Returns 0 on convergence, -1 otherwise; result holds the value,
+ * the error estimate and the work done either way.
+ */
+int NAME(gauss_kronrod)(SCALAR a, SCALAR b, Expr* expr, SCALAR absTol, SCALAR relTol, int maxIntervals, NAME(Quadrature)* result) {
+    if (maxIntervals < 1) {
+        maxIntervals = 1;
+    }
+    NAME(QuadInterval)* heap = (NAME(QuadInterval)*) malloc(maxIntervals * sizeof(NAME(QuadInterval)));
+    SCALAR work[2 * 30];
+    int count = 1;
+    int status = -1;
+
+    heap[0].a = a;
+    heap[0].b = b;
+    NAME(kronrodIntervals)(expr, heap, 1, work);
+    result->evaluations = 15;
+
+    for (;;) {
+        SCALAR value = 0;
+        SCALAR error = 0;
+        for (int k = 0; k < count; k++) {
+            value += heap[k].value;
+            error += heap[k].error;
+        }
+        result->value = value;
+        result->error = error;
+
+        SCALAR target = relTol * MATH(fabs)(value);
+        if (error <= absTol || error <= target) {
+            status = 0;
+            break;
+        }
+        /* Roundoff floor: the worst interval cannot be resolved any further. */
+        SCALAR mid = (heap[0].a + heap[0].b) / 2;
+        if (count + 1 > maxIntervals || mid <= heap[0].a || mid >= heap[0].b
+            || heap[0].error <= 50 * SCALAR_MACHEPS * MATH(fabs)(heap[0].value)) {
+            break;
+        }
+
+        NAME(QuadInterval) halves[2] = {{heap[0].a, mid, 0, 0}, {mid, heap[0].b, 0, 0}};
+        NAME(kronrodIntervals)(expr, halves, 2, work);
+        result->evaluations += 30;
+
+        heap[0] = halves[0];
+        NAME(quadSiftDown)(heap, count, 0);
+        heap[count] = halves[1];
+        NAME(quadSiftUp)(heap, count);
+        count++;
+    }
+
+    result->intervals = count;
+    free(heap);
+    return status;
+}
+
+typedef struct {
+    Expr* expr;
+    const SCALAR* bounds;
+    SCALAR absTol;
+    SCALAR relTol;
+    int maxIntervals;
+    SCALAR* values;
+    SCALAR* errors;
+    atomic_int failures;
+    atomic_int evaluations;
+} NAME(BatchQuadrature);
+
+void NAME(integrateRange)(void* ctx, int lo, int hi) {
+    NAME(BatchQuadrature)* c = (NAME(BatchQuadrature)*) ctx;
+    int failures = 0;
+    int evaluations = 0;
+
+    for (int i = lo; i < hi; i++) {
+        NAME(Quadrature) result;
+        if (NAME(gauss_kronrod)(c->bounds[2*i], c->bounds[2*i + 1], c->expr, c->absTol, c->relTol, c->maxIntervals, &result) != 0) {
+            failures++;
+        }
+        c->values[i] = result.value;
+        if (c->errors != NULL) {
+            c->errors[i] = result.error;
+        }
+        evaluations += result.evaluations;
+    }
+    atomic_fetch_add(&c->failures, failures);
+    atomic_fetch_add(&c->evaluations, evaluations);
+}
+
+/*
+ * Integrates expr adaptively (gauss_kronrod) over count intervals, bounds
+ * holding the pairs a0, b0, a1, b1, ... Intervals are handed out one at a
+ * time through the thread pool, so a few expensive ones do not hold up the
+ * rest. Fills values and, if not NULL, errors; returns how many intervals
+ * missed the tolerance. evaluations, if not NULL, receives the total count.
+ */
+int NAME(integrate_batch)(Expr* expr, int count, const SCALAR* bounds, SCALAR absTol, SCALAR relTol, int maxIntervals, SCALAR* values, SCALAR* errors, int* evaluations) {
+    NAME(BatchQuadrature) ctx = {expr, bounds, absTol, relTol, maxIntervals, values, errors, 0, 0};
+
+    parallelFor(0, count, 1, NAME(integrateRange), &ctx);
+    if (evaluations != NULL) {
+        *evaluations = atomic_load(&ctx.evaluations);
+    }
+    return atomic_load(&ctx.failures);
+}
+
+/*
+ * Romberg integration of expr over [a, b]. Each level halves the trapezoid
+ * step, evaluating only the new midpoints (in evalBatch blocks) and reusing
+ * the previous sum; Richardson extrapolation of the trapezoid sums fills
+ * one tableau row per level. Converges when two successive diagonal
+ * entries agree to max(absTol, relTol * |value|), after at least 4 levels,
+ * or fails with -1 after maxLevels (at most MAX_ROMBERG) halvings.
+ */
+int NAME(romberg)(SCALAR a, SCALAR b, Expr* expr, SCALAR absTol, SCALAR relTol, int maxLevels, NAME(Quadrature)* result) {
+    SCALAR previous[MAX_ROMBERG + 1];
+    SCALAR current[MAX_ROMBERG + 1];
+    SCALAR xs[BATCH_BLOCK];
+    SCALAR ys[BATCH_BLOCK];
+    SCALAR ends[2] = {a, b};
+    SCALAR length = b - a;
+    int status = -1;
+
+    if (maxLevels > MAX_ROMBERG) {
+        maxLevels = MAX_ROMBERG;
+    }
+
+    NAME(evalBatch)(expr, ends, ys, 2);
+    previous[0] = length * (ys[0] + ys[1]) / 2;
+    result->value = previous[0];
+    result->error = MATH(fabs)(previous[0]);
+    result->evaluations = 2;
+    result->intervals = 1;
+
+    for (int level = 1; level <= maxLevels; level++) {
+        long panels = 1L << (level - 1);
+        SCALAR step = length / panels;
+        SCALAR sum = 0;
+
+        for (long i = 0; i < panels; i += BATCH_BLOCK) {
+            int count = (panels - i < BATCH_BLOCK) ? (int) (panels - i) : BATCH_BLOCK;
+            for (int j = 0; j < count; j++) {
+                xs[j] = a + (i + j + (SCALAR) 0.5) * step;
+            }
+            NAME(evalBatch)(expr, xs, ys, count);
+            for (int j = 0; j < count; j++) {
+                sum += ys[j];
+            }
+        }
+        result->evaluations += panels;
+        result->intervals = 2 * panels;
+
+        current[0] = previous[0] / 2 + sum * step / 2;
+        SCALAR factor = 1;
+        for (int j = 1; j <= level; j++) {
+            factor *= 4;
+            current[j] = current[j-1] + (current[j-1] - previous[j-1]) / (factor - 1);
+        }
+
+        result->error = MATH(fabs)(current[level] - previous[level-1]);
+        result->value = current[level];
+        if (level >= 4 && (result->error <= absTol || result->error <= relTol * MATH(fabs)(result->value))) {
+            status = 0;
+            break;
+        }
+        memcpy(previous, current, (level + 1) * sizeof(SCALAR));
+    }
+
+    return status;
+}
+
+/*
+ * Factors the n x n row-major matrix (row pitch lda) into lu, which owns
+ * its storage until lu_free. Right-looking blocked algorithm: an LU_BLOCK
+ * wide panel is factored unblocked, the matching block row of U is solved,
+ * and the trailing matrix gets a rank-LU_BLOCK update in column tiles of
+ * LU_TILE so the U block being reused stays in cache.
+ * Returns 0, or -1 if the matrix is singular or there is no memory.
+ */
+int NAME(lu_factor)(NAME(LUFactor)* lu, int n, const SCALAR* matrix, int lda) {
+    int perLine = 64 / sizeof(SCALAR);
+    int stride = (n + perLine - 1) / perLine * perLine;
+    SCALAR* a = (SCALAR*) alignedAlloc((size_t) n * stride * sizeof(SCALAR));
+
+    lu->n = n;
+    lu->stride = stride;
+    lu->data = a;
+    lu->pivots = (int*) malloc(n * sizeof(int));
+    if (a == NULL || lu->pivots == NULL) {
+        return -1;
+    }
+
+    for (int i = 0; i < n; i++) {
+        memcpy(a + (size_t) i*stride, matrix + (size_t) i*lda, n * sizeof(SCALAR));
+    }
+
+    for (int k0 = 0; k0 < n; k0 += LU_BLOCK) {
+        int k1 = (k0 + LU_BLOCK < n) ? k0 + LU_BLOCK : n;
+
+        for (int j = k0; j < k1; j++) {
+            int p = j;
+            for (int i = j+1; i < n; i++) {
+                if (MATH(fabs)(a[(size_t) i*stride + j]) > MATH(fabs)(a[(size_t) p*stride + j])) {
+                    p = i;
+                }
+            }
+            if (a[(size_t) p*stride + j] == 0) {
+                return -1;
+            }
+
+            lu->pivots[j] = p;
+            if (p != j) {
+                SCALAR* rowJ = a + (size_t) j*stride;
+                SCALAR* rowP = a + (size_t) p*stride;
+                for (int c = 0; c < n; c++) {
+                    SCALAR temp = rowJ[c];
+                    rowJ[c] = rowP[c];
+                    rowP[c] = temp;
+                }
+            }
+
+            SCALAR* pivotRow = a + (size_t) j*stride;
+            for (int i = j+1; i < n; i++) {
+                SCALAR* row = a + (size_t) i*stride;
+                SCALAR l = row[j] /= pivotRow[j];
+                for (int c = j+1; c < k1; c++) {
+                    row[c] -= l * pivotRow[c];
+                }
+            }
+        }
+
+        for (int j = k0; j < k1; j++) {
+            SCALAR* pivotRow = a + (size_t) j*stride;
+            for (int i = j+1; i < k1; i++) {
+                SCALAR* row = a + (size_t) i*stride;
+                SCALAR l = row[j];
+                for (int c = k1; c < n; c++) {
+                    row[c] -= l * pivotRow[c];
+                }
+            }
+        }
+
+        for (int c0 = k1; c0 < n; c0 += LU_TILE) {
+            int c1 = (c0 + LU_TILE < n) ? c0 + LU_TILE : n;
+            for (int i = k1; i < n; i++) {
+                SCALAR* row = a + (size_t) i*stride;
+                for (int k = k0; k < k1; k++) {
+                    SCALAR l = row[k];
+                    SCALAR* pivotRow = a + (size_t) k*stride;
+                    for (int c = c0; c < c1; c++) {
+                        row[c] -= l * pivotRow[c];
+                    }
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Solves A X = B in place for the nrhs right-hand sides stored row-major in
+ * rhs (n x nrhs), reusing a factorization from lu_factor.
+ */
+void NAME(lu_solve)(NAME(LUFactor)* lu, SCALAR* rhs, int nrhs) {
+    int n = lu->n;
+    int stride = lu->stride;
+    SCALAR* a = lu->data;
+
+    for (int i = 0; i < n; i++) {
+        int p = lu->pivots[i];
+        if (p != i) {
+            for (int c = 0; c < nrhs; c++) {
+                SCALAR temp = rhs[(size_t) i*nrhs + c];
+                rhs[(size_t) i*nrhs + c] = rhs[(size_t) p*nrhs + c];
+                rhs[(size_t) p*nrhs + c] = temp;
+            }
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        SCALAR* row = a + (size_t) i*stride;
+        SCALAR* x = rhs + (size_t) i*nrhs;
+        for (int k = 0; k < i; k++) {
+            SCALAR* y = rhs + (size_t) k*nrhs;
+            for (int c = 0; c < nrhs; c++) {
+                x[c] -= row[k] * y[c];
+            }
+        }
+    }
+
+    for (int i = n-1; i >= 0; i--) {
+        SCALAR* row = a + (size_t) i*stride;
+        SCALAR* x = rhs + (size_t) i*nrhs;
+        for (int k = i+1; k < n; k++) {
+            SCALAR* y = rhs + (size_t) k*nrhs;
+            for (int c = 0; c < nrhs; c++) {
+                x[c] -= row[k] * y[c];
+            }
+        }
+        for (int c = 0; c < nrhs; c++) {
+            x[c] /= row[i];
+        }
+    }
+}
+
+void NAME(lu_free)(NAME(LUFactor)* lu) {
+    free(lu->data);
+    free(lu->pivots);
+    lu->data = NULL;
+    lu->pivots = NULL;
+}
+
+/*
+ * Solves the n x (n+1) augmented system stored row-major in matrix through
+ * lu_factor/lu_solve. Returns 0, or -1 if the system is singular.
+ */
+int NAME(gauss_solve)(int n, SCALAR* matrix, SCALAR* solution) {
+    NAME(LUFactor) lu;
+    int status = NAME(lu_factor)(&lu, n, matrix, n + 1);
+
+    if (status == 0) {
+        for (int i = 0; i < n; i++) {
+            solution[i] = matrix[(size_t) i*(n+1) + n];
+        }
+        NAME(lu_solve)(&lu, solution, 1);
+    }
+
+    NAME(lu_free)(&lu);
+    return status;
+}
+
+typedef struct {
+    int n;
+    int pivot;
+    SCALAR* matrix;
+    SCALAR* inverse;
+} NAME(InvertStep);
+
+/* Eliminates column step->pivot from rows [lo, hi) of both matrices. */
+void NAME(invertRows)(void* ctx, int lo, int hi) {
+    NAME(InvertStep)* step = (NAME(InvertStep)*) ctx;
+    int n = step->n;
+    int i = step->pivot;
+    SCALAR* pivotRow = step->matrix + (size_t) i*n;
+    SCALAR* pivotInv = step->inverse + (size_t) i*n;
+
+    for (int k = lo; k < hi; k++) {
+        SCALAR* row = step->matrix + (size_t) k*n;
+        SCALAR factor = row[i];
+        if (k == i || factor == 0) {
+            continue;
+        }
+
+        SCALAR* inv = step->inverse + (size_t) k*n;
+        row[i] = 0;
+        for (int j = i+1; j < n; j++) {
+            row[j] -= factor * pivotRow[j];
+        }
+        for (int j = 0; j < n; j++) {
+            inv[j] -= factor * pivotInv[j];
+        }
+    }
+}
+
+/*
+ * Gauss-Jordan inversion of the n x n row-major matrix, which is overwritten.
+ * Each column is pivoted on its largest remaining entry; the row updates for
+ * that pivot are independent and are split across the thread pool. Returns 0,
+ * or -1 if a pivot is negligible relative to the largest entry (singular).
+ */
+int NAME(invert_matrix)(int n, SCALAR* matrix, SCALAR* inverse) {
+    SCALAR norm = 0;
+
+    for (size_t i = 0; i < (size_t) n*n; i++) {
+        if (MATH(fabs)(matrix[i]) > norm) {
+            norm = MATH(fabs)(matrix[i]);
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            inverse[(size_t) i*n + j] = (i == j) ? 1.0 : 0.0;
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        int p = i;
+        for (int k = i+1; k < n; k++) {
+            if (MATH(fabs)(matrix[(size_t) k*n + i]) > MATH(fabs)(matrix[(size_t) p*n + i])) {
+                p = k;
+            }
+        }
+        if (MATH(fabs)(matrix[(size_t) p*n + i]) <= n * SCALAR_MACHEPS * norm) {
+            return -1;
+        }
+
+        if (p != i) {
+            for (int j = 0; j < n; j++) {
+                SCALAR temp = matrix[(size_t) i*n + j];
+                matrix[(size_t) i*n + j] = matrix[(size_t) p*n + j];
+                matrix[(size_t) p*n + j] = temp;
+                temp = inverse[(size_t) i*n + j];
+                inverse[(size_t) i*n + j] = inverse[(size_t) p*n + j];
+                inverse[(size_t) p*n + j] = temp;
+            }
+        }
+
+        SCALAR pivot = matrix[(size_t) i*n + i];
+        for (int j = 0; j < n; j++) {
+            matrix[(size_t) i*n + j] /= pivot;
+            inverse[(size_t) i*n + j] /= pivot;
+        }
+
+        NAME(InvertStep) step = {n, i, matrix, inverse};
+        parallelFor(0, n, 16, NAME(invertRows), &step);
+    }
+
+    return 0;
+}
+
+void NAME(csr_alloc)(NAME(CSRMatrix)* csr, int rows, int nnz) {
+    csr->rows = rows;
+    csr->nnz = nnz;
+    csr->rowStart = (int*) calloc(rows + 1, sizeof(int));
+    csr->cols = (int*) malloc((nnz > 0 ? nnz : 1) * sizeof(int));
+    csr->values = (SCALAR*) malloc((nnz > 0 ? nnz : 1) * sizeof(SCALAR));
+    csr->diag = (int*) malloc((rows > 0 ? rows : 1) * sizeof(int));
+}
+
+void NAME(csr_find_diagonal)(NAME(CSRMatrix)* csr) {
+    for (int i = 0; i < csr->rows; i++) {
+        csr->diag[i] = -1;
+        for (int k = csr->rowStart[i]; k < csr->rowStart[i+1]; k++) {
+            if (csr->cols[k] == i) {
+                csr->diag[i] = k;
+            }
+        }
+    }
+}
+
+/* Builds a CSR matrix from the non-zeros of a dense row-major matrix with row pitch lda. */
+void NAME(csr_from_dense)(NAME(CSRMatrix)* csr, int rows, int cols, const SCALAR* matrix, int lda) {
+    int nnz = 0;
+
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            nnz += matrix[(size_t) i*lda + j] != 0;
+        }
+    }
+
+    NAME(csr_alloc)(csr, rows, nnz);
+    nnz = 0;
+    for (int i = 0; i < rows; i++) {
+        csr->rowStart[i] = nnz;
+        for (int j = 0; j < cols; j++) {
+            if (matrix[(size_t) i*lda + j] != 0) {
+                csr->cols[nnz] = j;
+                csr->values[nnz++] = matrix[(size_t) i*lda + j];
+            }
+        }
+    }
+    csr->rowStart[rows] = nnz;
+    NAME(csr_find_diagonal)(csr);
+}
+
+/*
+ * Builds a CSR matrix from nnz (row, col, value) triplets in any order with a
+ * counting sort on the row index. Duplicate entries are kept and summed by
+ * every kernel that walks the row.
+ */
+void NAME(csr_from_triplets)(NAME(CSRMatrix)* csr, int rows, int nnz, const int* rowIndex, const int* colIndex, const SCALAR* values) {
+    NAME(csr_alloc)(csr, rows, nnz);
+
+    for (int k = 0; k < nnz; k++) {
+        csr->rowStart[rowIndex[k] + 1]++;
+    }
+    for (int i = 0; i < rows; i++) {
+        csr->rowStart[i+1] += csr->rowStart[i];
+    }
+
+    int* fill = (int*) malloc((rows > 0 ? rows : 1) * sizeof(int));
+    memcpy(fill, csr->rowStart, rows * sizeof(int));
+    for (int k = 0; k < nnz; k++) {
+        int at = fill[rowIndex[k]]++;
+        csr->cols[at] = colIndex[k];
+        csr->values[at] = values[k];
+    }
+    free(fill);
+    NAME(csr_find_diagonal)(csr);
+}
+
+void NAME(csr_free)(NAME(CSRMatrix)* csr) {
+    free(csr->rowStart);
+    free(csr->cols);
+    free(csr->values);
+    free(csr->diag);
+    *csr = (NAME(CSRMatrix)) {0};
+}
+
+/*
+ * Successive over-relaxation on A x = b, starting from the contents of x.
+ * omega = 1 is plain Gauss-Seidel. Each sweep only touches the stored
+ * non-zeros. Iteration stops once the sum of |x_new - x_old| over a sweep
+ * drops below tolerance. Returns the number of sweeps, or -1 if a diagonal
+ * entry is missing or maxIterations is reached first.
+ */
+int NAME(sor_solve)(NAME(CSRMatrix)* A, const SCALAR* b, SCALAR* x, SCALAR omega, SCALAR tolerance, int maxIterations) {
+    for (int i = 0; i < A->rows; i++) {
+        if (A->diag[i] < 0 || A->values[A->diag[i]] == 0) {
+            return -1;
+        }
+    }
+
+    for (int iter = 1; iter <= maxIterations; iter++) {
+        SCALAR err = 0;
+
+        for (int i = 0; i < A->rows; i++) {
+            SCALAR residual = b[i];
+            for (int k = A->rowStart[i]; k < A->rowStart[i+1]; k++) {
+                residual -= A->values[k] * x[A->cols[k]];
+            }
+            SCALAR delta = omega * residual / A->values[A->diag[i]];
+            x[i] += delta;
+            err += MATH(fabs)(delta);
+        }
+
+        if (err < tolerance) {
+            return iter;
+        }
+    }
+
+    return -1;
+}
+
+int NAME(sparse_gauss_seidel)(NAME(CSRMatrix)* A, const SCALAR* b, SCALAR* x, SCALAR tolerance, int maxIterations) {
+    return NAME(sor_solve)(A, b, x, 1, tolerance, maxIterations);
+}
+
+/*
+ * Greedy colouring of the symmetrised sparsity graph of A: every row gets the
+ * smallest colour not used by a row it reads or that reads it, so rows of one
+ * colour can be relaxed concurrently. On a 5-point grid in natural order this
+ * is exactly the red-black colouring. Fills colors[rows] and returns the
+ * number of colours.
+ */
+int NAME(csr_color)(NAME(CSRMatrix)* A, int* colors) {
+    int n = A->rows;
+    int* tStart = (int*) calloc(n + 1, sizeof(int));
+    int* tRows = (int*) malloc((A->nnz > 0 ? A->nnz : 1) * sizeof(int));
+    int* mark = (int*) malloc((n + 1) * sizeof(int));
+    int numColors = 0;
+
+    for (int k = 0; k < A->nnz; k++) {
+        tStart[A->cols[k] + 1]++;
+    }
+    for (int i = 0; i < n; i++) {
+        tStart[i+1] += tStart[i];
+    }
+    int* fill = (int*) malloc((n > 0 ? n : 1) * sizeof(int));
+    memcpy(fill, tStart, n * sizeof(int));
+    for (int i = 0; i < n; i++) {
+        for (int k = A->rowStart[i]; k < A->rowStart[i+1]; k++) {
+            tRows[fill[A->cols[k]]++] = i;
+        }
+    }
+    free(fill);
+
+    for (int i = 0; i <= n; i++) {
+        mark[i] = -1;
+    }
+    for (int i = 0; i < n; i++) {
+        for (int k = A->rowStart[i]; k < A->rowStart[i+1]; k++) {
+            int j = A->cols[k];
+            if (j < i) {
+                mark[colors[j]] = i;
+            }
+        }
+        for (int k = tStart[i]; k < tStart[i+1]; k++) {
+            int j = tRows[k];
+            if (j < i) {
+                mark[colors[j]] = i;
+            }
+        }
+
+        int color = 0;
+        while (mark[color] == i) {
+            color++;
+        }
+        colors[i] = color;
+        if (color + 1 > numColors) {
+            numColors = color + 1;
+        }
+    }
+
+    free(tStart);
+    free(tRows);
+    free(mark);
+    return numColors;
+}
+
+typedef struct {
+    NAME(CSRMatrix)* A;
+    const SCALAR* b;
+    SCALAR* x;
+    SCALAR* xNew;
+    const int* order;
+    SCALAR omega;
+    SCALAR* partial;
+} NAME(RelaxContext);
+
+/* Relaxes rows order[lo..hi) in place; they share a colour, so none reads another. */
+void NAME(relaxColorRows)(void* ctx, int lo, int hi) {
+    NAME(RelaxContext)* c = (NAME(RelaxContext)*) ctx;
+    NAME(CSRMatrix)* A = c->A;
+
+    for (int idx = lo; idx < hi; idx++) {
+        int i = c->order[idx];
+        SCALAR residual = c->b[i];
+        for (int k = A->rowStart[i]; k < A->rowStart[i+1]; k++) {
+            residual -= A->values[k] * c->x[A->cols[k]];
+        }
+        c->x[i] += c->omega * residual / A->values[A->diag[i]];
+    }
+}
+
+void NAME(jacobiRows)(void* ctx, int lo, int hi) {
+    NAME(RelaxContext)* c = (NAME(RelaxContext)*) ctx;
+    NAME(CSRMatrix)* A = c->A;
+
+    for (int i = lo; i < hi; i++) {
+        SCALAR residual = c->b[i];
+        for (int k = A->rowStart[i]; k < A->rowStart[i+1]; k++) {
+            residual -= A->values[k] * c->x[A->cols[k]];
+        }
+        c->xNew[i] = c->x[i] + c->omega * residual / A->values[A->diag[i]];
+    }
+}
+
+/* Squared residual of rows [lo, hi) into partial[lo / RELAX_CHUNK]. */
+void NAME(residualRows)(void* ctx, int lo, int hi) {
+    NAME(RelaxContext)* c = (NAME(RelaxContext)*) ctx;
+    NAME(CSRMatrix)* A = c->A;
+    SCALAR sum = 0;
+
+    for (int i = lo; i < hi; i++) {
+        SCALAR residual = c->b[i];
+        for (int k = A->rowStart[i]; k < A->rowStart[i+1]; k++) {
+            residual -= A->values[k] * c->x[A->cols[k]];
+        }
+        sum += residual * residual;
+    }
+    c->partial[lo / RELAX_CHUNK] = sum;
+}
+
+/*
+ * Parallel stationary iteration on A x = b from the contents of x.
+ * RELAX_MULTICOLOR does Gauss-Seidel/SOR one colour class at a time (see
+ * csr_color), each class split over the thread pool; RELAX_JACOBI is the
+ * fully parallel, slower-converging baseline (omega damps it). Stops when
+ * ||b - Ax|| <= tolerance * ||b||. Returns the number of sweeps, or -1 on a
+ * missing diagonal or when maxIterations is exhausted.
+ */
+int NAME(parallel_relax)(NAME(CSRMatrix)* A, const SCALAR* b, SCALAR* x, int mode, SCALAR omega, SCALAR tolerance, int maxIterations) {
+    int n = A->rows;
+    int chunks = n / RELAX_CHUNK + 1;
+    int numColors = 0;
+    int* colorStart = NULL;
+    int* order = NULL;
+    int sweeps = -1;
+
+    for (int i = 0; i < n; i++) {
+        if (A->diag[i] < 0 || A->values[A->diag[i]] == 0) {
+            return -1;
+        }
+    }
+
+    NAME(RelaxContext) ctx = {A, b, x, NULL, NULL, omega, (SCALAR*) calloc(chunks, sizeof(SCALAR))};
+
+    if (mode == RELAX_MULTICOLOR) {
+        int* colors = (int*) malloc((n > 0 ? n : 1) * sizeof(int));
+        numColors = NAME(csr_color)(A, colors);
+        colorStart = (int*) calloc(numColors + 1, sizeof(int));
+        order = (int*) malloc((n > 0 ? n : 1) * sizeof(int));
+        for (int i = 0; i < n; i++) {
+            colorStart[colors[i] + 1]++;
+        }
+        for (int c = 0; c < numColors; c++) {
+            colorStart[c+1] += colorStart[c];
+        }
+        int* fill = (int*) malloc((numColors > 0 ? numColors : 1) * sizeof(int));
+        memcpy(fill, colorStart, numColors * sizeof(int));
+        for (int i = 0; i < n; i++) {
+            order[fill[colors[i]]++] = i;
+        }
+        free(fill);
+        free(colors);
+        ctx.order = order;
+    } else {
+        ctx.xNew = (SCALAR*) malloc((n > 0 ? n : 1) * sizeof(SCALAR));
+    }
+
+    SCALAR bNorm = 0;
+    for (int i = 0; i < n; i++) {
+        bNorm += b[i] * b[i];
+    }
+    SCALAR limit = tolerance * tolerance * bNorm;
+
+    for (int iter = 1; iter <= maxIterations; iter++) {
+        if (mode == RELAX_MULTICOLOR) {
+            for (int c = 0; c < numColors; c++) {
+                parallelFor(colorStart[c], colorStart[c+1], RELAX_CHUNK, NAME(relaxColorRows), &ctx);
+            }
+        } else {
+            parallelFor(0, n, RELAX_CHUNK, NAME(jacobiRows), &ctx);
+            SCALAR* temp = ctx.x;
+            ctx.x = ctx.xNew;
+            ctx.xNew = temp;
+        }
+
+        memset(ctx.partial, 0, chunks * sizeof(SCALAR));
+        parallelFor(0, n, RELAX_CHUNK, NAME(residualRows), &ctx);
+        SCALAR residual = 0;
+        for (int k = 0; k < chunks; k++) {
+            residual += ctx.partial[k];
+        }
+        if (residual <= limit) {
+            sweeps = iter;
+            break;
+        }
+    }
+
+    if (ctx.x != x) {
+        memcpy(x, ctx.x, n * sizeof(SCALAR));
+        ctx.xNew = ctx.x;
+    }
+    free(ctx.xNew);
+    free(ctx.partial);
+    free(colorStart);
+    free(order);
+    return sweeps;
+}
+
+/* Binds the unknowns x to slots 0..n-1 of equation and its own parameters to the slots after them. */
+void NAME(bindSystem)(Expr* equation, int n, const SCALAR* x, SCALAR* bindings) {
+    NAME(loadBindings)(equation, bindings);
+    memcpy(bindings, x, n * sizeof(SCALAR));
+}
+
+/* Evaluates the n equations at x into F and returns max |F_i|; width is the longest binding table. */
+SCALAR NAME(systemResidual)(Expr* equations, int n, int width, const SCALAR* x, SCALAR* F) {
+    SCALAR bindings[width];
+    SCALAR norm = 0;
+
+    for (int i = 0; i < n; i++) {
+        NAME(bindSystem)(&equations[i], n, x, bindings);
+        F[i] = NAME(evalBound)(&equations[i], bindings);
+        if (!(MATH(fabs)(F[i]) <= norm)) {
+            norm = MATH(fabs)(F[i]);
+        }
+    }
+    return norm;
+}
+
+typedef struct {
+    Expr* equations;
+    int n;
+    int width;
+    int jacobian;
+    const SCALAR* x;
+    const SCALAR* F;
+    const int* useStart;
+    const int* useSlots;
+    SCALAR* J;
+} NAME(JacobianRows);
+
+/*
+ * Fills rows [lo, hi) of the Jacobian. Only the unknowns an equation
+ * mentions are differentiated; the rest of its row is zero.
+ */
+void NAME(jacobianRows)(void* ctx, int lo, int hi) {
+    NAME(JacobianRows)* c = (NAME(JacobianRows)*) ctx;
+    SCALAR bindings[c->width];
+    SCALAR root = MATH(sqrt)(SCALAR_MACHEPS);
+
+    for (int i = lo; i < hi; i++) {
+        Expr* equation = &c->equations[i];
+        SCALAR* row = c->J + (size_t) i * c->n;
+
+        memset(row, 0, c->n * sizeof(SCALAR));
+        NAME(bindSystem)(equation, c->n, c->x, bindings);
+        for (int u = c->useStart[i]; u < c->useStart[i+1]; u++) {
+            int j = c->useSlots[u];
+            if (c->jacobian == JACOBIAN_DUAL) {
+                NAME(evalBoundDual)(equation, bindings, j, &row[j]);
+            } else {
+                /* Forward difference with a step scaled to x_j, rounded so x_j + h is exact. */
+                SCALAR xj = bindings[j];
+                SCALAR shifted = xj + root * ((MATH(fabs)(xj) > 1) ? MATH(fabs)(xj) : 1);
+                bindings[j] = shifted;
+                row[j] = (NAME(evalBound)(equation, bindings) - c->F[i]) / (shifted - xj);
+                bindings[j] = xj;
+            }
+        }
+    }
+}
+
+/*
+ * Solves the n equations F_i(x) = 0 for the n unknowns in variable slots
+ * 0..n-1 of every equation (see compileMultivariate); slots past n are
+ * parameters with the values setVariable gave them. x holds the starting
+ * point and receives the solution.
+ *
+ * Each step solves J s = -F with an LU factorization of the Jacobian J,
+ * built by forward differences (JACOBIAN_DIFFERENCE) or dual numbers
+ * (JACOBIAN_DUAL), row by row over the thread pool, and only for the
+ * unknowns each equation mentions. update decides how long a factorization
+ * is kept: UPDATE_NEWTON refactors every step; UPDATE_FROZEN reuses J while
+ * each step cuts max |F_i| by SYSTEM_CONTRACTION; UPDATE_BROYDEN does the
+ * same but corrects the steps with Broyden's rank-one updates, stored as
+ * up to MAX_BROYDEN previous steps and applied without refactoring. A
+ * step that contracts too little with an old J is discarded and J is
+ * rebuilt; a fresh J's step is halved until |F| decreases.
+ *
+ * Returns 0 once max |F_i| <= tolerance, -1 if maxIterations steps or a
+ * step that cannot decrease |F| come first, or -2 if a Jacobian is
+ * singular. result receives the statistics.
+ */
+int NAME(newton_system)(int n, Expr* equations, SCALAR* x, int jacobian, int update, SCALAR tolerance, int maxIterations, NAME(SystemResult)* result) {
+    int width = n;
+    int total = 0;
+    for (int i = 0; i < n; i++) {
+        width = (equations[i].variables > width) ? equations[i].variables : width;
+        total += equations[i].length;
+    }
+
+    /* Unknowns mentioned by each equation, as rows of a sparsity pattern. */
+    int* useStart = (int*) malloc((n + 1) * sizeof(int));
+    int* useSlots = (int*) malloc((total + 1) * sizeof(int));
+    int* seen = (int*) malloc(n * sizeof(int));
+    int uses = 0;
+    for (int j = 0; j < n; j++) {
+        seen[j] = -1;
+    }
+    for (int i = 0; i < n; i++) {
+        useStart[i] = uses;
+        for (int k = 0; k < equations[i].length; k++) {
+            Instr* instr = &equations[i].code[k];
+            if (instr->op == OP_VAR && instr->index < n && seen[instr->index] != i) {
+                seen[instr->index] = i;
+                useSlots[uses++] = instr->index;
+            }
+        }
+    }
+    useStart[n] = uses;
+    free(seen);
+
+    SCALAR* work = (SCALAR*) malloc(4 * (size_t) n * sizeof(SCALAR));
+    SCALAR* F = work;
+    SCALAR* FNew = work + n;
+    SCALAR* xNew = work + 2*n;
+    SCALAR* step = work + 3*n;
+    SCALAR* J = (SCALAR*) malloc((size_t) n * n * sizeof(SCALAR));
+    SCALAR* steps = (update == UPDATE_BROYDEN) ? (SCALAR*) malloc((size_t) MAX_BROYDEN * n * sizeof(SCALAR)) : NULL;
+    SCALAR squares[MAX_BROYDEN];
+    NAME(LUFactor) lu = {0};
+    NAME(JacobianRows) ctx = {equations, n, width, jacobian, x, F, useStart, useSlots, J};
+    int refresh = 1;
+    int fresh = 0;
+    int stored = 0;
+    int status = -1;
+    int i = 0;
+
+    tolerance = (tolerance > 0) ? tolerance : SCALAR_EPSILON;
+    maxIterations = (maxIterations > 0) ? maxIterations : MAX_ITERATIONS;
+    *result = (NAME(SystemResult)) {0};
+
+    SCALAR norm = NAME(systemResidual)(equations, n, width, x, F);
+    result->evaluations = n;
+    while (!(norm <= tolerance) && i < maxIterations) {
+        if (refresh) {
+            parallelFor(0, n, (n >= 64) ? 8 : n, NAME(jacobianRows), &ctx);
+            result->evaluations += uses;
+            result->jacobians++;
+            NAME(lu_free)(&lu);
+            if (NAME(lu_factor)(&lu, n, J, n) != 0) {
+                status = -2;
+                break;
+            }
+            refresh = 0;
+            fresh = 1;
+            stored = 0;
+        }
+
+        for (int k = 0; k < n; k++) {
+            step[k] = -F[k];
+        }
+        NAME(lu_solve)(&lu, step, 1);
+
+        if (stored > 0) {
+            /* Broyden: fold in the updates made by the stored steps s_0..s_m (Kelley's recursion). */
+            int m = stored - 1;
+            for (int j = 0; j < m; j++) {
+                SCALAR* s = steps + (size_t) j*n;
+                SCALAR dot = 0;
+                for (int k = 0; k < n; k++) {
+                    dot += s[k] * step[k];
+                }
+                dot /= squares[j];
+                for (int k = 0; k < n; k++) {
+                    step[k] += dot * s[n + k];
+                }
+            }
+            SCALAR dot = 0;
+            for (int k = 0; k < n; k++) {
+                dot += steps[(size_t) m*n + k] * step[k];
+            }
+            SCALAR denominator = 1 - dot / squares[m];
+            if (!(MATH(fabs)(denominator) > MATH(sqrt)(SCALAR_MACHEPS))) {
+                refresh = 1;
+                continue;
+            }
+            for (int k = 0; k < n; k++) {
+                step[k] /= denominator;
+            }
+        }
+
+        SCALAR lambda = 1;
+        SCALAR normNew = norm;
+        for (int halvings = 0; halvings <= 10; halvings++, lambda /= 2) {
+            for (int k = 0; k < n; k++) {
+                xNew[k] = x[k] + lambda * step[k];
+            }
+            normNew = NAME(systemResidual)(equations, n, width, xNew, FNew);
+            result->evaluations += n;
+            if (normNew < norm || !fresh) {
+                break;
+            }
+        }
+        i++;
+
+        if (!fresh && !(normNew <= SYSTEM_CONTRACTION * norm)) {
+            refresh = 1;
+            continue;
+        }
+        if (!(normNew < norm)) {
+            break;
+        }
+
+        memcpy(x, xNew, n * sizeof(SCALAR));
+        memcpy(F, FNew, n * sizeof(SCALAR));
+        norm = normNew;
+        fresh = 0;
+        if (update == UPDATE_NEWTON) {
+            refresh = 1;
+        } else if (update == UPDATE_BROYDEN) {
+            if (lambda == 1 && stored < MAX_BROYDEN) {
+                SCALAR* s = steps + (size_t) stored*n;
+                squares[stored] = 0;
+                for (int k = 0; k < n; k++) {
+                    s[k] = step[k];
+                    squares[stored] += step[k] * step[k];
+                }
+                stored++;
+            } else {
+                refresh = 1;
+            }
+        }
+    }
+
+    if (norm <= tolerance) {
+        status = 0;
+    }
+    result->residual = norm;
+    result->iterations = i;
+    NAME(lu_free)(&lu);
+    free(steps);
+    free(J);
+    free(work);
+    free(useSlots);
+    free(useStart);
+    return status;
+}
+
+#endif /* SCALAR_DEFINITIONS */
+
+#undef NAME
+#undef SCALAR
+#undef SFX
+#undef MATH
+#undef SCALAR_WIDE
+#undef SCALAR_PI
+#undef SCALAR_CONST
+#undef SCALAR_EPSILON
+#undef SCALAR_STEP
+#undef SCALAR_MACHEPS
+#undef SCALAR_IS_FLOAT